@@ -44,12 +44,17 @@ struct exposay_surface {
 
 	int row;
 	int column;
+	int slot;
 
 	/* The animations only apply a transformation for their own lifetime,
 	 * and don't have an option to indefinitely maintain the
 	 * transformation in a steady state - so, we apply our own once the
 	 * animation has finished. */
 	struct weston_transform transform;
+	bool transformed;
+
+	struct weston_view_animation *animation;
+	bool view_destroyed;
 };
 
 static void exposay_set_state(struct desktop_shell *shell,
@@ -57,12 +62,59 @@ static void exposay_set_state(struct desktop_shell *shell,
 			      struct weston_seat *seat);
 static void exposay_check_state(struct desktop_shell *shell);
 
+static void exposay_relayout(struct desktop_shell *shell,
+			     struct exposay_output *eoutput);
+
+/* Take the surface out of its output's grid, moving the ones after it
+ * up a slot. */
+static void
+exposay_surface_remove_slot(struct exposay_surface *esurface)
+{
+	struct exposay_output *eoutput = esurface->eoutput;
+	int i;
+
+	eoutput->num_surfaces--;
+	for (i = esurface->slot; i < eoutput->num_surfaces; i++) {
+		eoutput->slots[i] = eoutput->slots[i + 1];
+		eoutput->slots[i]->slot = i;
+	}
+}
+
+static int
+exposay_surface_add_slot(struct exposay_surface *esurface)
+{
+	struct exposay_output *eoutput = esurface->eoutput;
+	struct exposay_surface **slots;
+	int size;
+
+	if (eoutput->num_surfaces == eoutput->slots_size) {
+		size = eoutput->slots_size ? eoutput->slots_size * 2 : 16;
+		slots = realloc(eoutput->slots, size * sizeof *slots);
+		if (!slots)
+			return -1;
+		eoutput->slots = slots;
+		eoutput->slots_size = size;
+	}
+
+	esurface->slot = eoutput->num_surfaces++;
+	eoutput->slots[esurface->slot] = esurface;
+
+	return 0;
+}
+
 static void
 exposay_surface_destroy(struct exposay_surface *esurface)
 {
+	struct desktop_shell *shell = esurface->shell;
+
 	wl_list_remove(&esurface->link);
 	wl_list_remove(&esurface->view_destroy_listener.link);
 
+	exposay_surface_remove_slot(esurface);
+	if (shell->exposay.state_cur == EXPOSAY_LAYOUT_OVERVIEW ||
+	    shell->exposay.state_cur == EXPOSAY_LAYOUT_ANIMATE_TO_OVERVIEW)
+		exposay_relayout(shell, esurface->eoutput);
+
 	if (esurface->shell->exposay.focus_current == esurface->view)
 		esurface->shell->exposay.focus_current = NULL;
 	if (esurface->shell->exposay.focus_prev == esurface->view)
@@ -87,12 +139,8 @@ exposay_in_flight_dec(struct desktop_shell *shell)
 }
 
 static void
-exposay_animate_in_done(struct weston_view_animation *animation, void *data)
+exposay_surface_update_transform(struct exposay_surface *esurface)
 {
-	struct exposay_surface *esurface = data;
-
-	wl_list_insert(&esurface->view->geometry.transformation_list,
-	               &esurface->transform.link);
 	weston_matrix_init(&esurface->transform.matrix);
 	weston_matrix_scale(&esurface->transform.matrix,
 	                    esurface->scale, esurface->scale, 1.0f);
@@ -103,8 +151,28 @@ exposay_animate_in_done(struct weston_view_animation *animation, void *data)
 
 	weston_view_geometry_dirty(esurface->view);
 	weston_compositor_schedule_repaint(esurface->view->surface->compositor);
+}
+
+static void
+exposay_animate_in_done(struct weston_view_animation *animation, void *data)
+{
+	struct exposay_surface *esurface = data;
+	struct desktop_shell *shell = esurface->shell;
+
+	esurface->animation = NULL;
+
+	if (esurface->view_destroyed) {
+		exposay_surface_destroy(esurface);
+		exposay_in_flight_dec(shell);
+		return;
+	}
 
-	exposay_in_flight_dec(esurface->shell);
+	wl_list_insert(&esurface->view->geometry.transformation_list,
+	               &esurface->transform.link);
+	esurface->transformed = true;
+	exposay_surface_update_transform(esurface);
+
+	exposay_in_flight_dec(shell);
 }
 
 static void
@@ -112,11 +180,12 @@ exposay_animate_in(struct exposay_surface *esurface)
 {
 	exposay_in_flight_inc(esurface->shell);
 
-	weston_move_scale_run(esurface->view,
-	                      esurface->x - esurface->view->geometry.x,
-	                      esurface->y - esurface->view->geometry.y,
-			      1.0, esurface->scale, 0,
-	                      exposay_animate_in_done, esurface);
+	esurface->animation =
+		weston_move_scale_run(esurface->view,
+				      esurface->x - esurface->view->geometry.x,
+				      esurface->y - esurface->view->geometry.y,
+				      1.0, esurface->scale, 0,
+				      exposay_animate_in_done, esurface);
 }
 
 static void
@@ -137,14 +206,18 @@ exposay_animate_out(struct exposay_surface *esurface)
 
 	/* Remove the static transformation set up by
 	 * exposay_transform_in_done(). */
-	wl_list_remove(&esurface->transform.link);
+	if (esurface->transformed) {
+		wl_list_remove(&esurface->transform.link);
+		esurface->transformed = false;
+	}
 	weston_view_geometry_dirty(esurface->view);
 
-	weston_move_scale_run(esurface->view,
-	                      esurface->x - esurface->view->geometry.x,
-	                      esurface->y - esurface->view->geometry.y,
-			      1.0, esurface->scale, 1,
-			      exposay_animate_out_done, esurface);
+	esurface->animation =
+		weston_move_scale_run(esurface->view,
+				      esurface->x - esurface->view->geometry.x,
+				      esurface->y - esurface->view->geometry.y,
+				      1.0, esurface->scale, 1,
+				      exposay_animate_out_done, esurface);
 }
 
 static void
@@ -174,6 +247,68 @@ exposay_is_animating(struct desktop_shell *shell)
 	return (shell->exposay.in_flight > 0);
 }
 
+static struct exposay_surface *
+exposay_surface_at_slot(struct exposay_output *eoutput, int row, int column)
+{
+	int slot;
+
+	if (row < 0 || column < 0 || column >= eoutput->grid_size)
+		return NULL;
+
+	slot = row * eoutput->grid_size + column;
+	if (slot >= eoutput->num_surfaces)
+		return NULL;
+
+	return eoutput->slots[slot];
+}
+
+/* The grid cell under the point gives the only surface it can be on. */
+static struct exposay_surface *
+exposay_surface_at(struct desktop_shell *shell, int x, int y)
+{
+	struct shell_output *shell_output;
+	struct exposay_output *eoutput;
+	struct weston_output *output;
+	struct exposay_surface *esurface;
+	int pad, row, column, x0, y0;
+
+	wl_list_for_each(shell_output, &shell->output_list, link) {
+		eoutput = &shell_output->eoutput;
+		output = shell_output->output;
+
+		if (!pixman_region32_contains_point(&output->region,
+						    x, y, NULL))
+			continue;
+		if (eoutput->num_surfaces == 0)
+			return NULL;
+
+		pad = eoutput->surface_size + eoutput->padding_inner;
+		y0 = output->y + eoutput->vpadding_outer;
+		if (y < y0)
+			return NULL;
+		row = (y - y0) / pad;
+
+		x0 = output->x + eoutput->hpadding_outer;
+		if (row == eoutput->grid_size - 1)
+			x0 += eoutput->last_row_offset;
+		if (x < x0)
+			return NULL;
+		column = (x - x0) / pad;
+
+		esurface = exposay_surface_at_slot(eoutput, row, column);
+		if (!esurface)
+			return NULL;
+
+		if (x > esurface->x + esurface->width ||
+		    y > esurface->y + esurface->height)
+			return NULL;
+
+		return esurface;
+	}
+
+	return NULL;
+}
+
 static void
 exposay_pick(struct desktop_shell *shell, int x, int y)
 {
@@ -182,15 +317,9 @@ exposay_pick(struct desktop_shell *shell, int x, int y)
         if (exposay_is_animating(shell))
             return;
 
-	wl_list_for_each(esurface, &shell->exposay.surface_list, link) {
-		if (x < esurface->x || x > esurface->x + esurface->width)
-			continue;
-		if (y < esurface->y || y > esurface->y + esurface->height)
-			continue;
-
+	esurface = exposay_surface_at(shell, x, y);
+	if (esurface)
 		exposay_highlight_surface(shell, esurface);
-		return;
-	}
 }
 
 static void
@@ -200,32 +329,24 @@ handle_view_destroy(struct wl_listener *listener, void *data)
 						 struct exposay_surface,
 						 view_destroy_listener);
 
+	/* The view's destruction also ends a running animation, and its
+	 * done handler then finishes off the surface. */
+	if (esurface->animation) {
+		esurface->view_destroyed = true;
+		return;
+	}
+
 	exposay_surface_destroy(esurface);
 }
 
 /* Pretty lame layout for now; just tries to make a square.  Should take
- * aspect ratio into account really.  Also needs to be notified of surface
- * addition and removal and adjust layout/animate accordingly. */
-static enum exposay_layout_state
-exposay_layout(struct desktop_shell *shell, struct shell_output *shell_output)
+ * aspect ratio into account really. */
+static void
+exposay_layout_grid(struct exposay_output *eoutput,
+		    struct weston_output *output)
 {
-	struct workspace *workspace = shell->exposay.workspace;
-	struct weston_output *output = shell_output->output;
-	struct exposay_output *eoutput = &shell_output->eoutput;
-	struct weston_view *view;
-	struct exposay_surface *esurface, *highlight = NULL;
 	int w, h;
-	int i;
-	int last_row_removed = 0;
-
-	eoutput->num_surfaces = 0;
-	wl_list_for_each(view, &workspace->layer.view_list.link, layer_link.link) {
-		if (!get_shell_surface(view->surface))
-			continue;
-		if (view->output != output)
-			continue;
-		eoutput->num_surfaces++;
-	}
+	int last_row_removed;
 
 	if (eoutput->num_surfaces == 0) {
 		eoutput->grid_size = 0;
@@ -233,7 +354,8 @@ exposay_layout(struct desktop_shell *shell, struct shell_output *shell_output)
 		eoutput->vpadding_outer = 0;
 		eoutput->padding_inner = 0;
 		eoutput->surface_size = 0;
-		return EXPOSAY_LAYOUT_OVERVIEW;
+		eoutput->last_row_offset = 0;
+		return;
 	}
 
 	/* Lay the grid out as square as possible, losing surfaces from the
@@ -271,56 +393,144 @@ exposay_layout(struct desktop_shell *shell, struct shell_output *shell_output)
 	if (eoutput->surface_size > (output->height / 2))
 		eoutput->surface_size = output->height / 2;
 
-	i = 0;
-	wl_list_for_each(view, &workspace->layer.view_list.link, layer_link.link) {
-		int pad;
+	eoutput->last_row_offset =
+		(eoutput->surface_size + eoutput->padding_inner) *
+		last_row_removed / 2;
+}
 
-		pad = eoutput->surface_size + eoutput->padding_inner;
+static void
+exposay_surface_place(struct exposay_surface *esurface,
+		      struct weston_output *output)
+{
+	struct exposay_output *eoutput = esurface->eoutput;
+	struct weston_view *view = esurface->view;
+	int pad;
+
+	pad = eoutput->surface_size + eoutput->padding_inner;
+
+	esurface->row = esurface->slot / eoutput->grid_size;
+	esurface->column = esurface->slot % eoutput->grid_size;
+
+	esurface->x = output->x + eoutput->hpadding_outer;
+	esurface->x += pad * esurface->column;
+	esurface->y = output->y + eoutput->vpadding_outer;
+	esurface->y += pad * esurface->row;
+
+	if (esurface->row == eoutput->grid_size - 1)
+		esurface->x += eoutput->last_row_offset;
+
+	if (view->surface->width > view->surface->height)
+		esurface->scale = eoutput->surface_size / (float) view->surface->width;
+	else
+		esurface->scale = eoutput->surface_size / (float) view->surface->height;
+	esurface->width = view->surface->width * esurface->scale;
+	esurface->height = view->surface->height * esurface->scale;
+}
+
+/* Recompute the grid after a surface came or went, and move the surfaces
+ * whose cell changed.  Ones still animating in pick up their new cell
+ * when the animation ends. */
+static void
+exposay_relayout(struct desktop_shell *shell, struct exposay_output *eoutput)
+{
+	struct shell_output *shell_output =
+		container_of(eoutput, struct shell_output, eoutput);
+	struct exposay_surface *esurface;
+	int grid_size = eoutput->grid_size;
+	int surface_size = eoutput->surface_size;
+	int last_row_offset = eoutput->last_row_offset;
+	int i, x, y;
+
+	exposay_layout_grid(eoutput, shell_output->output);
+
+	for (i = 0; i < eoutput->num_surfaces; i++) {
+		esurface = eoutput->slots[i];
+		x = esurface->x;
+		y = esurface->y;
+
+		exposay_surface_place(esurface, shell_output->output);
+
+		if (esurface->transformed &&
+		    (x != esurface->x || y != esurface->y ||
+		     grid_size != eoutput->grid_size ||
+		     surface_size != eoutput->surface_size ||
+		     last_row_offset != eoutput->last_row_offset))
+			exposay_surface_update_transform(esurface);
+
+		if (shell->exposay.focus_current == esurface->view &&
+		    shell->exposay.cur_output == eoutput) {
+			shell->exposay.row_current = esurface->row;
+			shell->exposay.column_current = esurface->column;
+		}
+	}
+}
+
+static struct exposay_surface *
+exposay_surface_create(struct desktop_shell *shell,
+		       struct exposay_output *eoutput,
+		       struct weston_view *view)
+{
+	struct exposay_surface *esurface;
+
+	esurface = zalloc(sizeof(*esurface));
+	if (!esurface)
+		return NULL;
+
+	esurface->shell = shell;
+	esurface->eoutput = eoutput;
+	esurface->view = view;
+
+	if (exposay_surface_add_slot(esurface) < 0) {
+		free(esurface);
+		return NULL;
+	}
+
+	wl_list_insert(&shell->exposay.surface_list, &esurface->link);
+
+	esurface->view_destroy_listener.notify = handle_view_destroy;
+	wl_signal_add(&view->destroy_signal, &esurface->view_destroy_listener);
+
+	return esurface;
+}
+
+static enum exposay_layout_state
+exposay_layout(struct desktop_shell *shell, struct shell_output *shell_output)
+{
+	struct workspace *workspace = shell->exposay.workspace;
+	struct weston_output *output = shell_output->output;
+	struct exposay_output *eoutput = &shell_output->eoutput;
+	struct weston_view *view;
+	struct exposay_surface *esurface, *highlight = NULL;
+	int i;
 
+	eoutput->num_surfaces = 0;
+	wl_list_for_each(view, &workspace->layer.view_list.link, layer_link.link) {
 		if (!get_shell_surface(view->surface))
 			continue;
 		if (view->output != output)
 			continue;
 
-		esurface = malloc(sizeof(*esurface));
+		esurface = exposay_surface_create(shell, eoutput, view);
 		if (!esurface) {
 			exposay_set_state(shell, EXPOSAY_TARGET_CANCEL,
 			                  shell->exposay.seat);
 			break;
 		}
+	}
 
-		wl_list_insert(&shell->exposay.surface_list, &esurface->link);
-		esurface->shell = shell;
-		esurface->eoutput = eoutput;
-		esurface->view = view;
-
-		esurface->view_destroy_listener.notify = handle_view_destroy;
-		wl_signal_add(&view->destroy_signal, &esurface->view_destroy_listener);
-
-		esurface->row = i / eoutput->grid_size;
-		esurface->column = i % eoutput->grid_size;
-
-		esurface->x = output->x + eoutput->hpadding_outer;
-		esurface->x += pad * esurface->column;
-		esurface->y = output->y + eoutput->vpadding_outer;
-		esurface->y += pad * esurface->row;
+	exposay_layout_grid(eoutput, output);
+	if (eoutput->num_surfaces == 0)
+		return EXPOSAY_LAYOUT_OVERVIEW;
 
-		if (esurface->row == eoutput->grid_size - 1)
-			esurface->x += (eoutput->surface_size + eoutput->padding_inner) * last_row_removed / 2;
+	for (i = 0; i < eoutput->num_surfaces; i++) {
+		esurface = eoutput->slots[i];
 
-		if (view->surface->width > view->surface->height)
-			esurface->scale = eoutput->surface_size / (float) view->surface->width;
-		else
-			esurface->scale = eoutput->surface_size / (float) view->surface->height;
-		esurface->width = view->surface->width * esurface->scale;
-		esurface->height = view->surface->height * esurface->scale;
+		exposay_surface_place(esurface, output);
 
 		if (shell->exposay.focus_current == esurface->view)
 			highlight = esurface;
 
 		exposay_animate_in(esurface);
-
-		i++;
 	}
 
 	if (highlight) {
@@ -333,6 +543,36 @@ exposay_layout(struct desktop_shell *shell, struct shell_output *shell_output)
 	return EXPOSAY_LAYOUT_ANIMATE_TO_OVERVIEW;
 }
 
+/* A window mapped on the current workspace while the overview is up
+ * gets a cell at the end of its output's grid. */
+void
+exposay_add_view(struct desktop_shell *shell, struct weston_view *view)
+{
+	struct shell_output *shell_output;
+	struct exposay_surface *esurface;
+
+	if (shell->exposay.state_cur != EXPOSAY_LAYOUT_OVERVIEW &&
+	    shell->exposay.state_cur != EXPOSAY_LAYOUT_ANIMATE_TO_OVERVIEW)
+		return;
+
+	if (view->layer_link.layer != &shell->exposay.workspace->layer)
+		return;
+
+	wl_list_for_each(shell_output, &shell->output_list, link) {
+		if (shell_output->output != view->output)
+			continue;
+
+		esurface = exposay_surface_create(shell, &shell_output->eoutput,
+						  view);
+		if (!esurface)
+			return;
+
+		exposay_relayout(shell, &shell_output->eoutput);
+		exposay_animate_in(esurface);
+		return;
+	}
+}
+
 static void
 exposay_focus(struct weston_pointer_grab *grab)
 {
@@ -398,16 +638,16 @@ exposay_maybe_move(struct desktop_shell *shell, int row, int column)
 {
 	struct exposay_surface *esurface;
 
-	wl_list_for_each(esurface, &shell->exposay.surface_list, link) {
-		if (esurface->eoutput != shell->exposay.cur_output ||
-		    esurface->row != row || esurface->column != column)
-			continue;
+	if (!shell->exposay.cur_output)
+		return 0;
 
-		exposay_highlight_surface(shell, esurface);
-		return 1;
-	}
+	esurface = exposay_surface_at_slot(shell->exposay.cur_output,
+					   row, column);
+	if (!esurface)
+		return 0;
 
-	return 0;
+	exposay_highlight_surface(shell, esurface);
+	return 1;
 }
 
 static void
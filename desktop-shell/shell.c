@@ -641,15 +641,6 @@ focus_surface_configure(struct weston_surface *es, int32_t sx, int32_t sy)
 {
 }
 
-static struct focus_surface *
-get_focus_surface(struct weston_surface *surface)
-{
-	if (surface->configure == focus_surface_configure)
-		return surface->configure_private;
-	else
-		return NULL;
-}
-
 static bool
 is_focus_surface (struct weston_surface *es)
 {
@@ -701,8 +692,6 @@ create_focus_surface(struct weston_compositor *ec,
 	pixman_region32_fini(&surface->input);
 	pixman_region32_init(&surface->input);
 
-	wl_list_init(&fsurf->workspace_transform.link);
-
 	return fsurf;
 }
 
@@ -1059,60 +1048,67 @@ get_output_height(struct weston_output *output)
 }
 
 static void
-view_translate(struct workspace *ws, struct weston_view *view, double d)
+workspace_translate_out(struct workspace *ws, struct weston_output *output,
+			double fraction)
 {
-	struct weston_transform *transform;
-
-	if (is_focus_view(view)) {
-		struct focus_surface *fsurf = get_focus_surface(view->surface);
-		transform = &fsurf->workspace_transform;
-	} else {
-		struct shell_surface *shsurf = get_shell_surface(view->surface);
-		transform = &shsurf->workspace_transform;
-	}
-
-	if (wl_list_empty(&transform->link))
-		wl_list_insert(view->geometry.transformation_list.prev,
-			       &transform->link);
+	unsigned int height = get_output_height(output);
 
-	weston_matrix_init(&transform->matrix);
-	weston_matrix_translate(&transform->matrix,
-				0.0, d, 0.0);
-	weston_view_geometry_dirty(view);
+	weston_layer_set_offset(&ws->layer, 0, height * fraction);
 }
 
 static void
-workspace_translate_out(struct workspace *ws, double fraction)
+workspace_translate_in(struct workspace *ws, struct weston_output *output,
+		       double fraction)
 {
-	struct weston_view *view;
-	unsigned int height;
+	unsigned int height = get_output_height(output);
 	double d;
 
-	wl_list_for_each(view, &ws->layer.view_list.link, layer_link.link) {
-		height = get_output_height(view->surface->output);
-		d = height * fraction;
+	if (fraction > 0)
+		d = -(height - height * fraction);
+	else
+		d = height + height * fraction;
 
-		view_translate(ws, view, d);
-	}
+	weston_layer_set_offset(&ws->layer, 0, d);
 }
 
+/* A surface taken along to the new workspace stays where it is while
+ * the workspaces slide, so it cancels out its layer's offset. */
 static void
-workspace_translate_in(struct workspace *ws, double fraction)
+workspace_sticky_update(struct desktop_shell *shell)
 {
-	struct weston_view *view;
-	unsigned int height;
-	double d;
+	struct shell_surface *shsurf = shell->workspaces.anim_sticky;
+	struct weston_layer *layer;
 
-	wl_list_for_each(view, &ws->layer.view_list.link, layer_link.link) {
-		height = get_output_height(view->surface->output);
+	if (!shsurf || !shsurf->view->layer_link.layer)
+		return;
 
-		if (fraction > 0)
-			d = -(height - height * fraction);
-		else
-			d = height + height * fraction;
+	layer = shsurf->view->layer_link.layer;
+
+	if (wl_list_empty(&shsurf->workspace_transform.link))
+		wl_list_insert(shsurf->view->geometry.transformation_list.prev,
+			       &shsurf->workspace_transform.link);
+
+	weston_matrix_init(&shsurf->workspace_transform.matrix);
+	weston_matrix_translate(&shsurf->workspace_transform.matrix,
+				-layer->offset_x, -layer->offset_y, 0.0);
+	weston_view_geometry_dirty(shsurf->view);
+}
+
+static void
+workspace_sticky_clear(struct desktop_shell *shell)
+{
+	struct shell_surface *shsurf = shell->workspaces.anim_sticky;
+
+	if (!shsurf)
+		return;
 
-		view_translate(ws, view, d);
+	if (!wl_list_empty(&shsurf->workspace_transform.link)) {
+		wl_list_remove(&shsurf->workspace_transform.link);
+		wl_list_init(&shsurf->workspace_transform.link);
+		weston_view_geometry_dirty(shsurf->view);
 	}
+
+	shell->workspaces.anim_sticky = NULL;
 }
 
 static void
@@ -1142,29 +1138,6 @@ reverse_workspace_change_animation(struct desktop_shell *shell,
 	weston_compositor_schedule_repaint(shell->compositor);
 }
 
-static void
-workspace_deactivate_transforms(struct workspace *ws)
-{
-	struct weston_view *view;
-	struct weston_transform *transform;
-
-	wl_list_for_each(view, &ws->layer.view_list.link, layer_link.link) {
-		if (is_focus_view(view)) {
-			struct focus_surface *fsurf = get_focus_surface(view->surface);
-			transform = &fsurf->workspace_transform;
-		} else {
-			struct shell_surface *shsurf = get_shell_surface(view->surface);
-			transform = &shsurf->workspace_transform;
-		}
-
-		if (!wl_list_empty(&transform->link)) {
-			wl_list_remove(&transform->link);
-			wl_list_init(&transform->link);
-		}
-		weston_view_geometry_dirty(view);
-	}
-}
-
 static void
 finish_workspace_change_animation(struct desktop_shell *shell,
 				  struct workspace *from,
@@ -1182,8 +1155,9 @@ finish_workspace_change_animation(struct desktop_shell *shell,
 		weston_view_damage_below(view);
 
 	wl_list_remove(&shell->workspaces.animation.link);
-	workspace_deactivate_transforms(from);
-	workspace_deactivate_transforms(to);
+	weston_layer_set_offset(&from->layer, 0, 0);
+	weston_layer_set_offset(&to->layer, 0, 0);
+	workspace_sticky_clear(shell);
 	shell->workspaces.anim_to = NULL;
 
 	wl_list_remove(&shell->workspaces.anim_from->layer.link);
@@ -1228,10 +1202,11 @@ animate_workspace_change_frame(struct weston_animation *animation,
 	y = sin(x);
 
 	if (t < DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH) {
-		weston_compositor_schedule_repaint(shell->compositor);
-
-		workspace_translate_out(from, shell->workspaces.anim_dir * y);
-		workspace_translate_in(to, shell->workspaces.anim_dir * y);
+		workspace_translate_out(from, output,
+					shell->workspaces.anim_dir * y);
+		workspace_translate_in(to, output,
+				       shell->workspaces.anim_dir * y);
+		workspace_sticky_update(shell);
 		shell->workspaces.anim_current = y;
 
 		weston_compositor_schedule_repaint(shell->compositor);
@@ -1270,7 +1245,8 @@ animate_workspace_change(struct desktop_shell *shell,
 
 	wl_list_insert(from->layer.link.prev, &to->layer.link);
 
-	workspace_translate_in(to, 0);
+	workspace_translate_in(to, output, 0);
+	workspace_sticky_update(shell);
 
 	restore_focus_state(shell, to);
 
@@ -1451,10 +1427,8 @@ take_surface_to_workspace_by_seat(struct desktop_shell *shell,
 	    workspace_has_only(to, surface))
 		update_workspace(shell, index, from, to);
 	else {
-		if (shsurf != NULL &&
-		    wl_list_empty(&shsurf->workspace_transform.link))
-			wl_list_insert(&shell->workspaces.anim_sticky_list,
-				       &shsurf->workspace_transform.link);
+		if (shsurf != NULL)
+			shell->workspaces.anim_sticky = shsurf;
 
 		animate_workspace_change(shell, index, from, to);
 	}
@@ -3379,6 +3353,9 @@ destroy_shell_surface(struct shell_surface *shsurf)
 	shsurf->surface->configure = NULL;
 	free(shsurf->title);
 
+	if (shsurf->shell->workspaces.anim_sticky == shsurf)
+		workspace_sticky_clear(shsurf->shell);
+
 	weston_view_destroy(shsurf->view);
 
 	wl_list_remove(&shsurf->children_link);
@@ -5360,6 +5337,8 @@ map(struct desktop_shell *shell, struct shell_surface *shsurf,
 			break;
 		wl_list_for_each(seat, &compositor->seat_list, link)
 			activate(shell, shsurf->surface, seat, true);
+		if (shsurf->type == SHELL_SURFACE_TOPLEVEL)
+			exposay_add_view(shell, shsurf->view);
 		break;
 	case SHELL_SURFACE_POPUP:
 	case SHELL_SURFACE_NONE:
@@ -6284,6 +6263,7 @@ handle_output_destroy(struct wl_listener *listener, void *data)
 
 	wl_list_remove(&output_listener->destroy_listener.link);
 	wl_list_remove(&output_listener->link);
+	free(output_listener->eoutput.slots);
 	free(output_listener);
 }
 
@@ -6567,7 +6547,6 @@ module_init(struct weston_compositor *ec,
 
 	weston_layer_init(&shell->minimized_layer, NULL);
 
-	wl_list_init(&shell->workspaces.anim_sticky_list);
 	wl_list_init(&shell->workspaces.animation.link);
 	shell->workspaces.animation.frame = animate_workspace_change_frame;
 
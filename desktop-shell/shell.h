@@ -63,6 +63,11 @@ struct exposay_output {
 	int hpadding_outer;
 	int vpadding_outer;
 	int padding_inner;
+	int last_row_offset;
+
+	/* Surfaces in grid order, row * grid_size + column. */
+	struct exposay_surface **slots;
+	int slots_size;
 };
 
 struct exposay {
@@ -93,7 +98,6 @@ struct exposay {
 struct focus_surface {
 	struct weston_surface *surface;
 	struct weston_view *view;
-	struct weston_transform workspace_transform;
 };
 
 struct workspace {
@@ -163,7 +167,7 @@ struct desktop_shell {
 		struct wl_list client_list;
 
 		struct weston_animation animation;
-		struct wl_list anim_sticky_list;
+		struct shell_surface *anim_sticky;
 		int anim_dir;
 		uint32_t anim_timestamp;
 		double anim_current;
@@ -237,6 +241,8 @@ void
 exposay_binding(struct weston_seat *seat,
 		enum weston_keyboard_modifier modifier,
 		void *data);
+void
+exposay_add_view(struct desktop_shell *shell, struct weston_view *view);
 int
 input_panel_setup(struct desktop_shell *shell);
 void
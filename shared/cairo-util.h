@@ -220,4 +220,13 @@ frame_double_click(struct frame *frame, void *pointer,
 void
 frame_repaint(struct frame *frame, cairo_t *cr);
 
+/* frame_repaint() in two steps: the themed border, shadow and title,
+ * which only change with the size, title and flags, and then the
+ * buttons on top. */
+void
+frame_repaint_background(struct frame *frame, cairo_t *cr);
+
+void
+frame_repaint_buttons(struct frame *frame, cairo_t *cr);
+
 #endif
@@ -869,9 +869,8 @@ frame_double_click(struct frame *frame, void *data,
 }
 
 void
-frame_repaint(struct frame *frame, cairo_t *cr)
+frame_repaint_background(struct frame *frame, cairo_t *cr)
 {
-	struct frame_button *button;
 	uint32_t flags = 0;
 
 	frame_refresh_geometry(frame);
@@ -886,9 +885,24 @@ frame_repaint(struct frame *frame, cairo_t *cr)
 	theme_render_frame(frame->theme, cr, frame->width, frame->height,
 			   frame->title, &frame->buttons, flags);
 	cairo_restore(cr);
+}
+
+void
+frame_repaint_buttons(struct frame *frame, cairo_t *cr)
+{
+	struct frame_button *button;
+
+	frame_refresh_geometry(frame);
 
 	wl_list_for_each(button, &frame->buttons, link)
 		frame_button_repaint(button, cr);
 
 	frame_status_clear(frame, FRAME_STATUS_REPAINT);
 }
+
+void
+frame_repaint(struct frame *frame, cairo_t *cr)
+{
+	frame_repaint_background(frame, cr);
+	frame_repaint_buttons(frame, cr);
+}
@@ -56,25 +56,89 @@ weston_matrix_init(struct weston_matrix *matrix)
 	memcpy(matrix, &identity, sizeof identity);
 }
 
+/*
+ * The type bits say which elements can differ from the identity:
+ * translate only touches 12-14, scale the diagonal, and rotate the
+ * upper left 2x2 block.  Anything with OTHER set is a full 4x4 matrix.
+ */
+#define MATRIX_TYPE_TRANSLATE	WESTON_MATRIX_TRANSFORM_TRANSLATE
+#define MATRIX_TYPE_SCALE	(WESTON_MATRIX_TRANSFORM_TRANSLATE |	\
+				 WESTON_MATRIX_TRANSFORM_SCALE)
+#define MATRIX_TYPE_AFFINE	(WESTON_MATRIX_TRANSFORM_TRANSLATE |	\
+				 WESTON_MATRIX_TRANSFORM_SCALE |	\
+				 WESTON_MATRIX_TRANSFORM_ROTATE)
+
+static inline int
+matrix_is(unsigned int type, unsigned int kind)
+{
+	return (type & ~kind) == 0;
+}
+
+/* Each column of the product is a sum of n's columns weighted by the
+ * matching column of m.  Written this way the inner loop runs over four
+ * independent floats, which the compiler turns into vector operations. */
+static void
+matrix_multiply_general(float *d, const float *m, const float *n)
+{
+	int c, r, k;
+
+	for (c = 0; c < 4; c++) {
+		for (r = 0; r < 4; r++)
+			d[c * 4 + r] = n[r] * m[c * 4];
+		for (k = 1; k < 4; k++)
+			for (r = 0; r < 4; r++)
+				d[c * 4 + r] += n[k * 4 + r] * m[c * 4 + k];
+	}
+}
+
 /* m <- n * m, that is, m is multiplied on the LEFT. */
 WL_EXPORT void
 weston_matrix_multiply(struct weston_matrix *m, const struct weston_matrix *n)
 {
-	struct weston_matrix tmp;
-	const float *row, *column;
-	div_t d;
-	int i, j;
+	unsigned int type = m->type | n->type;
+	struct weston_matrix copy;
+	float *d = m->d;
+	float x, y;
+
+	if (m == n) {
+		copy = *n;
+		n = &copy;
+	}
 
-	for (i = 0; i < 16; i++) {
-		tmp.d[i] = 0;
-		d = div(i, 4);
-		row = m->d + d.quot * 4;
-		column = n->d + d.rem;
-		for (j = 0; j < 4; j++)
-			tmp.d[i] += row[j] * column[j * 4];
+	if (matrix_is(type, MATRIX_TYPE_TRANSLATE)) {
+		d[12] += n->d[12];
+		d[13] += n->d[13];
+		d[14] += n->d[14];
+	} else if (matrix_is(type, MATRIX_TYPE_SCALE)) {
+		d[0] *= n->d[0];
+		d[5] *= n->d[5];
+		d[10] *= n->d[10];
+		d[12] = n->d[0] * d[12] + n->d[12];
+		d[13] = n->d[5] * d[13] + n->d[13];
+		d[14] = n->d[10] * d[14] + n->d[14];
+	} else if (matrix_is(type, MATRIX_TYPE_AFFINE)) {
+		x = d[0];
+		y = d[1];
+		d[0] = n->d[0] * x + n->d[4] * y;
+		d[1] = n->d[1] * x + n->d[5] * y;
+		x = d[4];
+		y = d[5];
+		d[4] = n->d[0] * x + n->d[4] * y;
+		d[5] = n->d[1] * x + n->d[5] * y;
+		d[10] *= n->d[10];
+		x = d[12];
+		y = d[13];
+		d[12] = n->d[0] * x + n->d[4] * y + n->d[12];
+		d[13] = n->d[1] * x + n->d[5] * y + n->d[13];
+		d[14] = n->d[10] * d[14] + n->d[14];
+	} else {
+		struct weston_matrix tmp;
+
+		matrix_multiply_general(tmp.d, m->d, n->d);
+		memcpy(m->d, tmp.d, sizeof tmp.d);
 	}
-	tmp.type = m->type | n->type;
-	memcpy(m, &tmp, sizeof tmp);
+
+	m->type = type;
 }
 
 WL_EXPORT void
@@ -126,6 +190,46 @@ weston_matrix_transform(struct weston_matrix *matrix, struct weston_vector *v)
 	*v = t;
 }
 
+/* v[i] <- m * v[i] for an array of vectors, with the loop picked once
+ * for the whole array from the matrix type. */
+WL_EXPORT void
+weston_matrix_transform_points(const struct weston_matrix *matrix,
+			       struct weston_vector *v, unsigned int count)
+{
+	const float *d = matrix->d;
+	unsigned int i;
+	float x, y, w;
+
+	if (matrix_is(matrix->type, MATRIX_TYPE_TRANSLATE)) {
+		for (i = 0; i < count; i++) {
+			w = v[i].f[3];
+			v[i].f[0] += d[12] * w;
+			v[i].f[1] += d[13] * w;
+			v[i].f[2] += d[14] * w;
+		}
+	} else if (matrix_is(matrix->type, MATRIX_TYPE_SCALE)) {
+		for (i = 0; i < count; i++) {
+			w = v[i].f[3];
+			v[i].f[0] = d[0] * v[i].f[0] + d[12] * w;
+			v[i].f[1] = d[5] * v[i].f[1] + d[13] * w;
+			v[i].f[2] = d[10] * v[i].f[2] + d[14] * w;
+		}
+	} else if (matrix_is(matrix->type, MATRIX_TYPE_AFFINE)) {
+		for (i = 0; i < count; i++) {
+			x = v[i].f[0];
+			y = v[i].f[1];
+			w = v[i].f[3];
+			v[i].f[0] = d[0] * x + d[4] * y + d[12] * w;
+			v[i].f[1] = d[1] * x + d[5] * y + d[13] * w;
+			v[i].f[2] = d[10] * v[i].f[2] + d[14] * w;
+		}
+	} else {
+		for (i = 0; i < count; i++)
+			weston_matrix_transform((struct weston_matrix *) matrix,
+						&v[i]);
+	}
+}
+
 static inline void
 swap_rows(double *a, double *b)
 {
@@ -253,6 +357,44 @@ inverse_transform(const double *LU, const unsigned *p, float *v)
 		v[j] = b[j];
 }
 
+/* The inverse of an affine matrix is affine too: invert the upper left
+ * 2x2 block and the z scale, and map the translation back through them.
+ * Same singularity threshold as the pivots in matrix_invert(). */
+static int
+matrix_invert_affine(struct weston_matrix *inverse,
+		     const struct weston_matrix *matrix)
+{
+	const float *d = matrix->d;
+	struct weston_matrix tmp;
+	double det, a, b, c, e, z;
+
+	det = (double) d[0] * d[5] - (double) d[4] * d[1];
+	if (fabs(det) < 1e-9 || fabs(d[10]) < 1e-9)
+		return -1;
+
+	a = d[5] / det;
+	b = -d[1] / det;
+	c = -d[4] / det;
+	e = d[0] / det;
+	z = 1.0 / d[10];
+
+	weston_matrix_init(&tmp);
+	tmp.d[0] = a;
+	tmp.d[1] = b;
+	tmp.d[4] = c;
+	tmp.d[5] = e;
+	tmp.d[10] = z;
+	tmp.d[12] = -(a * d[12] + c * d[13]);
+	tmp.d[13] = -(b * d[12] + e * d[13]);
+	tmp.d[14] = -z * d[14];
+	tmp.type = matrix->type;
+
+	/* inverse may be matrix itself */
+	*inverse = tmp;
+
+	return 0;
+}
+
 WL_EXPORT int
 weston_matrix_invert(struct weston_matrix *inverse,
 		     const struct weston_matrix *matrix)
@@ -261,6 +403,17 @@ weston_matrix_invert(struct weston_matrix *inverse,
 	unsigned perm[4];	/* permutation */
 	unsigned c;
 
+	if (matrix_is(matrix->type, MATRIX_TYPE_TRANSLATE)) {
+		*inverse = *matrix;
+		inverse->d[12] = -inverse->d[12];
+		inverse->d[13] = -inverse->d[13];
+		inverse->d[14] = -inverse->d[14];
+		return 0;
+	}
+
+	if (matrix_is(matrix->type, MATRIX_TYPE_AFFINE))
+		return matrix_invert_affine(inverse, matrix);
+
 	if (matrix_invert(LU, perm, matrix) < 0)
 		return -1;
 
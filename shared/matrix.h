@@ -35,6 +35,12 @@ enum weston_matrix_transform_type {
 	WESTON_MATRIX_TRANSFORM_OTHER		= (1 << 3),
 };
 
+/* type is the union of the kinds of transformation d[] holds, and the
+ * weston_matrix_* functions pick their code paths from it.  It is kept
+ * up to date by weston_matrix_init() and the functions that compose a
+ * matrix.  Anyone writing d[] directly must set type to match, to
+ * WESTON_MATRIX_TRANSFORM_OTHER if in doubt; a zero type means d[] is
+ * the identity. */
 struct weston_matrix {
 	float d[16];
 	unsigned int type;
@@ -57,6 +63,9 @@ void
 weston_matrix_rotate_xy(struct weston_matrix *matrix, float cos, float sin);
 void
 weston_matrix_transform(struct weston_matrix *matrix, struct weston_vector *v);
+void
+weston_matrix_transform_points(const struct weston_matrix *matrix,
+			       struct weston_vector *v, unsigned int count);
 
 int
 weston_matrix_invert(struct weston_matrix *inverse,
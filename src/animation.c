@@ -46,10 +46,126 @@ weston_spring_init(struct weston_spring *spring,
 	spring->max = 1.0;
 }
 
+#define SPRING_STEP_MSEC	4
+#define SPRING_STEP		0.01
+
+/* Below this many steps, stepping is cheaper than the pow() and
+ * trigonometry of the closed form. */
+#define SPRING_SOLVE_MIN_STEPS	8
+
+static void
+weston_spring_step(struct weston_spring *spring)
+{
+	double force, v, current, step;
+
+	step = SPRING_STEP;
+	current = spring->current;
+	v = current - spring->previous;
+	force = spring->k * (spring->target - current) / 10.0 +
+		(spring->previous - current) - v * spring->friction;
+
+	spring->current =
+		current + (current - spring->previous) +
+		force * step * step;
+	spring->previous = current;
+
+	switch (spring->clip) {
+	case WESTON_SPRING_OVERSHOOT:
+		break;
+
+	case WESTON_SPRING_CLAMP:
+		if (spring->current > spring->max) {
+			spring->current = spring->max;
+			spring->previous = spring->max;
+		} else if (spring->current < 0.0) {
+			spring->current = spring->min;
+			spring->previous = spring->min;
+		}
+		break;
+
+	case WESTON_SPRING_BOUNCE:
+		if (spring->current > spring->max) {
+			spring->current =
+				2 * spring->max - spring->current;
+			spring->previous =
+				2 * spring->max - spring->previous;
+		} else if (spring->current < spring->min) {
+			spring->current =
+				2 * spring->min - spring->current;
+			spring->previous =
+				2 * spring->min - spring->previous;
+		}
+		break;
+	}
+}
+
+/* Without clipping, a step is linear in the distance to the target:
+ *
+ *   e[i+1] = (2 - a - b) e[i] - (1 - b) e[i-1]
+ *
+ * with a = k h^2 / 10 and b = (1 + friction) h^2.  Its solution is a
+ * sum of powers of the roots of z^2 - (2 - a - b) z + (1 - b), which
+ * are complex for an underdamped spring, repeated for a critically
+ * damped one and real for an overdamped one, so any number of steps
+ * can be evaluated at once.  Returns 0 if the spring is too stiff
+ * for that (it then diverges anyway). */
+static int
+weston_spring_advance(struct weston_spring *spring, uint32_t steps)
+{
+	double h2 = SPRING_STEP * SPRING_STEP;
+	double a = spring->k * h2 / 10.0;
+	double b = (1.0 + spring->friction) * h2;
+	double sum = 2.0 - a - b, product = 1.0 - b;
+	double disc = sum * sum - 4.0 * product;
+	double p = spring->previous - spring->target;
+	double c = spring->current - spring->target;
+	double n = steps;
+	double rho, theta, alpha, beta, r, r1, r2, c1, c2;
+
+	if (product <= 0.0 || sum <= 0.0)
+		return 0;
+
+	if (fabs(disc) < 1e-12) {
+		/* critically damped: e[i] = (alpha + beta i) r^i */
+		r = sum / 2.0;
+		alpha = p;
+		beta = c / r - p;
+		p = (alpha + beta * n) * pow(r, n);
+		c = (alpha + beta * (n + 1)) * pow(r, n + 1);
+	} else if (disc < 0.0) {
+		/* underdamped: e[i] = rho^i (alpha cos(i theta) +
+		 *                            beta sin(i theta)) */
+		rho = sqrt(product);
+		theta = atan2(sqrt(-disc), sum);
+		alpha = p;
+		beta = (c / rho - p * cos(theta)) / sin(theta);
+		r = pow(rho, n);
+		p = r * (alpha * cos(n * theta) + beta * sin(n * theta));
+		r *= rho;
+		c = r * (alpha * cos((n + 1) * theta) +
+			 beta * sin((n + 1) * theta));
+	} else {
+		/* overdamped: e[i] = c1 r1^i + c2 r2^i */
+		r1 = (sum + sqrt(disc)) / 2.0;
+		r2 = product / r1;
+		c1 = (c - p * r2) / (r1 - r2);
+		c2 = (p * r1 - c) / (r1 - r2);
+		c1 *= pow(r1, n);
+		c2 *= pow(r2, n);
+		p = c1 + c2;
+		c = c1 * r1 + c2 * r2;
+	}
+
+	spring->previous = spring->target + p;
+	spring->current = spring->target + c;
+
+	return 1;
+}
+
 WL_EXPORT void
 weston_spring_update(struct weston_spring *spring, uint32_t msec)
 {
-	double force, v, current, step;
+	uint32_t steps;
 
 	/* Limit the number of executions of the loop below by ensuring that
 	 * the timestamp for last update of the spring is no more than 1s ago.
@@ -62,48 +178,24 @@ weston_spring_update(struct weston_spring *spring, uint32_t msec)
 		spring->timestamp = msec - 1000;
 	}
 
-	step = 0.01;
-	while (4 < msec - spring->timestamp) {
-		current = spring->current;
-		v = current - spring->previous;
-		force = spring->k * (spring->target - current) / 10.0 +
-			(spring->previous - current) - v * spring->friction;
-
-		spring->current =
-			current + (current - spring->previous) +
-			force * step * step;
-		spring->previous = current;
-
-		switch (spring->clip) {
-		case WESTON_SPRING_OVERSHOOT:
-			break;
-
-		case WESTON_SPRING_CLAMP:
-			if (spring->current > spring->max) {
-				spring->current = spring->max;
-				spring->previous = spring->max;
-			} else if (spring->current < 0.0) {
-				spring->current = spring->min;
-				spring->previous = spring->min;
-			}
-			break;
-
-		case WESTON_SPRING_BOUNCE:
-			if (spring->current > spring->max) {
-				spring->current =
-					2 * spring->max - spring->current;
-				spring->previous =
-					2 * spring->max - spring->previous;
-			} else if (spring->current < spring->min) {
-				spring->current =
-					2 * spring->min - spring->current;
-				spring->previous =
-					2 * spring->min - spring->previous;
-			}
-			break;
-		}
+	if (msec - spring->timestamp <= SPRING_STEP_MSEC)
+		return;
 
-		spring->timestamp += 4;
+	/* The number of whole steps the loop below would take */
+	steps = (msec - spring->timestamp - 1) / SPRING_STEP_MSEC;
+
+	/* Clipping makes the motion non-linear, so only an unclipped
+	 * spring can be solved in one go. */
+	if (spring->clip == WESTON_SPRING_OVERSHOOT &&
+	    steps >= SPRING_SOLVE_MIN_STEPS &&
+	    weston_spring_advance(spring, steps)) {
+		spring->timestamp += steps * SPRING_STEP_MSEC;
+		return;
+	}
+
+	while (SPRING_STEP_MSEC < msec - spring->timestamp) {
+		weston_spring_step(spring);
+		spring->timestamp += SPRING_STEP_MSEC;
 	}
 }
 
@@ -128,6 +220,10 @@ struct weston_view_animation {
 	weston_view_animation_done_func_t done;
 	void *data;
 	void *private;
+	/* Alpha and transform as last made visible */
+	float shown_alpha;
+	struct weston_matrix shown_matrix;
+	int skip_unchanged;
 };
 
 WL_EXPORT void
@@ -154,6 +250,41 @@ handle_animation_view_destroy(struct wl_listener *listener, void *data)
 	weston_view_animation_destroy(animation);
 }
 
+/* Whether the last frame changed anything that would show on screen:
+ * alpha by at least one 8-bit step, or a corner of the surface by at
+ * least 1/256 of a pixel, below which no sampled pixel changes by more
+ * than one step either. */
+static int
+weston_view_animation_changed(struct weston_view_animation *animation)
+{
+	struct weston_view *view = animation->view;
+	struct weston_vector a, b;
+	int i;
+
+	if (!animation->skip_unchanged)
+		return 1;
+
+	if (lrintf(animation->shown_alpha * 255.0f) !=
+	    lrintf(view->alpha * 255.0f))
+		return 1;
+
+	for (i = 0; i < 4; i++) {
+		a.f[0] = (i & 1) ? view->surface->width : 0;
+		a.f[1] = (i & 2) ? view->surface->height : 0;
+		a.f[2] = 0.0f;
+		a.f[3] = 1.0f;
+		b = a;
+		weston_matrix_transform(&animation->shown_matrix, &a);
+		weston_matrix_transform(&animation->transform.matrix, &b);
+
+		if (fabsf(a.f[0] / a.f[3] - b.f[0] / b.f[3]) >= 1.0f / 256 ||
+		    fabsf(a.f[1] / a.f[3] - b.f[1] / b.f[3]) >= 1.0f / 256)
+			return 1;
+	}
+
+	return 0;
+}
+
 static void
 weston_view_animation_frame(struct weston_animation *base,
 			    struct weston_output *output, uint32_t msecs)
@@ -178,6 +309,16 @@ weston_view_animation_frame(struct weston_animation *base,
 	if (animation->frame)
 		animation->frame(animation);
 
+	compositor->animation_frames++;
+	if (base->frame_counter > 1 &&
+	    !weston_view_animation_changed(animation)) {
+		compositor->animation_frames_skipped++;
+		return;
+	}
+
+	animation->shown_alpha = animation->view->alpha;
+	animation->shown_matrix = animation->transform.matrix;
+
 	weston_view_geometry_dirty(animation->view);
 	weston_view_schedule_repaint(animation->view);
 
@@ -214,6 +355,7 @@ weston_view_animation_create(struct weston_view *view,
 	animation->start = start;
 	animation->stop = stop;
 	animation->private = private;
+	animation->skip_unchanged = 1;
 
 	weston_matrix_init(&animation->transform.matrix);
 	wl_list_insert(&view->geometry.transformation_list,
@@ -368,6 +510,9 @@ weston_stable_fade_run(struct weston_view *front_view, float start,
 
 	weston_spring_init(&fade->spring, 400, start, end);
 	fade->spring.friction = 1150;
+	/* The back view's alpha changes fastest when the front view's
+	 * barely does, so looking at the front view alone isn't enough. */
+	fade->skip_unchanged = 0;
 
 	front_view->alpha = start;
 	back_view->alpha = end;
@@ -33,11 +33,109 @@ struct weston_binding {
 	uint32_t modifier;
 	void *handler;
 	void *data;
+	struct weston_binding_table *table;
+	uint32_t hash;
 	struct wl_list link;
+	struct wl_list hash_link;
 };
 
+#define BINDING_TABLE_MIN_BUCKETS 16
+
+static uint32_t
+binding_hash(uint32_t id, uint32_t modifier)
+{
+	uint32_t h;
+
+	h = id * 2654435761u ^ modifier * 0x27d4eb2du;
+
+	return h ^ (h >> 15);
+}
+
+WL_EXPORT void
+weston_binding_table_init(struct weston_binding_table *table)
+{
+	wl_list_init(&table->list);
+	table->buckets = NULL;
+	table->bucket_count = 0;
+	table->count = 0;
+	table->dispatching = 0;
+}
+
+/* Spread the bindings over @bucket_count buckets.  The bindings are
+ * re-inserted in registration order, so every bucket stays in that
+ * order too. */
+static int
+binding_table_resize(struct weston_binding_table *table,
+		     uint32_t bucket_count)
+{
+	struct wl_list *buckets;
+	struct weston_binding *binding;
+	uint32_t i;
+
+	buckets = malloc(bucket_count * sizeof *buckets);
+	if (buckets == NULL)
+		return -1;
+
+	for (i = 0; i < bucket_count; i++)
+		wl_list_init(&buckets[i]);
+
+	wl_list_for_each(binding, &table->list, link)
+		wl_list_insert(buckets[binding->hash & (bucket_count - 1)].prev,
+			       &binding->hash_link);
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->bucket_count = bucket_count;
+
+	return 0;
+}
+
+static int
+binding_table_insert(struct weston_binding_table *table,
+		     struct weston_binding *binding, uint32_t id)
+{
+	uint32_t bucket_count;
+
+	if (table->buckets == NULL ||
+	    (table->count + 1 > table->bucket_count &&
+	     table->dispatching == 0)) {
+		bucket_count = table->bucket_count ?
+			table->bucket_count * 2 : BINDING_TABLE_MIN_BUCKETS;
+
+		/* A table that can't grow still works, just slower. */
+		if (binding_table_resize(table, bucket_count) < 0 &&
+		    table->buckets == NULL)
+			return -1;
+	}
+
+	binding->table = table;
+	binding->hash = binding_hash(id, binding->modifier);
+	wl_list_insert(table->list.prev, &binding->link);
+	wl_list_insert(table->buckets[binding->hash &
+				      (table->bucket_count - 1)].prev,
+		       &binding->hash_link);
+	table->count++;
+
+	return 0;
+}
+
+/* The bucket holding every binding for (@id, @modifier), in registration
+ * order; the caller still has to compare the fields.  NULL if the table
+ * is empty. */
+static struct wl_list *
+binding_table_lookup(struct weston_binding_table *table,
+		     uint32_t id, uint32_t modifier)
+{
+	if (table->count == 0)
+		return NULL;
+
+	return &table->buckets[binding_hash(id, modifier) &
+			       (table->bucket_count - 1)];
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
+			      struct weston_binding_table *table, uint32_t id,
 			      uint32_t key, uint32_t button, uint32_t axis,
 			      uint32_t modifier, void *handler, void *data)
 {
@@ -54,6 +152,11 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->handler = handler;
 	binding->data = data;
 
+	if (binding_table_insert(table, binding, id) < 0) {
+		free(binding);
+		return NULL;
+	}
+
 	return binding;
 }
 
@@ -63,16 +166,10 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 				  weston_key_binding_handler_t handler,
 				  void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, key, 0, 0,
-						modifier, handler, data);
-	if (binding == NULL)
-		return NULL;
-
-	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->key_binding_table,
+					     key, key, 0, 0,
+					     modifier, handler, data);
 }
 
 WL_EXPORT struct weston_binding *
@@ -81,16 +178,10 @@ weston_compositor_add_modifier_binding(struct weston_compositor *compositor,
 				       weston_modifier_binding_handler_t handler,
 				       void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, 0, 0, 0,
-						modifier, handler, data);
-	if (binding == NULL)
-		return NULL;
-
-	wl_list_insert(compositor->modifier_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->modifier_binding_table,
+					     0, 0, 0, 0,
+					     modifier, handler, data);
 }
 
 WL_EXPORT struct weston_binding *
@@ -99,16 +190,10 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 				     weston_button_binding_handler_t handler,
 				     void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, 0, button, 0,
-						modifier, handler, data);
-	if (binding == NULL)
-		return NULL;
-
-	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->button_binding_table,
+					     button, 0, button, 0,
+					     modifier, handler, data);
 }
 
 WL_EXPORT struct weston_binding *
@@ -117,16 +202,10 @@ weston_compositor_add_touch_binding(struct weston_compositor *compositor,
 				    weston_touch_binding_handler_t handler,
 				    void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, 0, 0, 0,
-						modifier, handler, data);
-	if (binding == NULL)
-		return NULL;
-
-	wl_list_insert(compositor->touch_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->touch_binding_table,
+					     0, 0, 0, 0,
+					     modifier, handler, data);
 }
 
 WL_EXPORT struct weston_binding *
@@ -135,16 +214,10 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 				   weston_axis_binding_handler_t handler,
 				   void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, 0, 0, axis,
-						modifier, handler, data);
-	if (binding == NULL)
-		return NULL;
-
-	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->axis_binding_table,
+					     axis, 0, 0, axis,
+					     modifier, handler, data);
 }
 
 WL_EXPORT struct weston_binding *
@@ -153,30 +226,31 @@ weston_compositor_add_debug_binding(struct weston_compositor *compositor,
 				    weston_key_binding_handler_t handler,
 				    void *data)
 {
-	struct weston_binding *binding;
-
-	binding = weston_compositor_add_binding(compositor, key, 0, 0, 0,
-						handler, data);
-
-	wl_list_insert(compositor->debug_binding_list.prev, &binding->link);
-
-	return binding;
+	return weston_compositor_add_binding(compositor,
+					     &compositor->debug_binding_table,
+					     key, key, 0, 0, 0,
+					     handler, data);
 }
 
 WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->hash_link);
+	binding->table->count--;
 	free(binding);
 }
 
 WL_EXPORT void
-weston_binding_list_destroy_all(struct wl_list *list)
+weston_binding_table_release(struct weston_binding_table *table)
 {
 	struct weston_binding *binding, *tmp;
 
-	wl_list_for_each_safe(binding, tmp, list, link)
+	wl_list_for_each_safe(binding, tmp, &table->list, link)
 		weston_binding_destroy(binding);
+
+	free(table->buckets);
+	weston_binding_table_init(table);
 }
 
 struct binding_keyboard_grab {
@@ -262,15 +336,22 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  enum wl_keyboard_key_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
 
 	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
+	wl_list_for_each(b, &compositor->modifier_binding_table.list, link)
 		b->key = key;
 
-	wl_list_for_each(b, &compositor->key_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->key_binding_table,
+				      key, seat->modifier_state);
+	if (bucket == NULL)
+		return;
+
+	compositor->key_binding_table.dispatching++;
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->key == key && b->modifier == seat->modifier_state) {
 			weston_key_binding_handler_t handler = b->handler;
 			handler(seat, time, key, b->data);
@@ -283,6 +364,7 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				install_binding_grab(seat, time, key);
 		}
 	}
+	compositor->key_binding_table.dispatching--;
 }
 
 WL_EXPORT void
@@ -292,11 +374,18 @@ weston_compositor_run_modifier_binding(struct weston_compositor *compositor,
 				       enum wl_keyboard_key_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (seat->keyboard->grab != &seat->keyboard->default_grab)
 		return;
 
-	wl_list_for_each(b, &compositor->modifier_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->modifier_binding_table,
+				      0, modifier);
+	if (bucket == NULL)
+		return;
+
+	compositor->modifier_binding_table.dispatching++;
+	wl_list_for_each(b, bucket, hash_link) {
 		weston_modifier_binding_handler_t handler = b->handler;
 
 		if (b->modifier != modifier)
@@ -309,11 +398,12 @@ weston_compositor_run_modifier_binding(struct weston_compositor *compositor,
 		}
 		/* Ignore the binding if a key was pressed in between. */
 		else if (b->key != 0) {
-			return;
+			break;
 		}
 
 		handler(seat, modifier, b->data);
 	}
+	compositor->modifier_binding_table.dispatching--;
 }
 
 WL_EXPORT void
@@ -323,20 +413,28 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
 
 	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
+	wl_list_for_each(b, &compositor->modifier_binding_table.list, link)
 		b->key = button;
 
-	wl_list_for_each(b, &compositor->button_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->button_binding_table,
+				      button, seat->modifier_state);
+	if (bucket == NULL)
+		return;
+
+	compositor->button_binding_table.dispatching++;
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->button == button && b->modifier == seat->modifier_state) {
 			weston_button_binding_handler_t handler = b->handler;
 			handler(seat, time, button, b->data);
 		}
 	}
+	compositor->button_binding_table.dispatching--;
 }
 
 WL_EXPORT void
@@ -345,16 +443,24 @@ weston_compositor_run_touch_binding(struct weston_compositor *compositor,
 				    int touch_type)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (seat->touch->num_tp != 1 || touch_type != WL_TOUCH_DOWN)
 		return;
 
-	wl_list_for_each(b, &compositor->touch_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->touch_binding_table,
+				      0, seat->modifier_state);
+	if (bucket == NULL)
+		return;
+
+	compositor->touch_binding_table.dispatching++;
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->modifier == seat->modifier_state) {
 			weston_touch_binding_handler_t handler = b->handler;
 			handler(seat, time, b->data);
 		}
 	}
+	compositor->touch_binding_table.dispatching--;
 }
 
 WL_EXPORT int
@@ -364,12 +470,20 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   wl_fixed_t value)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	/* Invalidate all active modifier bindings. */
-	wl_list_for_each(b, &compositor->modifier_binding_list, link)
+	wl_list_for_each(b, &compositor->modifier_binding_table.list, link)
 		b->key = axis;
 
-	wl_list_for_each(b, &compositor->axis_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->axis_binding_table,
+				      axis, seat->modifier_state);
+	if (bucket == NULL)
+		return 0;
+
+	/* The first match handles the event and the walk stops, so the
+	 * bucket can't change under us. */
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->axis == axis && b->modifier == seat->modifier_state) {
 			weston_axis_binding_handler_t handler = b->handler;
 			handler(seat, time, axis, value, b->data);
@@ -388,9 +502,16 @@ weston_compositor_run_debug_binding(struct weston_compositor *compositor,
 {
 	weston_key_binding_handler_t handler;
 	struct weston_binding *binding;
+	struct wl_list *bucket;
 	int count = 0;
 
-	wl_list_for_each(binding, &compositor->debug_binding_list, link) {
+	bucket = binding_table_lookup(&compositor->debug_binding_table,
+				      key, 0);
+	if (bucket == NULL)
+		return 0;
+
+	compositor->debug_binding_table.dispatching++;
+	wl_list_for_each(binding, bucket, hash_link) {
 		if (key != binding->key)
 			continue;
 
@@ -398,6 +519,7 @@ weston_compositor_run_debug_binding(struct weston_compositor *compositor,
 		handler = binding->handler;
 		handler(seat, time, key, binding->data);
 	}
+	compositor->debug_binding_table.dispatching--;
 
 	return count;
 }
@@ -24,21 +24,34 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/uio.h>
 
 #include "compositor.h"
+#include "../shared/os-compatibility.h"
+
+/* The contents of the last selection live in an anonymous file (a memfd
+ * when available) rather than on the heap.  It is filled straight from
+ * the source pipe with splice(), sealed once complete, and pastes are
+ * served from it with sendfile().  The data still takes its size in
+ * shmem, but never passes through the compositor's heap or mappings,
+ * and the file only grows as data arrives. */
 
 struct clipboard_source {
 	struct weston_data_source base;
-	struct wl_array contents;
 	struct clipboard *clipboard;
 	struct wl_event_source *event_source;
+	struct wl_list client_list;
 	uint32_t serial;
 	int refcount;
 	int fd;
+	int store_fd;
+	off_t size;
 };
 
 struct clipboard {
@@ -46,9 +59,36 @@ struct clipboard {
 	struct wl_listener selection_listener;
 	struct wl_listener destroy_listener;
 	struct clipboard_source *source;
+	off_t max_size;
+};
+
+struct clipboard_client {
+	struct wl_event_source *event_source;
+	int fd;
+	struct wl_list link;
+	off_t offset;
+	struct clipboard_source *source;
 };
 
 static void clipboard_client_create(struct clipboard_source *source, int fd);
+static void clipboard_client_destroy(struct clipboard_client *client);
+static void clipboard_client_wake(struct clipboard_client *client);
+
+static int
+clipboard_create_store(void)
+{
+	int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+	fd = memfd_create("weston-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0)
+		return fd;
+#endif
+
+	fd = os_create_anonymous_file(0);
+
+	return fd;
+}
 
 static void
 clipboard_source_unref(struct clipboard_source *source)
@@ -63,40 +103,122 @@ clipboard_source_unref(struct clipboard_source *source)
 		wl_event_source_remove(source->event_source);
 		close(source->fd);
 	}
+	close(source->store_fd);
 	wl_signal_emit(&source->base.destroy_signal,
 		       &source->base);
 	s = source->base.mime_types.data;
 	free(*s);
 	wl_array_release(&source->base.mime_types);
-	wl_array_release(&source->contents);
 	free(source);
 }
 
-static int
-clipboard_source_data(int fd, uint32_t mask, void *data)
+/* Stop reading from the source; pastes still being served finish with
+ * what was stored. */
+static void
+clipboard_source_finish(struct clipboard_source *source)
+{
+	struct clipboard_client *client;
+
+	wl_event_source_remove(source->event_source);
+	close(source->fd);
+	source->event_source = NULL;
+
+	wl_list_for_each(client, &source->client_list, link)
+		clipboard_client_wake(client);
+}
+
+static void
+clipboard_source_seal(struct clipboard_source *source)
+{
+	if (ftruncate(source->store_fd, source->size) < 0)
+		return;
+
+#ifdef F_ADD_SEALS
+	fcntl(source->store_fd, F_ADD_SEALS,
+	      F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+}
+
+static ssize_t
+clipboard_source_copy(struct clipboard_source *source, int fd, size_t len)
+{
+	char buffer[4096];
+	loff_t offset = source->size;
+	ssize_t n;
+
+	n = splice(fd, NULL, source->store_fd, &offset, len,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n >= 0 || errno != EINVAL)
+		return n;
+
+	/* No splice() into this file; copy through a small buffer. */
+	n = read(fd, buffer, sizeof buffer);
+	if (n > 0 && pwrite(source->store_fd, buffer, n, source->size) != n)
+		return -1;
+
+	return n;
+}
+
+/* Give up on the source.  Pastes in progress are cut off rather than
+ * finished, since what was stored is not the whole selection. */
+static void
+clipboard_source_drop(struct clipboard_source *source)
 {
-	struct clipboard_source *source = data;
 	struct clipboard *clipboard = source->clipboard;
-	char *p;
-	int len, size;
+	struct clipboard_client *client, *next;
 
-	if (source->contents.alloc - source->contents.size < 1024) {
-		wl_array_add(&source->contents, 1024);
-		source->contents.size -= 1024;
-	}
+	/* the last client may hold the last reference */
+	source->refcount++;
 
-	p = source->contents.data + source->contents.size;
-	size = source->contents.alloc - source->contents.size;
-	len = read(fd, p, size);
-	if (len == 0) {
-		wl_event_source_remove(source->event_source);
-		close(fd);
-		source->event_source = NULL;
-	} else if (len < 0) {
-		clipboard_source_unref(source);
+	wl_event_source_remove(source->event_source);
+	close(source->fd);
+	source->event_source = NULL;
+
+	wl_list_for_each_safe(client, next, &source->client_list, link)
+		clipboard_client_destroy(client);
+
+	if (clipboard->source == source) {
 		clipboard->source = NULL;
+		clipboard_source_unref(source);
+	}
+
+	clipboard_source_unref(source);
+}
+
+static int
+clipboard_source_data(int fd, uint32_t mask, void *data)
+{
+	struct clipboard_source *source = data;
+	struct clipboard *clipboard = source->clipboard;
+	struct clipboard_client *client;
+	size_t len = 65536;
+	ssize_t n;
+
+	/* Read at most one byte past the limit: a selection of exactly
+	 * the limit still sees its EOF, a larger one gets that byte. */
+	if (clipboard->max_size > 0 &&
+	    source->size + (off_t) len > clipboard->max_size)
+		len = clipboard->max_size - source->size + 1;
+
+	n = clipboard_source_copy(source, fd, len);
+	if (n < 0 && errno == EAGAIN)
+		return 1;
+
+	if (n < 0) {
+		clipboard_source_drop(source);
+	} else if (n == 0) {
+		clipboard_source_finish(source);
+		clipboard_source_seal(source);
+	} else if (clipboard->max_size > 0 &&
+		   source->size + n > clipboard->max_size) {
+		weston_log("selection larger than %lld bytes, "
+			   "not keeping it\n",
+			   (long long) clipboard->max_size);
+		clipboard_source_drop(source);
 	} else {
-		source->contents.size += len;
+		source->size += n;
+		wl_list_for_each(client, &source->client_list, link)
+			clipboard_client_wake(client);
 	}
 
 	return 1;
@@ -137,12 +259,12 @@ clipboard_source_create(struct clipboard *clipboard,
 	struct clipboard_source *source;
 	char **s;
 
-	source = malloc(sizeof *source);
+	source = zalloc(sizeof *source);
 	if (source == NULL)
 		return NULL;
 
-	wl_array_init(&source->contents);
 	wl_array_init(&source->base.mime_types);
+	wl_list_init(&source->client_list);
 	source->base.resource = NULL;
 	source->base.accept = clipboard_source_accept;
 	source->base.send = clipboard_source_send;
@@ -151,6 +273,11 @@ clipboard_source_create(struct clipboard *clipboard,
 	source->refcount = 1;
 	source->clipboard = clipboard;
 	source->serial = serial;
+	source->fd = fd;
+
+	source->store_fd = clipboard_create_store();
+	if (source->store_fd < 0)
+		goto err_store;
 
 	s = wl_array_add(&source->base.mime_types, sizeof *s);
 	if (s == NULL)
@@ -171,37 +298,56 @@ clipboard_source_create(struct clipboard *clipboard,
  err_strdup:
 	wl_array_release(&source->base.mime_types);
  err_add:
+	close(source->store_fd);
+ err_store:
 	free(source);
 
 	return NULL;
 }
 
-struct clipboard_client {
-	struct wl_event_source *event_source;
-	size_t offset;
-	struct clipboard_source *source;
-};
+static void
+clipboard_client_destroy(struct clipboard_client *client)
+{
+	close(client->fd);
+	wl_list_remove(&client->link);
+	wl_event_source_remove(client->event_source);
+	clipboard_source_unref(client->source);
+	free(client);
+}
+
+static void
+clipboard_client_wake(struct clipboard_client *client)
+{
+	wl_event_source_fd_update(client->event_source, WL_EVENT_WRITABLE);
+}
 
 static int
 clipboard_client_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_client *client = data;
-	char *p;
-	size_t size;
-	int len;
+	struct clipboard_source *source = client->source;
+	ssize_t len;
+
+	if (client->offset < source->size) {
+		len = sendfile(fd, source->store_fd, &client->offset,
+			       source->size - client->offset);
+		if (len < 0 && errno == EAGAIN)
+			return 1;
+		if (len <= 0) {
+			clipboard_client_destroy(client);
+			return 1;
+		}
+	}
 
-	size = client->source->contents.size;
-	p = client->source->contents.data;
-	len = write(fd, p + client->offset, size - client->offset);
-	if (len > 0)
-		client->offset += len;
+	if (client->offset < source->size)
+		return 1;
 
-	if (client->offset == size || len <= 0) {
-		close(fd);
-		wl_event_source_remove(client->event_source);
-		clipboard_source_unref(client->source);
-		free(client);
-	}
+	/* Caught up: done if the source is complete, otherwise wait for
+	 * more data to arrive. */
+	if (source->event_source == NULL)
+		clipboard_client_destroy(client);
+	else
+		wl_event_source_fd_update(client->event_source, 0);
 
 	return 1;
 }
@@ -215,13 +361,27 @@ clipboard_client_create(struct clipboard_source *source, int fd)
 		wl_display_get_event_loop(seat->compositor->wl_display);
 
 	client = malloc(sizeof *client);
+	if (client == NULL) {
+		close(fd);
+		return;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
+	client->fd = fd;
 	client->offset = 0;
 	client->source = source;
-	source->refcount++;
 	client->event_source =
 		wl_event_loop_add_fd(loop, fd, WL_EVENT_WRITABLE,
 				     clipboard_client_data, client);
+	if (client->event_source == NULL) {
+		close(fd);
+		free(client);
+		return;
+	}
+
+	source->refcount++;
+	wl_list_insert(&source->client_list, &client->link);
 }
 
 static void
@@ -255,6 +415,7 @@ clipboard_set_selection(struct wl_listener *listener, void *data)
 	if (pipe2(p, O_CLOEXEC) == -1)
 		return;
 
+	fcntl(p[0], F_SETFL, O_NONBLOCK);
 	source->send(source, mime_types[0], p[1]);
 
 	clipboard->source =
@@ -282,11 +443,19 @@ struct clipboard *
 clipboard_create(struct weston_seat *seat)
 {
 	struct clipboard *clipboard;
+	struct weston_config_section *s;
+	int32_t max_size;
 
 	clipboard = zalloc(sizeof *clipboard);
 	if (clipboard == NULL)
 		return NULL;
 
+	s = weston_config_get_section(seat->compositor->config,
+				      "core", NULL, NULL);
+	weston_config_section_get_int(s, "clipboard-size-limit",
+				      &max_size, 64);
+	clipboard->max_size = (off_t) max_size * 1024 * 1024;
+
 	clipboard->seat = seat;
 	clipboard->selection_listener.notify = clipboard_set_selection;
 	clipboard->destroy_listener.notify = clipboard_destroy;
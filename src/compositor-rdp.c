@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <linux/input.h>
 
 #if HAVE_FREERDP_VERSION_H
@@ -51,6 +54,8 @@
 #define MAX_FREERDP_FDS 32
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 #define RDP_MODE_FREQ 60 * 1000
+#define RDP_TILE_SIZE 64
+#define RDP_MAX_ENCODER_THREADS 8
 
 struct rdp_compositor_config {
 	int width;
@@ -62,9 +67,31 @@ struct rdp_compositor_config {
 	char *server_key;
 	int env_socket;
 	int no_clients_resize;
+	int encoder_threads;
 };
 
 struct rdp_output;
+struct rdp_peer_context;
+
+/* Pool of threads running the RemoteFX/NSCodec encoders.  The damage of
+ * a job is snapshotted from the shadow surface on submission so the
+ * worker never races with repaint, and the encoded SurfaceBits are sent
+ * from the main loop once the worker signals completion through an
+ * eventfd. */
+struct rdp_encoder {
+	pthread_t *threads;
+	int nthreads;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t queue_cond;
+	pthread_cond_t done_cond;
+	struct wl_list queue;
+	struct wl_list done;
+	int destroying;
+
+	int fd;
+	struct wl_event_source *source;
+};
 
 struct rdp_compositor {
 	struct weston_compositor base;
@@ -78,6 +105,11 @@ struct rdp_compositor {
 	char *rdp_key;
 	int tls_enabled;
 	int no_clients_resize;
+
+	/* started with the first peer; 0 threads encodes synchronously */
+	struct rdp_encoder *encoder;
+	int encoder_threads;
+	struct wl_list free_jobs;
 };
 
 enum peer_item_flags {
@@ -101,15 +133,66 @@ struct rdp_output {
 	struct wl_list peers;
 };
 
+/* Hashes of the 64x64 tiles of the shadow surface as last sent to a
+ * peer.  Damaged tiles whose content hashes the same are dropped from
+ * the region before encoding. */
+struct rdp_tile_cache {
+	int width, height;
+	uint64_t *hashes;
+
+	uint64_t tiles_sent;
+	uint64_t tiles_skipped;
+	uint64_t bytes_saved;
+};
+
+enum rdp_job_state {
+	RDP_JOB_IDLE = 0,
+	RDP_JOB_QUEUED,
+	RDP_JOB_RUNNING,
+	RDP_JOB_DONE
+};
+
+/* One encoding of a region of the shadow surface.  NSCodec output only
+ * depends on the pixels, so all peers needing the same region share a
+ * job.  RemoteFX contexts carry per-peer state (frame index, headers),
+ * so a RemoteFX job serves a single peer and borrows its context.
+ * While the job is QUEUED or RUNNING, everything but the peer list
+ * belongs to the encoder. */
+struct rdp_encode_job {
+	enum rdp_job_state state;
+	struct wl_list link;
+
+	int rfx;
+	RFX_CONTEXT *rfx_context;
+	NSC_CONTEXT *nsc_context;
+	wStream *stream;
+	pixman_region32_t region;
+	pixman_box32_t extents;
+	RFX_RECT *rfx_rects;
+	int nrects;
+	BYTE *pixels;
+	size_t pixels_size;
+
+	/* RdpPeerContext pointers, NULL once a peer went away */
+	struct wl_array peers;
+};
+
 struct rdp_peer_context {
 	rdpContext _p;
 
 	struct rdp_compositor *rdpCompositor;
 	struct wl_event_source *events[MAX_FREERDP_FDS];
 	RFX_CONTEXT *rfx_context;
-	wStream *encode_stream;
-	RFX_RECT *rfx_rects;
-	NSC_CONTEXT *nsc_context;
+	struct rdp_tile_cache tile_cache;
+
+	/* Damage accumulated since the last update sent to this peer.  It
+	 * is held back while an encode for the peer is in flight or while
+	 * the peer has not acknowledged enough of the frames sent so far,
+	 * so a slow peer gets fewer, larger updates without holding back
+	 * the others. */
+	pixman_region32_t pending_damage;
+	struct rdp_encode_job *job;
+	UINT32 acked_frame_id;
 
 	struct rdp_peers_item item;
 };
@@ -126,95 +209,434 @@ rdp_compositor_config_init(struct rdp_compositor_config *config) {
 	config->server_key = NULL;
 	config->env_socket = 0;
 	config->no_clients_resize = 0;
+	config->encoder_threads = -1;
 }
 
-static void
-rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+static struct rdp_encode_job *
+rdp_encode_job_get(struct rdp_compositor *c)
 {
-	int width, height, nrects, i;
-	pixman_box32_t *region, *rects;
-	uint32_t *ptr;
-	RFX_RECT *rfxRect;
-	rdpUpdate *update = peer->update;
-	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct rdp_encode_job *job;
 
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	if (!wl_list_empty(&c->free_jobs)) {
+		job = container_of(c->free_jobs.next, struct rdp_encode_job, link);
+		wl_list_remove(&job->link);
+		wl_list_init(&job->link);
+		return job;
+	}
 
-	width = (damage->extents.x2 - damage->extents.x1);
-	height = (damage->extents.y2 - damage->extents.y1);
+	job = zalloc(sizeof *job);
+	if (!job)
+		return NULL;
 
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
-	cmd->bpp = 32;
-	cmd->codecID = peer->settings->RemoteFxCodecId;
-	cmd->width = width;
-	cmd->height = height;
+	job->stream = Stream_New(NULL, 65536);
+	job->nsc_context = nsc_context_new();
+	if (!job->stream || !job->nsc_context) {
+		if (job->stream)
+			Stream_Free(job->stream, TRUE);
+		if (job->nsc_context)
+			nsc_context_free(job->nsc_context);
+		free(job);
+		return NULL;
+	}
+	nsc_context_set_pixel_format(job->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
 
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
+	pixman_region32_init(&job->region);
+	wl_array_init(&job->peers);
+	wl_list_init(&job->link);
 
-	rects = pixman_region32_rectangles(damage, &nrects);
-	context->rfx_rects = realloc(context->rfx_rects, nrects * sizeof *rfxRect);
+	return job;
+}
 
-	for (i = 0; i < nrects; i++) {
-		region = &rects[i];
-		rfxRect = &context->rfx_rects[i];
+static void
+rdp_encode_job_put(struct rdp_compositor *c, struct rdp_encode_job *job)
+{
+	job->state = RDP_JOB_IDLE;
+	job->rfx_context = NULL;
+	job->peers.size = 0;
+	pixman_region32_clear(&job->region);
+	wl_list_insert(&c->free_jobs, &job->link);
+}
 
-		rfxRect->x = (region->x1 - damage->extents.x1);
-		rfxRect->y = (region->y1 - damage->extents.y1);
-		rfxRect->width = (region->x2 - region->x1);
-		rfxRect->height = (region->y2 - region->y1);
+static void
+rdp_encode_job_free(struct rdp_encode_job *job)
+{
+	wl_list_remove(&job->link);
+	Stream_Free(job->stream, TRUE);
+	nsc_context_free(job->nsc_context);
+	pixman_region32_fini(&job->region);
+	wl_array_release(&job->peers);
+	free(job->rfx_rects);
+	free(job->pixels);
+	free(job);
+}
+
+/* Copy the damaged part of the shadow surface into the job buffer,
+ * laid out as the extents of the damage with a tight stride. */
+static int
+rdp_encode_job_snapshot(struct rdp_encode_job *job, pixman_image_t *image)
+{
+	pixman_box32_t *extents = &job->extents;
+	pixman_box32_t *rects, *rect;
+	int nrects, i, y, width, height, stride, src_stride;
+	const BYTE *src;
+	size_t size;
+
+	*extents = *pixman_region32_extents(&job->region);
+	width = extents->x2 - extents->x1;
+	height = extents->y2 - extents->y1;
+	stride = width * 4;
+	size = (size_t)stride * height;
+
+	if (size > job->pixels_size) {
+		free(job->pixels);
+		job->pixels = malloc(size);
+		if (!job->pixels) {
+			job->pixels_size = 0;
+			return -1;
+		}
+		job->pixels_size = size;
+	}
+
+	/* NSCodec encodes the whole extents, RemoteFX only the rects */
+	if (job->rfx) {
+		rects = pixman_region32_rectangles(&job->region, &nrects);
+	} else {
+		rects = extents;
+		nrects = 1;
 	}
 
-	rfx_compose_message(context->rfx_context, context->encode_stream, context->rfx_rects, nrects,
-			(BYTE *)ptr, width, height,
-			pixman_image_get_stride(image)
-	);
+	src_stride = pixman_image_get_stride(image);
+	for (i = 0; i < nrects; i++) {
+		rect = &rects[i];
+		src = (const BYTE *)pixman_image_get_data(image) +
+			rect->y1 * src_stride + rect->x1 * 4;
+		for (y = rect->y1; y < rect->y2; y++, src += src_stride)
+			memcpy(job->pixels +
+			       (y - extents->y1) * stride +
+			       (rect->x1 - extents->x1) * 4,
+			       src, (rect->x2 - rect->x1) * 4);
+	}
 
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
+	if (!job->rfx)
+		return 0;
 
-	update->SurfaceBits(update->context, cmd);
+	rects = pixman_region32_rectangles(&job->region, &nrects);
+	job->rfx_rects = realloc(job->rfx_rects, nrects * sizeof *job->rfx_rects);
+	if (!job->rfx_rects)
+		return -1;
+
+	for (i = 0; i < nrects; i++) {
+		job->rfx_rects[i].x = (rects[i].x1 - extents->x1);
+		job->rfx_rects[i].y = (rects[i].y1 - extents->y1);
+		job->rfx_rects[i].width = (rects[i].x2 - rects[i].x1);
+		job->rfx_rects[i].height = (rects[i].y2 - rects[i].y1);
+	}
+	job->nrects = nrects;
+
+	return 0;
 }
 
+/* Runs on an encoder thread, or inline when there is no encoder. */
+static void
+rdp_encode_job_run(struct rdp_encode_job *job)
+{
+	int width = job->extents.x2 - job->extents.x1;
+	int height = job->extents.y2 - job->extents.y1;
+
+	Stream_Clear(job->stream);
+	Stream_SetPosition(job->stream, 0);
+
+	if (job->rfx)
+		rfx_compose_message(job->rfx_context, job->stream,
+				job->rfx_rects, job->nrects,
+				job->pixels, width, height, width * 4);
+	else
+		nsc_compose_message(job->nsc_context, job->stream,
+				job->pixels, width, height, width * 4);
+}
 
 static void
-rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_peer *peer)
+rdp_peer_send_encoded(RdpPeerContext *context, struct rdp_encode_job *job)
 {
-	int width, height;
-	uint32_t *ptr;
+	freerdp_peer *peer = context->item.peer;
 	rdpUpdate *update = peer->update;
 	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
-	RdpPeerContext *context = (RdpPeerContext *)peer->context;
-
-	Stream_Clear(context->encode_stream);
-	Stream_SetPosition(context->encode_stream, 0);
+	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
+	pixman_box32_t *extents = &job->extents;
 
-	width = (damage->extents.x2 - damage->extents.x1);
-	height = (damage->extents.y2 - damage->extents.y1);
+	marker->frameId++;
+	marker->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+	update->SurfaceFrameMarker(peer->context, marker);
 
-	cmd->destLeft = damage->extents.x1;
-	cmd->destTop = damage->extents.y1;
-	cmd->destRight = damage->extents.x2;
-	cmd->destBottom = damage->extents.y2;
+	cmd->destLeft = extents->x1;
+	cmd->destTop = extents->y1;
+	cmd->destRight = extents->x2;
+	cmd->destBottom = extents->y2;
 	cmd->bpp = 32;
-	cmd->codecID = peer->settings->NSCodecId;
-	cmd->width = width;
-	cmd->height = height;
-
-	ptr = pixman_image_get_data(image) + damage->extents.x1 +
-				damage->extents.y1 * (pixman_image_get_stride(image) / sizeof(uint32_t));
-
-	nsc_compose_message(context->nsc_context, context->encode_stream, (BYTE *)ptr,
-			cmd->width,	cmd->height,
-			pixman_image_get_stride(image));
-	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
-	cmd->bitmapData = Stream_Buffer(context->encode_stream);
+	cmd->codecID = job->rfx ?
+		peer->settings->RemoteFxCodecId : peer->settings->NSCodecId;
+	cmd->width = extents->x2 - extents->x1;
+	cmd->height = extents->y2 - extents->y1;
+	cmd->bitmapDataLength = Stream_GetPosition(job->stream);
+	cmd->bitmapData = Stream_Buffer(job->stream);
+
 	update->SurfaceBits(update->context, cmd);
+
+	marker->frameAction = SURFACECMD_FRAMEACTION_END;
+	update->SurfaceFrameMarker(peer->context, marker);
+}
+
+static void
+rdp_encode_job_deliver(struct rdp_compositor *c, struct rdp_encode_job *job)
+{
+	RdpPeerContext **context;
+
+	wl_array_for_each(context, &job->peers) {
+		if (!*context)
+			continue;
+		(*context)->job = NULL;
+		rdp_peer_send_encoded(*context, job);
+	}
+
+	rdp_encode_job_put(c, job);
+}
+
+static void *
+rdp_encoder_thread(void *data)
+{
+	struct rdp_encoder *encoder = data;
+	struct rdp_encode_job *job;
+	uint64_t one = 1;
+
+	pthread_mutex_lock(&encoder->mutex);
+	while (!encoder->destroying) {
+		if (wl_list_empty(&encoder->queue)) {
+			pthread_cond_wait(&encoder->queue_cond, &encoder->mutex);
+			continue;
+		}
+
+		job = container_of(encoder->queue.next,
+				struct rdp_encode_job, link);
+		wl_list_remove(&job->link);
+		job->state = RDP_JOB_RUNNING;
+		pthread_mutex_unlock(&encoder->mutex);
+
+		rdp_encode_job_run(job);
+
+		pthread_mutex_lock(&encoder->mutex);
+		job->state = RDP_JOB_DONE;
+		wl_list_insert(encoder->done.prev, &job->link);
+		pthread_cond_broadcast(&encoder->done_cond);
+
+		if (write(encoder->fd, &one, sizeof one) < 0)
+			weston_log("rdp encoder: failed to signal completion\n");
+	}
+	pthread_mutex_unlock(&encoder->mutex);
+
+	return NULL;
+}
+
+static void
+rdp_output_flush_peers(struct rdp_output *output);
+
+static void
+rdp_tile_cache_invalidate_region(struct rdp_tile_cache *cache,
+		pixman_region32_t *region);
+
+static int
+rdp_encoder_handle_done(int fd, uint32_t mask, void *data)
+{
+	struct rdp_compositor *c = data;
+	struct rdp_encoder *encoder = c->encoder;
+	struct rdp_encode_job *job;
+	struct wl_list done;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+		return 0;
+
+	wl_list_init(&done);
+	pthread_mutex_lock(&encoder->mutex);
+	wl_list_insert_list(&done, &encoder->done);
+	wl_list_init(&encoder->done);
+	pthread_mutex_unlock(&encoder->mutex);
+
+	while (!wl_list_empty(&done)) {
+		job = container_of(done.next, struct rdp_encode_job, link);
+		wl_list_remove(&job->link);
+		rdp_encode_job_deliver(c, job);
+	}
+
+	/* damage that arrived while encoding goes out next */
+	rdp_output_flush_peers(c->output);
+
+	return 1;
+}
+
+/* Detach the peer from its in-flight job before its codec state is
+ * reset or freed.  The peer does not get that update. */
+static void
+rdp_peer_cancel_job(RdpPeerContext *context)
+{
+	struct rdp_compositor *c = context->rdpCompositor;
+	struct rdp_encoder *encoder = c->encoder;
+	struct rdp_encode_job *job = context->job;
+	RdpPeerContext **peer;
+	int members = 0;
+
+	/* without an encoder, jobs complete before flushing returns */
+	if (!job || !encoder)
+		return;
+
+	pthread_mutex_lock(&encoder->mutex);
+	/* a RemoteFX job is using this peer's context */
+	while (job->rfx && job->state == RDP_JOB_RUNNING)
+		pthread_cond_wait(&encoder->done_cond, &encoder->mutex);
+
+	wl_array_for_each(peer, &job->peers) {
+		if (*peer == context)
+			*peer = NULL;
+		else if (*peer)
+			members++;
+	}
+
+	if (members == 0 && job->state != RDP_JOB_RUNNING) {
+		wl_list_remove(&job->link);
+		rdp_encode_job_put(c, job);
+	}
+	pthread_mutex_unlock(&encoder->mutex);
+
+	context->job = NULL;
+}
+
+static struct rdp_encoder *
+rdp_encoder_create(struct rdp_compositor *c, int nthreads)
+{
+	struct rdp_encoder *encoder;
+	struct wl_event_loop *loop;
+	int i;
+
+	encoder = zalloc(sizeof *encoder);
+	if (!encoder)
+		return NULL;
+
+	encoder->threads = calloc(nthreads, sizeof *encoder->threads);
+	if (!encoder->threads)
+		goto err_free;
+
+	encoder->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (encoder->fd < 0)
+		goto err_free;
+
+	loop = wl_display_get_event_loop(c->base.wl_display);
+	encoder->source = wl_event_loop_add_fd(loop, encoder->fd,
+			WL_EVENT_READABLE, rdp_encoder_handle_done, c);
+	if (!encoder->source)
+		goto err_fd;
+
+	pthread_mutex_init(&encoder->mutex, NULL);
+	pthread_cond_init(&encoder->queue_cond, NULL);
+	pthread_cond_init(&encoder->done_cond, NULL);
+	wl_list_init(&encoder->queue);
+	wl_list_init(&encoder->done);
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&encoder->threads[i], NULL,
+				rdp_encoder_thread, encoder) != 0)
+			break;
+	}
+	encoder->nthreads = i;
+
+	if (encoder->nthreads == 0) {
+		weston_log("failed to start RDP encoder threads\n");
+		wl_event_source_remove(encoder->source);
+		goto err_fd;
+	}
+
+	weston_log("RDP encoder using %d threads\n", encoder->nthreads);
+	return encoder;
+
+err_fd:
+	close(encoder->fd);
+err_free:
+	free(encoder->threads);
+	free(encoder);
+	return NULL;
+}
+
+static void
+rdp_encoder_destroy(struct rdp_encoder *encoder)
+{
+	struct rdp_encode_job *job, *tmp;
+	int i;
+
+	pthread_mutex_lock(&encoder->mutex);
+	encoder->destroying = 1;
+	pthread_cond_broadcast(&encoder->queue_cond);
+	pthread_mutex_unlock(&encoder->mutex);
+
+	for (i = 0; i < encoder->nthreads; i++)
+		pthread_join(encoder->threads[i], NULL);
+
+	/* Nothing runs any more: drop what was never encoded or sent. */
+	wl_list_for_each_safe(job, tmp, &encoder->queue, link)
+		rdp_encode_job_free(job);
+	wl_list_for_each_safe(job, tmp, &encoder->done, link)
+		rdp_encode_job_free(job);
+
+	pthread_mutex_destroy(&encoder->mutex);
+	pthread_cond_destroy(&encoder->queue_cond);
+	pthread_cond_destroy(&encoder->done_cond);
+	wl_event_source_remove(encoder->source);
+	close(encoder->fd);
+	free(encoder->threads);
+	free(encoder);
+}
+
+/* The pool is only worth its threads once somebody is watching. */
+static void
+rdp_encoder_start(struct rdp_compositor *c)
+{
+	if (c->encoder || c->encoder_threads <= 0)
+		return;
+
+	c->encoder = rdp_encoder_create(c, c->encoder_threads);
+	if (!c->encoder) {
+		weston_log("encoding RDP updates synchronously\n");
+		c->encoder_threads = 0;
+	}
+}
+
+static void
+rdp_encode_job_submit(struct rdp_compositor *c, struct rdp_encode_job *job)
+{
+	struct rdp_encoder *encoder = c->encoder;
+	RdpPeerContext **context;
+
+	if (rdp_encode_job_snapshot(job, c->output->shadow_surface) < 0) {
+		weston_log("RDP encoder: out of memory, deferring update\n");
+		wl_array_for_each(context, &job->peers) {
+			rdp_tile_cache_invalidate_region(&(*context)->tile_cache,
+					&job->region);
+			pixman_region32_union(&(*context)->pending_damage,
+					&(*context)->pending_damage, &job->region);
+			(*context)->job = NULL;
+		}
+		rdp_encode_job_put(c, job);
+		return;
+	}
+
+	if (!encoder) {
+		rdp_encode_job_run(job);
+		rdp_encode_job_deliver(c, job);
+		return;
+	}
+
+	pthread_mutex_lock(&encoder->mutex);
+	job->state = RDP_JOB_QUEUED;
+	wl_list_insert(encoder->queue.prev, &job->link);
+	pthread_cond_signal(&encoder->queue_cond);
+	pthread_mutex_unlock(&encoder->mutex);
 }
 
 static void
@@ -288,18 +710,294 @@ rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_p
 }
 
 static void
-rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
+rdp_tile_cache_invalidate(struct rdp_tile_cache *cache)
+{
+	if (cache->hashes)
+		memset(cache->hashes, 0,
+		       cache->width * cache->height * sizeof *cache->hashes);
+}
+
+/* Forget the tiles covering region: an update for them was dropped after
+ * rdp_tile_cache_filter() had already recorded their hashes as sent. */
+static void
+rdp_tile_cache_invalidate_region(struct rdp_tile_cache *cache,
+		pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	int nrects, i, tx, ty, tx1, ty1, tx2, ty2;
+
+	if (!cache->hashes)
+		return;
+
+	rects = pixman_region32_rectangles(region, &nrects);
+	for (i = 0; i < nrects; i++) {
+		tx1 = rects[i].x1 > 0 ? rects[i].x1 / RDP_TILE_SIZE : 0;
+		ty1 = rects[i].y1 > 0 ? rects[i].y1 / RDP_TILE_SIZE : 0;
+		tx2 = (rects[i].x2 + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+		ty2 = (rects[i].y2 + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+		if (tx2 > cache->width)
+			tx2 = cache->width;
+		if (ty2 > cache->height)
+			ty2 = cache->height;
+
+		for (ty = ty1; ty < ty2; ty++)
+			for (tx = tx1; tx < tx2; tx++)
+				cache->hashes[ty * cache->width + tx] = 0;
+	}
+}
+
+static void
+rdp_tile_cache_release(struct rdp_tile_cache *cache)
+{
+	free(cache->hashes);
+	cache->hashes = NULL;
+	cache->width = cache->height = 0;
+}
+
+static int
+rdp_tile_cache_ensure(struct rdp_tile_cache *cache, pixman_image_t *image)
+{
+	int width, height;
+
+	width = (pixman_image_get_width(image) + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+	height = (pixman_image_get_height(image) + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+
+	if (cache->hashes && width == cache->width && height == cache->height)
+		return 0;
+
+	free(cache->hashes);
+	cache->hashes = calloc(width * height, sizeof *cache->hashes);
+	if (!cache->hashes) {
+		cache->width = cache->height = 0;
+		return -1;
+	}
+
+	cache->width = width;
+	cache->height = height;
+	return 0;
+}
+
+static uint64_t
+rdp_tile_hash(pixman_image_t *image, const pixman_box32_t *tile)
+{
+	int stride = pixman_image_get_stride(image);
+	int bytes = (tile->x2 - tile->x1) * 4;
+	const BYTE *row = (const BYTE *)pixman_image_get_data(image);
+	uint64_t h = 0xcbf29ce484222325ULL, v;
+	int x, y;
+
+	row += tile->y1 * stride + tile->x1 * 4;
+	for (y = tile->y1; y < tile->y2; y++, row += stride) {
+		for (x = 0; x + 8 <= bytes; x += 8) {
+			memcpy(&v, row + x, sizeof v);
+			h = (h ^ v) * 0x100000001b3ULL;
+			h ^= h >> 29;
+		}
+		if (x < bytes) {
+			v = 0;
+			memcpy(&v, row + x, bytes - x);
+			h = (h ^ v) * 0x100000001b3ULL;
+			h ^= h >> 29;
+		}
+	}
+
+	/* 0 marks a tile the peer has no known content for */
+	return h | 1;
+}
+
+static int
+rdp_region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	int nrects, i, area = 0;
+
+	rects = pixman_region32_rectangles(region, &nrects);
+	for (i = 0; i < nrects; i++)
+		area += (rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+	return area;
+}
+
+/* Remove from region the tiles whose content the peer already has. */
+static void
+rdp_tile_cache_filter(struct rdp_tile_cache *cache, pixman_image_t *image,
+		pixman_region32_t *region)
+{
+	pixman_box32_t *extents = pixman_region32_extents(region);
+	pixman_box32_t tile;
+	pixman_region32_t tile_damage;
+	int width = pixman_image_get_width(image);
+	int height = pixman_image_get_height(image);
+	int tx, ty, tx1, ty1, tx2, ty2;
+	uint64_t hash, *slot;
+
+	if (!pixman_region32_not_empty(region) ||
+	    rdp_tile_cache_ensure(cache, image) < 0)
+		return;
+
+	tx1 = extents->x1 > 0 ? extents->x1 / RDP_TILE_SIZE : 0;
+	ty1 = extents->y1 > 0 ? extents->y1 / RDP_TILE_SIZE : 0;
+	tx2 = (extents->x2 + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+	ty2 = (extents->y2 + RDP_TILE_SIZE - 1) / RDP_TILE_SIZE;
+	if (tx2 > cache->width)
+		tx2 = cache->width;
+	if (ty2 > cache->height)
+		ty2 = cache->height;
+
+	pixman_region32_init(&tile_damage);
+	for (ty = ty1; ty < ty2; ty++) {
+		for (tx = tx1; tx < tx2; tx++) {
+			tile.x1 = tx * RDP_TILE_SIZE;
+			tile.y1 = ty * RDP_TILE_SIZE;
+			tile.x2 = tile.x1 + RDP_TILE_SIZE;
+			tile.y2 = tile.y1 + RDP_TILE_SIZE;
+			if (tile.x2 > width)
+				tile.x2 = width;
+			if (tile.y2 > height)
+				tile.y2 = height;
+
+			if (pixman_region32_contains_rectangle(region, &tile) == PIXMAN_REGION_OUT)
+				continue;
+
+			hash = rdp_tile_hash(image, &tile);
+			slot = &cache->hashes[ty * cache->width + tx];
+			if (*slot != hash) {
+				*slot = hash;
+				cache->tiles_sent++;
+				continue;
+			}
+
+			pixman_region32_intersect_rect(&tile_damage, region,
+					tile.x1, tile.y1,
+					tile.x2 - tile.x1, tile.y2 - tile.y1);
+			cache->bytes_saved += rdp_region_area(&tile_damage) * 4;
+			cache->tiles_skipped++;
+
+			pixman_region32_subtract(region, region, &tile_damage);
+		}
+	}
+	pixman_region32_fini(&tile_damage);
+}
+
+static int
+rdp_peer_can_send(RdpPeerContext *context)
+{
+	freerdp_peer *peer = context->item.peer;
+	UINT32 max_frames = peer->settings->FrameAcknowledge;
+	UINT32 in_flight;
+
+	if (!(context->item.flags & RDP_PEER_ACTIVATED) ||
+			!(context->item.flags & RDP_PEER_OUTPUT_ENABLED) ||
+			context->job)
+		return 0;
+
+	/* peers that don't acknowledge frames are not paced */
+	if (!max_frames)
+		return 1;
+
+	in_flight = peer->update->surface_frame_marker.frameId - context->acked_frame_id;
+	return in_flight < max_frames;
+}
+
+/* Send every peer that can take an update the damage it accumulated.
+ * Peers that use NSCodec and need the same region share one encode. */
+static void
+rdp_output_flush_peers(struct rdp_output *output)
+{
+	struct rdp_compositor *c = (struct rdp_compositor *)output->base.compositor;
+	struct rdp_peers_item *item;
+	struct rdp_encode_job *job, *tmp;
+	RdpPeerContext *context, **slot;
+	rdpSettings *settings;
+	pixman_region32_t changed;
+	struct wl_list jobs;
+
+	wl_list_init(&jobs);
+	pixman_region32_init(&changed);
+
+	wl_list_for_each(item, &output->peers, link) {
+		context = container_of(item, RdpPeerContext, item);
+		settings = item->peer->settings;
+
+		if (!pixman_region32_not_empty(&context->pending_damage) ||
+				!rdp_peer_can_send(context))
+			continue;
+
+		pixman_region32_copy(&changed, &context->pending_damage);
+		pixman_region32_clear(&context->pending_damage);
+		rdp_tile_cache_filter(&context->tile_cache, output->shadow_surface, &changed);
+
+		if (!pixman_region32_not_empty(&changed))
+			continue;
+
+		if (!settings->RemoteFxCodec && !settings->NSCodec) {
+			rdp_peer_refresh_raw(&changed, output->shadow_surface, item->peer);
+			continue;
+		}
+
+		job = NULL;
+		if (!settings->RemoteFxCodec) {
+			wl_list_for_each(tmp, &jobs, link) {
+				if (!tmp->rfx && pixman_region32_equal(&tmp->region, &changed)) {
+					job = tmp;
+					break;
+				}
+			}
+		}
+
+		if (!job) {
+			job = rdp_encode_job_get(c);
+			if (!job) {
+				rdp_tile_cache_invalidate_region(&context->tile_cache,
+						&changed);
+				pixman_region32_union(&context->pending_damage,
+						&context->pending_damage, &changed);
+				continue;
+			}
+			job->rfx = settings->RemoteFxCodec;
+			job->rfx_context = job->rfx ? context->rfx_context : NULL;
+			pixman_region32_copy(&job->region, &changed);
+			wl_list_insert(jobs.prev, &job->link);
+		}
+
+		slot = wl_array_add(&job->peers, sizeof *slot);
+		if (!slot) {
+			rdp_tile_cache_invalidate_region(&context->tile_cache,
+					&changed);
+			pixman_region32_union(&context->pending_damage,
+					&context->pending_damage, &changed);
+			continue;
+		}
+		*slot = context;
+		context->job = job;
+	}
+
+	pixman_region32_fini(&changed);
+
+	wl_list_for_each_safe(job, tmp, &jobs, link) {
+		wl_list_remove(&job->link);
+		wl_list_init(&job->link);
+		if (job->peers.size == 0)
+			rdp_encode_job_put(c, job);
+		else
+			rdp_encode_job_submit(c, job);
+	}
+}
+
+/* The peer lost (or never had) its copy of the screen: forget what we
+ * think it shows and send everything. */
+static void
+rdp_peer_refresh_full(freerdp_peer *peer)
 {
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
 	struct rdp_output *output = context->rdpCompositor->output;
-	rdpSettings *settings = peer->settings;
 
-	if (settings->RemoteFxCodec)
-		rdp_peer_refresh_rfx(region, output->shadow_surface, peer);
-	else if (settings->NSCodec)
-		rdp_peer_refresh_nsc(region, output->shadow_surface, peer);
-	else
-		rdp_peer_refresh_raw(region, output->shadow_surface, peer);
+	rdp_tile_cache_invalidate(&context->tile_cache);
+
+	pixman_region32_union_rect(&context->pending_damage, &context->pending_damage,
+			0, 0, output->base.width, output->base.height);
+
+	rdp_output_flush_peers(output);
 }
 
 static void
@@ -319,18 +1017,22 @@ rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage)
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
 	struct rdp_peers_item *outputPeer;
+	RdpPeerContext *context;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
 	if (pixman_region32_not_empty(damage)) {
+		/* suppressed peers keep accumulating, so they catch up
+		 * once they allow output again */
 		wl_list_for_each(outputPeer, &output->peers, link) {
-			if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
-					(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
-			{
-				rdp_peer_refresh_region(damage, outputPeer->peer);
-			}
+			context = (RdpPeerContext *)outputPeer->peer->context;
+			if (outputPeer->flags & RDP_PEER_ACTIVATED)
+				pixman_region32_union(&context->pending_damage,
+						&context->pending_damage, damage);
 		}
+
+		rdp_output_flush_peers(output);
 	}
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
@@ -506,6 +1208,14 @@ rdp_restore(struct weston_compositor *ec)
 static void
 rdp_destroy(struct weston_compositor *ec)
 {
+	struct rdp_compositor *c = (struct rdp_compositor *)ec;
+	struct rdp_encode_job *job, *tmp;
+
+	if (c->encoder)
+		rdp_encoder_destroy(c->encoder);
+	wl_list_for_each_safe(job, tmp, &c->free_jobs, link)
+		rdp_encode_job_free(job);
+
 	weston_compositor_shutdown(ec);
 
 	free(ec);
@@ -566,10 +1276,7 @@ rdp_peer_context_new(freerdp_peer* client, RdpPeerContext* context)
 	context->rfx_context->height = client->settings->DesktopHeight;
 	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
 
-	context->nsc_context = nsc_context_new();
-	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
-
-	context->encode_stream = Stream_New(NULL, 65536);
+	pixman_region32_init(&context->pending_damage);
 }
 
 static void
@@ -579,6 +1286,9 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 	if (!context)
 		return;
 
+	rdp_peer_cancel_job(context);
+	pixman_region32_fini(&context->pending_damage);
+
 	wl_list_remove(&context->item.link);
 	for(i = 0; i < MAX_FREERDP_FDS; i++) {
 		if (context->events[i])
@@ -590,10 +1300,14 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 		weston_seat_release_pointer(&context->item.seat);
 		weston_seat_release(&context->item.seat);
 	}
-	Stream_Free(context->encode_stream, TRUE);
-	nsc_context_free(context->nsc_context);
+	weston_log("RDP peer %p: %llu tiles sent, %llu unchanged tiles skipped, "
+		   "%llu bytes saved\n", client,
+		   (unsigned long long)context->tile_cache.tiles_sent,
+		   (unsigned long long)context->tile_cache.tiles_skipped,
+		   (unsigned long long)context->tile_cache.bytes_saved);
+	rdp_tile_cache_release(&context->tile_cache);
+
 	rfx_context_free(context->rfx_context);
-	free(context->rfx_rects);
 }
 
 
@@ -766,8 +1480,6 @@ xf_peer_post_connect(freerdp_peer* client)
 	struct xkb_rule_names xkbRuleNames;
 	struct xkb_keymap *keymap;
 	int i;
-	pixman_box32_t box;
-	pixman_region32_t damage;
 
 
 	peerCtx = (RdpPeerContext *)client->context;
@@ -841,6 +1553,7 @@ xf_peer_post_connect(freerdp_peer* client)
 	weston_seat_init_keyboard(&peerCtx->item.seat, keymap);
 	weston_seat_init_pointer(&peerCtx->item.seat);
 
+	rdp_encoder_start(c);
 	peerCtx->item.flags |= RDP_PEER_ACTIVATED;
 
 	/* disable pointer on the client side */
@@ -848,16 +1561,7 @@ xf_peer_post_connect(freerdp_peer* client)
 	pointer->pointer_system.type = SYSPTR_NULL;
 	pointer->PointerSystem(client->context, &pointer->pointer_system);
 
-	/* sends a full refresh */
-	box.x1 = 0;
-	box.y1 = 0;
-	box.x2 = output->base.width;
-	box.y2 = output->base.height;
-	pixman_region32_init_with_extents(&damage, &box);
-
-	rdp_peer_refresh_region(&damage, client);
-
-	pixman_region32_fini(&damage);
+	rdp_peer_refresh_full(client);
 
 	return TRUE;
 }
@@ -866,6 +1570,8 @@ static BOOL
 xf_peer_activate(freerdp_peer *client)
 {
 	RdpPeerContext *context = (RdpPeerContext *)client->context;
+	rdp_peer_cancel_job(context);
+	rdp_tile_cache_invalidate(&context->tile_cache);
 	rfx_context_reset(context->rfx_context);
 	return TRUE;
 }
@@ -937,21 +1643,8 @@ static void
 xf_input_synchronize_event(rdpInput *input, UINT32 flags)
 {
 	freerdp_peer *client = input->context->peer;
-	RdpPeerContext *peerCtx = (RdpPeerContext *)input->context;
-	struct rdp_output *output = peerCtx->rdpCompositor->output;
-	pixman_box32_t box;
-	pixman_region32_t damage;
-
-	/* sends a full refresh */
-	box.x1 = 0;
-	box.y1 = 0;
-	box.x2 = output->base.width;
-	box.y2 = output->base.height;
-	pixman_region32_init_with_extents(&damage, &box);
 
-	rdp_peer_refresh_region(&damage, client);
-
-	pixman_region32_fini(&damage);
+	rdp_peer_refresh_full(client);
 }
 
 
@@ -999,10 +1692,21 @@ xf_input_unicode_keyboard_event(rdpInput *input, UINT16 flags, UINT16 code)
 static void
 xf_suppress_output(rdpContext *context, BYTE allow, RECTANGLE_16 *area) {
 	RdpPeerContext *peerContext = (RdpPeerContext *)context;
-	if (allow)
+	if (allow) {
 		peerContext->item.flags |= RDP_PEER_OUTPUT_ENABLED;
-	else
+		rdp_output_flush_peers(peerContext->rdpCompositor->output);
+	} else {
 		peerContext->item.flags &= (~RDP_PEER_OUTPUT_ENABLED);
+	}
+}
+
+static void
+xf_surface_frame_acknowledge(rdpContext *context, UINT32 frameId)
+{
+	RdpPeerContext *peerContext = (RdpPeerContext *)context;
+
+	peerContext->acked_frame_id = frameId;
+	rdp_output_flush_peers(peerContext->rdpCompositor->output);
 }
 
 static int
@@ -1041,6 +1745,7 @@ rdp_peer_init(freerdp_peer *client, struct rdp_compositor *c)
 	client->Activate = xf_peer_activate;
 
 	client->update->SuppressOutput = xf_suppress_output;
+	client->update->SurfaceFrameAcknowledge = xf_surface_frame_acknowledge;
 
 	input = client->input;
 	input->SynchronizeEvent = xf_input_synchronize_event;
@@ -1091,12 +1796,14 @@ rdp_compositor_create(struct wl_display *display,
 {
 	struct rdp_compositor *c;
 	char *fd_str;
-	int fd;
+	int fd, nthreads;
 
 	c = zalloc(sizeof *c);
 	if (c == NULL)
 		return NULL;
 
+	wl_list_init(&c->free_jobs);
+
 	if (weston_compositor_init(&c->base, display, argc, argv, wconfig) < 0)
 		goto err_free;
 
@@ -1123,6 +1830,16 @@ rdp_compositor_create(struct wl_display *display,
 
 	c->base.capabilities |= WESTON_CAP_ARBITRARY_MODES;
 
+	nthreads = config->encoder_threads;
+	if (nthreads < 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads < 1)
+			nthreads = 1;
+		else if (nthreads > RDP_MAX_ENCODER_THREADS)
+			nthreads = RDP_MAX_ENCODER_THREADS;
+	}
+	c->encoder_threads = nthreads;
+
 	if(!config->env_socket) {
 		c->listener = freerdp_listener_new();
 		c->listener->PeerAccepted = rdp_incoming_peer;
@@ -1187,7 +1904,8 @@ backend_init(struct wl_display *display, int *argc, char *argv[],
 		{ WESTON_OPTION_BOOLEAN, "no-clients-resize", 0, &config.no_clients_resize },
 		{ WESTON_OPTION_STRING,  "rdp4-key", 0, &config.rdp_key },
 		{ WESTON_OPTION_STRING,  "rdp-tls-cert", 0, &config.server_cert },
-		{ WESTON_OPTION_STRING,  "rdp-tls-key", 0, &config.server_key }
+		{ WESTON_OPTION_STRING,  "rdp-tls-key", 0, &config.server_key },
+		{ WESTON_OPTION_INTEGER, "encoder-threads", 0, &config.encoder_threads }
 	};
 
 	parse_options(rdp_options, ARRAY_LENGTH(rdp_options), argc, argv);
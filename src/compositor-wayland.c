@@ -135,14 +135,27 @@ struct wayland_parent_output {
 	struct weston_mode *current_mode;
 };
 
+/* Number of buffers carved out of each output's shm pool */
+#define WAYLAND_SHM_BUFFERS 3
+
+/* One mapping shared by the buffers carved out of it; unmapped when the
+ * last of those buffers is destroyed. */
+struct wayland_shm_pool {
+	void *data;
+	size_t size;
+	int refcount;
+};
+
 struct wayland_shm_buffer {
 	struct wayland_output *output;
 	struct wl_list link;
 	struct wl_list free_link;
 
 	struct wl_buffer *buffer;
+	struct wayland_shm_pool *pool;
 	void *data;
 	size_t size;
+	/* Damage not yet rendered into this buffer, global coordinates */
 	pixman_region32_t damage;
 	int frame_damaged;
 
@@ -184,7 +197,10 @@ wayland_shm_buffer_destroy(struct wayland_shm_buffer *buffer)
 	pixman_image_unref(buffer->pm_image);
 
 	wl_buffer_destroy(buffer->buffer);
-	munmap(buffer->data, buffer->size);
+	if (--buffer->pool->refcount == 0) {
+		munmap(buffer->pool->data, buffer->pool->size);
+		free(buffer->pool);
+	}
 
 	pixman_region32_fini(&buffer->damage);
 
@@ -210,81 +226,41 @@ static const struct wl_buffer_listener buffer_listener = {
 };
 
 static struct wayland_shm_buffer *
-wayland_output_get_shm_buffer(struct wayland_output *output)
+wayland_shm_buffer_create(struct wayland_output *output,
+			  struct wayland_shm_pool *pool, struct wl_shm_pool *wl_pool,
+			  int32_t offset, int width, int height, int stride)
 {
-	struct wayland_compositor *c =
-		(struct wayland_compositor *) output->base.compositor;
-	struct wl_shm *shm = c->parent.shm;
 	struct wayland_shm_buffer *sb;
-
-	struct wl_shm_pool *pool;
-	int width, height, stride;
-	int32_t fx, fy;
-	int fd;
 	unsigned char *data;
-
-	if (!wl_list_empty(&output->shm.free_buffers)) {
-		sb = container_of(output->shm.free_buffers.next,
-				  struct wayland_shm_buffer, free_link);
-		wl_list_remove(&sb->free_link);
-		wl_list_init(&sb->free_link);
-
-		return sb;
-	}
-
-	if (output->frame) {
-		width = frame_width(output->frame);
-		height = frame_height(output->frame);
-	} else {
-		width = output->base.current_mode->width;
-		height = output->base.current_mode->height;
-	}
-
-	stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-
-	fd = os_create_anonymous_file(height * stride);
-	if (fd < 0) {
-		weston_log("could not create an anonymous file buffer: %m\n");
-		return NULL;
-	}
-
-	data = mmap(NULL, height * stride, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (data == MAP_FAILED) {
-		weston_log("could not mmap %d memory for data: %m\n", height * stride);
-		close(fd);
-		return NULL;
-	}
+	int32_t fx, fy;
 
 	sb = zalloc(sizeof *sb);
 	if (sb == NULL) {
 		weston_log("could not zalloc %zu memory for sb: %m\n", sizeof *sb);
-		close(fd);
-		free(data);
 		return NULL;
 	}
 
+	data = (unsigned char *) pool->data + offset;
+
 	sb->output = output;
+	sb->pool = pool;
+	pool->refcount++;
 	wl_list_init(&sb->free_link);
 	wl_list_insert(&output->shm.buffers, &sb->link);
 
-	pixman_region32_init_rect(&sb->damage, 0, 0,
-				  output->base.width, output->base.height);
+	/* A fresh buffer has never been rendered into */
+	pixman_region32_init(&sb->damage);
+	pixman_region32_copy(&sb->damage, &output->base.region);
 	sb->frame_damaged = 1;
 
 	sb->data = data;
 	sb->size = height * stride;
 
-	pool = wl_shm_create_pool(shm, fd, sb->size);
-
-	sb->buffer = wl_shm_pool_create_buffer(pool, 0,
+	sb->buffer = wl_shm_pool_create_buffer(wl_pool, offset,
 					       width, height,
 					       stride,
 					       WL_SHM_FORMAT_ARGB8888);
 	wl_buffer_add_listener(sb->buffer, &buffer_listener, sb);
-	wl_shm_pool_destroy(pool);
-	close(fd);
-
-	memset(data, 0, sb->size);
 
 	sb->c_surface =
 		cairo_image_surface_create_for_data(data, CAIRO_FORMAT_ARGB32,
@@ -302,6 +278,127 @@ wayland_output_get_shm_buffer(struct wayland_output *output)
 	return sb;
 }
 
+/* Allocate one shm pool holding @count buffers of the current output size
+ * and put all of them on the free list. The file is freshly truncated, so
+ * the buffers start out zeroed without touching the pages. */
+static int
+wayland_output_create_shm_pool(struct wayland_output *output, int count)
+{
+	struct wayland_compositor *c =
+		(struct wayland_compositor *) output->base.compositor;
+	struct wayland_shm_pool *pool;
+	struct wayland_shm_buffer *sb;
+	struct wl_shm_pool *wl_pool;
+	int width, height, stride;
+	size_t size;
+	int fd, i;
+
+	if (output->frame) {
+		width = frame_width(output->frame);
+		height = frame_height(output->frame);
+	} else {
+		width = output->base.current_mode->width;
+		height = output->base.current_mode->height;
+	}
+
+	stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+	size = (size_t) height * stride * count;
+
+	pool = zalloc(sizeof *pool);
+	if (pool == NULL) {
+		weston_log("could not zalloc %zu memory for pool: %m\n",
+			   sizeof *pool);
+		return -1;
+	}
+
+	fd = os_create_anonymous_file(size);
+	if (fd < 0) {
+		weston_log("could not create an anonymous file buffer: %m\n");
+		free(pool);
+		return -1;
+	}
+
+	pool->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (pool->data == MAP_FAILED) {
+		weston_log("could not mmap %zu memory for data: %m\n", size);
+		close(fd);
+		free(pool);
+		return -1;
+	}
+	pool->size = size;
+
+	wl_pool = wl_shm_create_pool(c->parent.shm, fd, size);
+	close(fd);
+
+	/* Hold a reference while carving so a failure part way through
+	 * doesn't unmap the buffers already created. */
+	pool->refcount = 1;
+	for (i = 0; i < count; i++) {
+		sb = wayland_shm_buffer_create(output, pool, wl_pool,
+					       i * height * stride,
+					       width, height, stride);
+		if (sb == NULL)
+			break;
+		wl_list_insert(output->shm.free_buffers.prev, &sb->free_link);
+	}
+
+	wl_shm_pool_destroy(wl_pool);
+
+	if (--pool->refcount == 0) {
+		munmap(pool->data, pool->size);
+		free(pool);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+wayland_output_release_shm_buffers(struct wayland_output *output)
+{
+	struct wayland_shm_buffer *buffer, *next;
+
+	/* Throw away any remaining SHM buffers */
+	wl_list_for_each_safe(buffer, next, &output->shm.free_buffers,
+			      free_link)
+		wayland_shm_buffer_destroy(buffer);
+
+	/* These will get thrown away when they get released */
+	wl_list_for_each_safe(buffer, next, &output->shm.buffers, link) {
+		buffer->output = NULL;
+		wl_list_remove(&buffer->link);
+		wl_list_init(&buffer->link);
+	}
+}
+
+static struct wayland_shm_buffer *
+wayland_output_get_shm_buffer(struct wayland_output *output)
+{
+	struct wayland_shm_buffer *sb;
+	int count;
+
+	if (wl_list_empty(&output->shm.free_buffers)) {
+		/* The first pool holds the whole rotation; should the parent
+		 * hold on to all of them, grow one buffer at a time.  With
+		 * GL only the initial frame is drawn through shm. */
+		if (wl_list_empty(&output->shm.buffers) &&
+		    !output->gl.egl_window)
+			count = WAYLAND_SHM_BUFFERS;
+		else
+			count = 1;
+
+		if (wayland_output_create_shm_pool(output, count) < 0)
+			return NULL;
+	}
+
+	sb = container_of(output->shm.free_buffers.next,
+			  struct wayland_shm_buffer, free_link);
+	wl_list_remove(&sb->free_link);
+	wl_list_init(&sb->free_link);
+
+	return sb;
+}
+
 static void
 frame_done(void *data, struct wl_callback *callback, uint32_t time)
 {
@@ -321,11 +418,16 @@ draw_initial_frame(struct wayland_output *output)
 	struct wayland_shm_buffer *sb;
 
 	sb = wayland_output_get_shm_buffer(output);
+	if (sb == NULL)
+		return;
 
 	/* If we are rendering with GL, then orphan it so that it gets
 	 * destroyed immediately */
-	if (output->gl.egl_window)
+	if (output->gl.egl_window) {
 		sb->output = NULL;
+		wl_list_remove(&sb->link);
+		wl_list_init(&sb->link);
+	}
 
 	wl_surface_attach(output->parent.surface, sb->buffer, 0, 0);
 	wl_surface_damage(output->parent.surface, 0, 0,
@@ -488,8 +590,12 @@ wayland_output_update_shm_border(struct wayland_shm_buffer *buffer)
 	cairo_destroy(cr);
 }
 
+/* Attach @sb and damage what changed since the previously attached
+ * buffer: @frame_damage (global coordinates) and, when it was redrawn,
+ * the decoration. */
 static void
-wayland_shm_buffer_attach(struct wayland_shm_buffer *sb)
+wayland_shm_buffer_attach(struct wayland_shm_buffer *sb,
+			  pixman_region32_t *frame_damage)
 {
 	pixman_region32_t damage;
 	pixman_box32_t *rects;
@@ -497,11 +603,14 @@ wayland_shm_buffer_attach(struct wayland_shm_buffer *sb)
 	int i, n;
 
 	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, frame_damage);
+	pixman_region32_translate(&damage,
+				  -sb->output->base.x, -sb->output->base.y);
 	weston_transformed_region(sb->output->base.width,
 				  sb->output->base.height,
 				  sb->output->base.transform,
 				  sb->output->base.current_scale,
-				  &sb->damage, &damage);
+				  &damage, &damage);
 
 	if (sb->output->frame) {
 		frame_interior(sb->output->frame, &ix, &iy, &iwidth, &iheight);
@@ -531,8 +640,7 @@ wayland_shm_buffer_attach(struct wayland_shm_buffer *sb)
 				  rects[i].y1, rects[i].x2 - rects[i].x1,
 				  rects[i].y2 - rects[i].y1);
 
-	if (sb->output->frame)
-		pixman_region32_fini(&damage);
+	pixman_region32_fini(&damage);
 }
 
 static int
@@ -555,12 +663,17 @@ wayland_output_repaint_pixman(struct weston_output *output_base,
 		pixman_region32_union(&sb->damage, &sb->damage, damage);
 
 	sb = wayland_output_get_shm_buffer(output);
+	if (sb == NULL)
+		return -1;
 
+	/* The buffer is brought up to date with everything that changed
+	 * since it was last used, but only this frame's damage is new to
+	 * the parent. */
 	wayland_output_update_shm_border(sb);
 	pixman_renderer_output_set_buffer(output_base, sb->pm_image);
 	c->base.renderer->repaint_output(output_base, &sb->damage);
 
-	wayland_shm_buffer_attach(sb);
+	wayland_shm_buffer_attach(sb, damage);
 
 	callback = wl_surface_frame(output->parent.surface);
 	wl_callback_add_listener(callback, &frame_listener, output);
@@ -589,6 +702,8 @@ wayland_output_destroy(struct weston_output *output_base)
 		gl_renderer->output_destroy(output_base);
 	}
 
+	wayland_output_release_shm_buffers(output);
+
 	wl_egl_window_destroy(output->gl.egl_window);
 	wl_surface_destroy(output->parent.surface);
 	if (output->parent.shell_surface)
@@ -655,7 +770,6 @@ wayland_output_resize_surface(struct wayland_output *output)
 {
 	struct wayland_compositor *c =
 		(struct wayland_compositor *)output->base.compositor;
-	struct wayland_shm_buffer *buffer, *next;
 	int32_t ix, iy, iwidth, iheight;
 	int32_t width, height;
 	struct wl_region *region;
@@ -719,12 +833,7 @@ wayland_output_resize_surface(struct wayland_output *output)
 		output->gl.border.bottom = NULL;
 	}
 
-	/* Throw away any remaining SHM buffers */
-	wl_list_for_each_safe(buffer, next, &output->shm.free_buffers, link)
-		wayland_shm_buffer_destroy(buffer);
-	/* These will get thrown away when they get released */
-	wl_list_for_each(buffer, &output->shm.buffers, link)
-		buffer->output = NULL;
+	wayland_output_release_shm_buffers(output);
 }
 
 static int
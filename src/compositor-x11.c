@@ -72,6 +72,7 @@ struct x11_compositor {
 	unsigned int		 has_xkb;
 	uint8_t			 xkb_event_base;
 	int			 use_pixman;
+	uint8_t			 shm_event_base;
 
 	int			 has_net_wm_state_fullscreen;
 
@@ -100,18 +101,38 @@ struct x11_compositor {
 	} atom;
 };
 
+/* Number of SHM segments each pixman output rotates through, and the
+ * number of damage rectangles above which the extents are uploaded in a
+ * single request instead. */
+#define X11_SHM_BUFFERS		2
+#define X11_SHM_MAX_RECTS	16
+
+struct x11_shm_buffer {
+	xcb_shm_seg_t		segment;
+	int			shm_id;
+	void		       *buf;
+	pixman_image_t	       *image;
+	/* Damage not yet rendered into this buffer, global coordinates */
+	pixman_region32_t	damage;
+	/* The X server may still read from the segment */
+	int			busy;
+};
+
 struct x11_output {
 	struct weston_output	base;
 
 	xcb_window_t		window;
 	struct weston_mode	mode;
 	struct wl_event_source *finish_frame_timer;
+	uint32_t		frame_msec;
 
 	xcb_gc_t		gc;
-	xcb_shm_seg_t		segment;
-	pixman_image_t	       *hw_surface;
-	int			shm_id;
-	void		       *buf;
+	struct x11_shm_buffer	shm[X11_SHM_BUFFERS];
+	int			shm_count;
+	/* The current frame finishes when the server completes an upload */
+	int			frame_pending;
+	/* A repaint found every segment busy and rendered nothing */
+	int			repaint_skipped;
 	uint8_t			depth;
 	int32_t                 scale;
 };
@@ -358,25 +379,28 @@ x11_output_repaint_gl(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
+	wl_event_source_timer_update(output->finish_frame_timer,
+				     output->frame_msec);
 	return 0;
 }
 
-static void
-set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region)
+/* Upload the damaged part of @buffer to the output window without
+ * waiting for the server.  The last request asks for a completion event,
+ * which releases the buffer.  Returns the number of requests sent. */
+static int
+x11_output_put_damage(struct x11_output *output, struct x11_shm_buffer *buffer,
+		      pixman_region32_t *damage)
 {
-	struct x11_output *output = (struct x11_output *)output_base;
-	struct weston_compositor *ec = output->base.compositor;
-	struct x11_compositor *c = (struct x11_compositor *)ec;
+	struct weston_output *output_base = &output->base;
+	struct x11_compositor *c =
+		(struct x11_compositor *)output_base->compositor;
 	pixman_region32_t transformed_region;
 	pixman_box32_t *rects;
-	xcb_rectangle_t *output_rects;
-	xcb_void_cookie_t cookie;
 	int nrects, i;
-	xcb_generic_error_t *err;
+	uint16_t width, height;
 
 	pixman_region32_init(&transformed_region);
-	pixman_region32_copy(&transformed_region, region);
+	pixman_region32_copy(&transformed_region, damage);
 	pixman_region32_translate(&transformed_region,
 				  -output_base->x, -output_base->y);
 	weston_transformed_region(output_base->width, output_base->height,
@@ -385,34 +409,31 @@ set_clip_for_output(struct weston_output *output_base, pixman_region32_t *region
 				  &transformed_region, &transformed_region);
 
 	rects = pixman_region32_rectangles(&transformed_region, &nrects);
-	output_rects = calloc(nrects, sizeof(xcb_rectangle_t));
-
-	if (output_rects == NULL) {
-		pixman_region32_fini(&transformed_region);
-		return;
+	if (nrects > X11_SHM_MAX_RECTS) {
+		rects = pixman_region32_extents(&transformed_region);
+		nrects = 1;
 	}
 
-	for (i = 0; i < nrects; i++) {
-		output_rects[i].x = rects[i].x1;
-		output_rects[i].y = rects[i].y1;
-		output_rects[i].width = rects[i].x2 - rects[i].x1;
-		output_rects[i].height = rects[i].y2 - rects[i].y1;
-	}
+	width = pixman_image_get_width(buffer->image);
+	height = pixman_image_get_height(buffer->image);
+
+	for (i = 0; i < nrects; i++)
+		xcb_shm_put_image(c->conn, output->window, output->gc,
+				  width, height,
+				  rects[i].x1, rects[i].y1,
+				  rects[i].x2 - rects[i].x1,
+				  rects[i].y2 - rects[i].y1,
+				  rects[i].x1, rects[i].y1,
+				  output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+				  i == nrects - 1, buffer->segment, 0);
 
 	pixman_region32_fini(&transformed_region);
 
-	cookie = xcb_set_clip_rectangles_checked(c->conn, XCB_CLIP_ORDERING_UNSORTED,
-					output->gc,
-					0, 0, nrects,
-					output_rects);
-	err = xcb_request_check(c->conn, cookie);
-	if (err != NULL) {
-		weston_log("Failed to set clip rects, err: %d\n", err->error_code);
-		free(err);
-	}
-	free(output_rects);
-}
+	if (nrects > 0)
+		xcb_flush(c->conn);
 
+	return nrects;
+}
 
 static int
 x11_output_repaint_shm(struct weston_output *output_base,
@@ -420,34 +441,76 @@ x11_output_repaint_shm(struct weston_output *output_base,
 {
 	struct x11_output *output = (struct x11_output *)output_base;
 	struct weston_compositor *ec = output->base.compositor;
-	struct x11_compositor *c = (struct x11_compositor *)ec;
-	xcb_void_cookie_t cookie;
-	xcb_generic_error_t *err;
+	struct x11_shm_buffer *buffer = NULL;
+	int i;
+
+	for (i = 0; i < output->shm_count; i++) {
+		pixman_region32_union(&output->shm[i].damage,
+				      &output->shm[i].damage, damage);
+		if (!buffer && !output->shm[i].busy)
+			buffer = &output->shm[i];
+	}
 
-	pixman_renderer_output_set_buffer(output_base, output->hw_surface);
-	ec->renderer->repaint_output(output_base, damage);
+	/* Every segment is still being read; keep the damage on the
+	 * primary plane and repaint once the server releases one. */
+	if (buffer == NULL) {
+		output->repaint_skipped = 1;
+		output->frame_pending = 1;
+		return 0;
+	}
+
+	pixman_renderer_output_set_buffer(output_base, buffer->image);
+	ec->renderer->repaint_output(output_base, &buffer->damage);
+
+	pixman_region32_fini(&buffer->damage);
+	pixman_region32_init(&buffer->damage);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
-	set_clip_for_output(output_base, damage);
-	cookie = xcb_shm_put_image_checked(c->conn, output->window, output->gc,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0, output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					0, output->segment, 0);
-	err = xcb_request_check(c->conn, cookie);
-	if (err != NULL) {
-		weston_log("Failed to put shm image, err: %d\n", err->error_code);
-		free(err);
+
+	/* The frame is done when the server has read the upload, which
+	 * paces us to what it can take; the next one renders into the
+	 * other segment.  With nothing to upload there is no completion
+	 * to wait for, so fall back to the refresh period. */
+	if (x11_output_put_damage(output, buffer, damage) > 0) {
+		buffer->busy = 1;
+		output->frame_pending = 1;
+	} else {
+		wl_event_source_timer_update(output->finish_frame_timer,
+					     output->frame_msec);
 	}
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
 	return 0;
 }
 
+static void
+x11_compositor_handle_shm_completion(struct x11_compositor *c,
+				     xcb_shm_completion_event_t *completion)
+{
+	struct x11_output *output;
+	int i;
+
+	wl_list_for_each(output, &c->base.output_list, base.link) {
+		if (output->window != completion->drawable)
+			continue;
+
+		for (i = 0; i < output->shm_count; i++)
+			if (output->shm[i].segment == completion->shmseg)
+				output->shm[i].busy = 0;
+
+		if (!output->frame_pending)
+			return;
+
+		output->frame_pending = 0;
+		if (output->repaint_skipped) {
+			output->repaint_skipped = 0;
+			weston_output_schedule_repaint(&output->base);
+		}
+		x11_output_start_repaint_loop(&output->base);
+		return;
+	}
+}
+
 static int
 finish_frame_handler(void *data)
 {
@@ -459,21 +522,33 @@ finish_frame_handler(void *data)
 }
 
 static void
-x11_output_deinit_shm(struct x11_compositor *c, struct x11_output *output)
+x11_shm_buffer_fini(struct x11_compositor *c, struct x11_shm_buffer *buffer)
 {
 	xcb_void_cookie_t cookie;
 	xcb_generic_error_t *err;
-	xcb_free_gc(c->conn, output->gc);
 
-	pixman_image_unref(output->hw_surface);
-	output->hw_surface = NULL;
-	cookie = xcb_shm_detach_checked(c->conn, output->segment);
+	pixman_region32_fini(&buffer->damage);
+	pixman_image_unref(buffer->image);
+	buffer->image = NULL;
+	cookie = xcb_shm_detach_checked(c->conn, buffer->segment);
 	err = xcb_request_check(c->conn, cookie);
 	if (err) {
 		weston_log("xcb_shm_detach failed, error %d\n", err->error_code);
 		free(err);
 	}
-	shmdt(output->buf);
+	shmdt(buffer->buf);
+}
+
+static void
+x11_output_deinit_shm(struct x11_compositor *c, struct x11_output *output)
+{
+	int i;
+
+	xcb_free_gc(c->conn, output->gc);
+
+	for (i = 0; i < output->shm_count; i++)
+		x11_shm_buffer_fini(c, &output->shm[i]);
+	output->shm_count = 0;
 }
 
 static void
@@ -648,6 +723,51 @@ get_depth_of_visual(xcb_screen_t *screen,
 	return 0;
 }
 
+static int
+x11_shm_buffer_init(struct x11_compositor *c, struct x11_output *output,
+		    struct x11_shm_buffer *buffer, int width, int height,
+		    int bitsperpixel, pixman_format_code_t pixman_format)
+{
+	xcb_void_cookie_t cookie;
+	xcb_generic_error_t *err;
+
+	/* Create SHM segment and attach it */
+	buffer->shm_id = shmget(IPC_PRIVATE, width * height * (bitsperpixel / 8), IPC_CREAT | S_IRWXU);
+	if (buffer->shm_id == -1) {
+		weston_log("x11shm: failed to allocate SHM segment\n");
+		return -1;
+	}
+	buffer->buf = shmat(buffer->shm_id, NULL, 0 /* read/write */);
+	if (-1 == (long)buffer->buf) {
+		weston_log("x11shm: failed to attach SHM segment\n");
+		shmctl(buffer->shm_id, IPC_RMID, NULL);
+		return -1;
+	}
+	buffer->segment = xcb_generate_id(c->conn);
+	cookie = xcb_shm_attach_checked(c->conn, buffer->segment, buffer->shm_id, 1);
+	err = xcb_request_check(c->conn, cookie);
+	if (err) {
+		weston_log("x11shm: xcb_shm_attach error %d\n", err->error_code);
+		free(err);
+		shmctl(buffer->shm_id, IPC_RMID, NULL);
+		shmdt(buffer->buf);
+		return -1;
+	}
+
+	shmctl(buffer->shm_id, IPC_RMID, NULL);
+
+	/* Now create pixman image */
+	buffer->image = pixman_image_create_bits(pixman_format, width, height, buffer->buf,
+		width * (bitsperpixel / 8));
+
+	/* A fresh buffer has never been rendered into */
+	pixman_region32_init(&buffer->damage);
+	pixman_region32_copy(&buffer->damage, &output->base.region);
+	buffer->busy = 0;
+
+	return 0;
+}
+
 static int
 x11_output_init_shm(struct x11_compositor *c, struct x11_output *output,
 	int width, int height)
@@ -655,10 +775,9 @@ x11_output_init_shm(struct x11_compositor *c, struct x11_output *output,
 	xcb_screen_iterator_t iter;
 	xcb_visualtype_t *visual_type;
 	xcb_format_iterator_t fmt;
-	xcb_void_cookie_t cookie;
-	xcb_generic_error_t *err;
 	const xcb_query_extension_reply_t *ext;
 	int bitsperpixel = 0;
+	int i;
 	pixman_format_code_t pixman_format;
 
 	/* Check if SHM is available */
@@ -669,6 +788,7 @@ x11_output_init_shm(struct x11_compositor *c, struct x11_output *output,
 		errno = ENOENT;
 		return -1;
 	}
+	c->shm_event_base = ext->first_event;
 
 	iter = xcb_setup_roots_iterator(xcb_get_setup(c->conn));
 	visual_type = find_visual_by_id(iter.data, iter.data->root_visual);
@@ -715,31 +835,16 @@ x11_output_init_shm(struct x11_compositor *c, struct x11_output *output,
 	}
 
 
-	/* Create SHM segment and attach it */
-	output->shm_id = shmget(IPC_PRIVATE, width * height * (bitsperpixel / 8), IPC_CREAT | S_IRWXU);
-	if (output->shm_id == -1) {
-		weston_log("x11shm: failed to allocate SHM segment\n");
-		return -1;
-	}
-	output->buf = shmat(output->shm_id, NULL, 0 /* read/write */);
-	if (-1 == (long)output->buf) {
-		weston_log("x11shm: failed to attach SHM segment\n");
-		return -1;
-	}
-	output->segment = xcb_generate_id(c->conn);
-	cookie = xcb_shm_attach_checked(c->conn, output->segment, output->shm_id, 1);
-	err = xcb_request_check(c->conn, cookie);
-	if (err) {
-		weston_log("x11shm: xcb_shm_attach error %d\n", err->error_code);
-		free(err);
-		return -1;
+	for (i = 0; i < X11_SHM_BUFFERS; i++) {
+		if (x11_shm_buffer_init(c, output, &output->shm[i],
+					width, height, bitsperpixel,
+					pixman_format) < 0)
+			break;
+		output->shm_count++;
 	}
 
-	shmctl(output->shm_id, IPC_RMID, NULL);
-
-	/* Now create pixman image */
-	output->hw_surface = pixman_image_create_bits(pixman_format, width, height, output->buf,
-		width * (bitsperpixel / 8));
+	if (output->shm_count == 0)
+		return -1;
 
 	output->gc = xcb_generate_id(c->conn);
 	xcb_create_gc(c->conn, output->gc, output->window, 0, NULL);
@@ -800,6 +905,7 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 	output->mode.width = output_width;
 	output->mode.height = output_height;
 	output->mode.refresh = 60000;
+	output->frame_msec = 1000000 / output->mode.refresh;
 	output->scale = scale;
 	wl_list_init(&output->base.mode_list);
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
@@ -1310,6 +1416,11 @@ x11_compositor_handle_event(int fd, uint32_t mask, void *data)
 		}
 #endif
 
+		if (c->use_pixman &&
+		    response_type == c->shm_event_base + XCB_SHM_COMPLETION)
+			x11_compositor_handle_shm_completion(c,
+				(xcb_shm_completion_event_t *) event);
+
 		count++;
 		if (prev != event)
 			free (event);
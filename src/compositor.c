@@ -969,11 +969,11 @@ view_compute_bbox(struct weston_view *view, int32_t sx, int32_t sy,
 {
 	float min_x = HUGE_VALF,  min_y = HUGE_VALF;
 	float max_x = -HUGE_VALF, max_y = -HUGE_VALF;
-	int32_t s[4][2] = {
-		{ sx,         sy },
-		{ sx,         sy + height },
-		{ sx + width, sy },
-		{ sx + width, sy + height }
+	struct weston_vector v[4] = {
+		{ { sx,         sy,          0.0f, 1.0f } },
+		{ { sx,         sy + height, 0.0f, 1.0f } },
+		{ { sx + width, sy,          0.0f, 1.0f } },
+		{ { sx + width, sy + height, 0.0f, 1.0f } }
 	};
 	float int_x, int_y;
 	int i;
@@ -984,9 +984,24 @@ view_compute_bbox(struct weston_view *view, int32_t sx, int32_t sy,
 		return;
 	}
 
+	/* Only called for transformed views, so all four corners go
+	 * through the matrix at once. */
+	weston_matrix_transform_points(&view->transform.matrix, v, 4);
+
 	for (i = 0; i < 4; ++i) {
 		float x, y;
-		weston_view_to_global_float(view, s[i][0], s[i][1], &x, &y);
+
+		if (fabsf(v[i].f[3]) < 1e-6) {
+			weston_log("warning: numerical instability in "
+				"%s(), divisor = %g\n", __func__,
+				v[i].f[3]);
+			x = 0;
+			y = 0;
+		} else {
+			x = v[i].f[0] / v[i].f[3];
+			y = v[i].f[1] / v[i].f[3];
+		}
+
 		if (x < min_x)
 			min_x = x;
 		if (x > max_x)
@@ -1003,6 +1018,14 @@ view_compute_bbox(struct weston_view *view, int32_t sx, int32_t sy,
 				  ceilf(max_x) - int_x, ceilf(max_y) - int_y);
 }
 
+static int
+view_has_layer_offset(struct weston_view *view)
+{
+	struct weston_layer *layer = view->layer_link.layer;
+
+	return layer && (layer->offset_x != 0 || layer->offset_y != 0);
+}
+
 static void
 weston_view_update_transform_disable(struct weston_view *view)
 {
@@ -1057,8 +1080,13 @@ weston_view_update_transform_enable(struct weston_view *view)
 	wl_list_for_each(tform, &view->geometry.transformation_list, link)
 		weston_matrix_multiply(matrix, &tform->matrix);
 
+	/* Children pick up the layer offset through their parent. */
 	if (parent)
 		weston_matrix_multiply(matrix, &parent->transform.matrix);
+	else if (view_has_layer_offset(view))
+		weston_matrix_translate(matrix,
+					view->layer_link.layer->offset_x,
+					view->layer_link.layer->offset_y, 0);
 
 	if (weston_matrix_invert(inverse, matrix) < 0) {
 		/* Oops, bad total transformation, not invertible */
@@ -1108,7 +1136,7 @@ weston_view_update_transform(struct weston_view *view)
 	    &view->transform.position.link &&
 	    view->geometry.transformation_list.prev ==
 	    &view->transform.position.link &&
-	    !parent) {
+	    !parent && !view_has_layer_offset(view)) {
 		weston_view_update_transform_disable(view);
 	} else {
 		if (weston_view_update_transform_enable(view) < 0)
@@ -1252,12 +1280,115 @@ weston_surface_damage(struct weston_surface *surface)
 	weston_surface_schedule_repaint(surface);
 }
 
+/* Move an up-to-date transform by (dx, dy) in global coordinates,
+ * without rebuilding it from the view's transformation list.  Children
+ * follow their parent. */
+static void
+weston_view_translate_transform(struct weston_view *view,
+				int32_t dx, int32_t dy)
+{
+	struct weston_matrix *inverse = &view->transform.inverse;
+	struct weston_layer *layer;
+	struct weston_view *child;
+	pixman_region32_t mask;
+	int i;
+
+	weston_view_damage_below(view);
+
+	weston_matrix_translate(&view->transform.matrix, dx, dy, 0);
+
+	/* inverse = inverse * translate(-dx, -dy) */
+	for (i = 0; i < 4; i++)
+		inverse->d[12 + i] -= inverse->d[i] * dx +
+				      inverse->d[4 + i] * dy;
+	inverse->type |= WESTON_MATRIX_TRANSFORM_TRANSLATE;
+
+	pixman_region32_translate(&view->transform.boundingbox, dx, dy);
+	pixman_region32_translate(&view->transform.opaque, dx, dy);
+
+	layer = get_view_layer(view);
+	if (layer) {
+		pixman_region32_init_with_extents(&mask, &layer->mask);
+		pixman_region32_intersect(&view->transform.masked_boundingbox,
+					&view->transform.boundingbox, &mask);
+		pixman_region32_intersect(&view->transform.masked_opaque,
+					&view->transform.opaque, &mask);
+		pixman_region32_fini(&mask);
+	}
+
+	weston_view_damage_below(view);
+
+	weston_view_assign_output(view);
+
+	wl_signal_emit(&view->surface->compositor->transform_signal,
+		       view->surface);
+
+	/* A dirty child gets rebuilt from our new matrix anyway. */
+	wl_list_for_each(child, &view->geometry.child_list,
+			 geometry.parent_link)
+		if (!child->transform.dirty)
+			weston_view_translate_transform(child, dx, dy);
+}
+
+/* Moving a mapped view only translates its finished transform when the
+ * position is the last transformation before the parent's, and the
+ * parent maps the move to whole pixels.  Returns -1 when the transform
+ * has to be rebuilt instead. */
+static int
+weston_view_move_transform(struct weston_view *view, float x, float y)
+{
+	struct weston_view *parent = view->geometry.parent;
+	struct weston_matrix *matrix;
+	float dx, dy, gx, gy;
+
+	if (view->transform.dirty || !get_view_layer(view) ||
+	    view->geometry.transformation_list.prev !=
+	    &view->transform.position.link)
+		return -1;
+
+	/* Same rounding as weston_view_update_transform_disable(). */
+	if (!view->transform.enabled) {
+		x = roundf(x);
+		y = roundf(y);
+	}
+
+	dx = x - view->geometry.x;
+	dy = y - view->geometry.y;
+
+	if (parent) {
+		matrix = &parent->transform.matrix;
+		if (matrix->type & WESTON_MATRIX_TRANSFORM_OTHER)
+			return -1;
+		gx = matrix->d[0] * dx + matrix->d[4] * dy;
+		gy = matrix->d[1] * dx + matrix->d[5] * dy;
+	} else {
+		gx = dx;
+		gy = dy;
+	}
+
+	if (gx != floorf(gx) || gy != floorf(gy))
+		return -1;
+
+	view->geometry.x = x;
+	view->geometry.y = y;
+	view->transform.position.matrix.d[12] = x;
+	view->transform.position.matrix.d[13] = y;
+
+	if (gx != 0 || gy != 0)
+		weston_view_translate_transform(view, gx, gy);
+
+	return 0;
+}
+
 WL_EXPORT void
 weston_view_set_position(struct weston_view *view, float x, float y)
 {
 	if (view->geometry.x == x && view->geometry.y == y)
 		return;
 
+	if (weston_view_move_transform(view, x, y) == 0)
+		return;
+
 	view->geometry.x = x;
 	view->geometry.y = y;
 	weston_view_geometry_dirty(view);
@@ -1894,12 +2025,64 @@ weston_compositor_build_view_list(struct weston_compositor *compositor)
 			surface_free_unused_subsurface_views(view->surface);
 }
 
+static void
+weston_output_run_animations(struct weston_output *output, uint32_t msecs)
+{
+	struct weston_animation *animation, *next;
+
+	output->animation_time = msecs;
+
+	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
+		animation->frame_counter++;
+		animation->frame(animation, output, msecs);
+	}
+}
+
+static uint32_t
+weston_output_frame_period(struct weston_output *output)
+{
+	if (output->current_mode && output->current_mode->refresh > 0)
+		return 1000000 / output->current_mode->refresh;
+
+	return 16;
+}
+
+/* Animations are run after each repaint, but one whose frame changed
+ * nothing visible doesn't schedule another.  While any are left, this
+ * runs them on the output's frame period instead, until one of them
+ * asks for a repaint again. */
+static void
+weston_output_schedule_animations(struct weston_output *output)
+{
+	struct weston_compositor *compositor = output->compositor;
+
+	if (wl_list_empty(&output->animation_list) ||
+	    output->repaint_needed ||
+	    compositor->state == WESTON_COMPOSITOR_SLEEPING ||
+	    compositor->state == WESTON_COMPOSITOR_OFFSCREEN)
+		return;
+
+	wl_event_source_timer_update(output->animation_timer,
+				     weston_output_frame_period(output));
+}
+
+static int
+output_animation_timer_handler(void *data)
+{
+	struct weston_output *output = data;
+
+	weston_output_run_animations(output, output->animation_time +
+				     weston_output_frame_period(output));
+	weston_output_schedule_animations(output);
+
+	return 1;
+}
+
 static int
 weston_output_repaint(struct weston_output *output, uint32_t msecs)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct weston_view *ev;
-	struct weston_animation *animation, *next;
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
@@ -1908,6 +2091,9 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 	if (output->destroying)
 		return 0;
 
+	/* Let coalesced pointer motion land in this frame */
+	weston_compositor_flush_motion(ec);
+
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_view_list(ec);
 
@@ -1954,10 +2140,7 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 		wl_resource_destroy(cb->resource);
 	}
 
-	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
-		animation->frame_counter++;
-		animation->frame(animation, output, msecs);
-	}
+	weston_output_run_animations(output, msecs);
 
 	return r;
 }
@@ -1991,6 +2174,8 @@ weston_output_finish_frame(struct weston_output *output, uint32_t msecs)
 	}
 
 	output->repaint_scheduled = 0;
+	weston_output_schedule_animations(output);
+
 	if (compositor->input_loop_source)
 		return;
 
@@ -2012,13 +2197,25 @@ WL_EXPORT void
 weston_layer_entry_insert(struct weston_layer_entry *list,
 			  struct weston_layer_entry *entry)
 {
+	struct weston_view *view =
+		container_of(entry, struct weston_view, layer_link);
+
 	wl_list_insert(&list->link, &entry->link);
 	entry->layer = list->layer;
+
+	if (view_has_layer_offset(view))
+		weston_view_geometry_dirty(view);
 }
 
 WL_EXPORT void
 weston_layer_entry_remove(struct weston_layer_entry *entry)
 {
+	struct weston_view *view =
+		container_of(entry, struct weston_view, layer_link);
+
+	if (view_has_layer_offset(view))
+		weston_view_geometry_dirty(view);
+
 	wl_list_remove(&entry->link);
 	wl_list_init(&entry->link);
 	entry->layer = NULL;
@@ -2029,6 +2226,8 @@ weston_layer_init(struct weston_layer *layer, struct wl_list *below)
 {
 	wl_list_init(&layer->view_list.link);
 	layer->view_list.layer = layer;
+	layer->offset_x = 0;
+	layer->offset_y = 0;
 	weston_layer_set_mask_infinite(layer);
 	if (below != NULL)
 		wl_list_insert(below, &layer->link);
@@ -2057,6 +2256,42 @@ weston_layer_set_mask_infinite(struct weston_layer *layer)
 				     UINT32_MAX, UINT32_MAX);
 }
 
+/** Translate every view in a layer
+ *
+ * \param layer The layer to move
+ * \param x The horizontal offset in global coordinates
+ * \param y The vertical offset in global coordinates
+ *
+ * The offset is applied after each view's own transformations.  Moving
+ * a layer shifts the already computed transforms of its views instead of
+ * marking them dirty, which keeps sliding a whole layer cheap.
+ */
+WL_EXPORT void
+weston_layer_set_offset(struct weston_layer *layer, int32_t x, int32_t y)
+{
+	struct weston_view *view;
+	int32_t dx = x - layer->offset_x;
+	int32_t dy = y - layer->offset_y;
+
+	if (dx == 0 && dy == 0)
+		return;
+
+	layer->offset_x = x;
+	layer->offset_y = y;
+
+	wl_list_for_each(view, &layer->view_list.link, layer_link.link) {
+		if (view->geometry.parent)
+			continue;
+
+		/* Going back to no offset lets views drop the matrix, and
+		 * untransformed views need it to move. */
+		if ((x == 0 && y == 0) || !view->transform.enabled)
+			weston_view_geometry_dirty(view);
+		else if (!view->transform.dirty)
+			weston_view_translate_transform(view, dx, dy);
+	}
+}
+
 WL_EXPORT void
 weston_output_schedule_repaint(struct weston_output *output)
 {
@@ -3133,6 +3368,35 @@ idle_handler(void *data)
 	return 1;
 }
 
+static int
+motion_timer_handler(void *data)
+{
+	struct weston_compositor *compositor = data;
+
+	weston_compositor_flush_motion(compositor);
+
+	return 1;
+}
+
+static void
+input_latency_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+		      void *data)
+{
+	weston_compositor_log_input_latency(seat->compositor);
+}
+
+static void
+animation_stats_binding(struct weston_seat *seat, uint32_t time,
+			uint32_t key, void *data)
+{
+	struct weston_compositor *compositor = seat->compositor;
+
+	weston_log("view animations: %u frames, %u changed nothing "
+		   "visible and were not repainted\n",
+		   compositor->animation_frames,
+		   compositor->animation_frames_skipped);
+}
+
 WL_EXPORT void
 weston_plane_init(struct weston_plane *plane,
 			struct weston_compositor *ec,
@@ -3258,6 +3522,7 @@ weston_output_destroy(struct weston_output *output)
 	wl_signal_emit(&output->compositor->output_destroyed_signal, output);
 	wl_signal_emit(&output->destroy_signal, output);
 
+	wl_event_source_remove(output->animation_timer);
 	free(output->name);
 	pixman_region32_fini(&output->region);
 	pixman_region32_fini(&output->previous_damage);
@@ -3461,6 +3726,10 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 	wl_list_init(&output->animation_list);
 	wl_list_init(&output->resource_list);
 
+	output->animation_timer =
+		wl_event_loop_add_timer(wl_display_get_event_loop(c->wl_display),
+					output_animation_timer_handler, output);
+
 	output->id = ffs(~output->compositor->output_id_pool) - 1;
 	output->compositor->output_id_pool |= 1 << output->id;
 
@@ -3796,6 +4065,7 @@ weston_compositor_init(struct weston_compositor *ec,
 	struct wl_event_loop *loop;
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
+	int32_t motion_rate;
 
 	ec->config = config;
 	ec->wl_display = display;
@@ -3835,12 +4105,18 @@ weston_compositor_init(struct weston_compositor *ec,
 	wl_list_init(&ec->layer_list);
 	wl_list_init(&ec->seat_list);
 	wl_list_init(&ec->output_list);
-	wl_list_init(&ec->key_binding_list);
-	wl_list_init(&ec->modifier_binding_list);
-	wl_list_init(&ec->button_binding_list);
-	wl_list_init(&ec->touch_binding_list);
-	wl_list_init(&ec->axis_binding_list);
-	wl_list_init(&ec->debug_binding_list);
+	weston_binding_table_init(&ec->key_binding_table);
+	weston_binding_table_init(&ec->modifier_binding_table);
+	weston_binding_table_init(&ec->button_binding_table);
+	weston_binding_table_init(&ec->touch_binding_table);
+	weston_binding_table_init(&ec->axis_binding_table);
+	weston_binding_table_init(&ec->debug_binding_table);
+	wl_list_init(&ec->latency_list);
+
+	weston_compositor_add_debug_binding(ec, KEY_L,
+					    input_latency_binding, NULL);
+	weston_compositor_add_debug_binding(ec, KEY_A,
+					    animation_stats_binding, NULL);
 
 	weston_plane_init(&ec->primary_plane, ec, 0, 0);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
@@ -3865,6 +4141,15 @@ weston_compositor_init(struct weston_compositor *ec,
 	weston_config_section_get_int(s, "repeat-delay",
 				      &ec->kb_repeat_delay, 400);
 
+	s = weston_config_get_section(ec->config, "core", NULL, NULL);
+	weston_config_section_get_bool(s, "coalesce-pointer-motion",
+				       &ec->coalesce_motion, 0);
+	weston_config_section_get_int(s, "pointer-motion-rate",
+				      &motion_rate, 0);
+	if (motion_rate > 0)
+		ec->motion_interval = motion_rate < 1000 ?
+			1000 / motion_rate : 1;
+
 	text_backend_init(ec);
 
 	wl_data_device_manager_init(ec->wl_display);
@@ -3875,6 +4160,9 @@ weston_compositor_init(struct weston_compositor *ec,
 	ec->idle_source = wl_event_loop_add_timer(loop, idle_handler, ec);
 	wl_event_source_timer_update(ec->idle_source, ec->idle_time * 1000);
 
+	ec->motion_timer = wl_event_loop_add_timer(loop, motion_timer_handler,
+						   ec);
+
 	ec->input_loop = wl_event_loop_create();
 
 	weston_layer_init(&ec->fade_layer, &ec->layer_list);
@@ -3891,6 +4179,7 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	struct weston_output *output, *next;
 
 	wl_event_source_remove(ec->idle_source);
+	wl_event_source_remove(ec->motion_timer);
 	if (ec->input_loop_source)
 		wl_event_source_remove(ec->input_loop_source);
 
@@ -3901,11 +4190,12 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	if (ec->renderer)
 		ec->renderer->destroy(ec);
 
-	weston_binding_list_destroy_all(&ec->key_binding_list);
-	weston_binding_list_destroy_all(&ec->button_binding_list);
-	weston_binding_list_destroy_all(&ec->touch_binding_list);
-	weston_binding_list_destroy_all(&ec->axis_binding_list);
-	weston_binding_list_destroy_all(&ec->debug_binding_list);
+	weston_binding_table_release(&ec->key_binding_table);
+	weston_binding_table_release(&ec->modifier_binding_table);
+	weston_binding_table_release(&ec->button_binding_table);
+	weston_binding_table_release(&ec->touch_binding_table);
+	weston_binding_table_release(&ec->axis_binding_table);
+	weston_binding_table_release(&ec->debug_binding_table);
 
 	weston_plane_release(&ec->primary_plane);
 
@@ -4257,6 +4547,8 @@ usage(int error_code)
        "  --rdp4-key=FILE\tThe file containing the key for RDP4 encryption\n"
        "  --rdp-tls-cert=FILE\tThe file containing the certificate for TLS encryption\n"
        "  --rdp-tls-key=FILE\tThe file containing the private key for TLS encryption\n"
+       "  --encoder-threads=N\tNumber of RemoteFX/NSCodec encoder threads,\n"
+       "\t\t\t0 to encode in the repaint loop (default: one per CPU)\n"
        "\n");
 #endif
 
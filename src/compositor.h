@@ -190,6 +190,9 @@ struct weston_output {
 	struct weston_compositor *compositor;
 	struct weston_matrix matrix;
 	struct wl_list animation_list;
+	/* Keeps animations ticking over frames that repaint nothing */
+	struct wl_event_source *animation_timer;
+	uint32_t animation_time;
 	int32_t x, y, width, height;
 	int32_t mm_width, mm_height;
 	pixman_region32_t region;
@@ -337,6 +340,15 @@ struct weston_pointer {
 	wl_fixed_t sx, sy;
 	uint32_t button_count;
 
+	/* Motion not yet delivered to the grab when coalescing */
+	struct {
+		int pending;
+		uint32_t time;
+		wl_fixed_t x, y;
+		struct weston_latency_histogram *latency;
+		uint64_t event_usec;
+	} coalesced_motion;
+
 	struct wl_listener output_destroy_listener;
 };
 
@@ -494,6 +506,21 @@ struct weston_keyboard {
 	struct xkb_keymap *pending_keymap;
 };
 
+#define WESTON_LATENCY_BUCKETS 20
+
+/* Time from the kernel input event to the first client event it caused.
+ * Bucket i counts latencies in [2^i, 2^(i+1)) us; the last one also
+ * takes everything above. */
+struct weston_latency_histogram {
+	struct weston_compositor *compositor;
+	struct wl_list link; /* weston_compositor::latency_list */
+	const char *name;
+	uint32_t buckets[WESTON_LATENCY_BUCKETS];
+	uint64_t count;
+	uint64_t total_usec;
+	uint64_t max_usec;
+};
+
 struct weston_seat {
 	struct wl_list base_resource_list;
 
@@ -527,6 +554,12 @@ struct weston_seat {
 	uint32_t slot_map;
 	struct input_method *input_method;
 	char *seat_name;
+
+	/* Set by the backend while it dispatches a kernel input event:
+	 * where to account the event's latency and its timestamp in
+	 * CLOCK_REALTIME microseconds. */
+	struct weston_latency_histogram *input_latency;
+	uint64_t input_event_usec;
 };
 
 enum {
@@ -546,6 +579,7 @@ struct weston_layer {
 	struct weston_layer_entry view_list;
 	struct wl_list link;
 	pixman_box32_t mask;
+	int32_t offset_x, offset_y;
 };
 
 struct weston_plane {
@@ -569,6 +603,18 @@ struct weston_renderer {
 			       float red, float green,
 			       float blue, float alpha);
 	void (*destroy)(struct weston_compositor *ec);
+
+	/* Optional.  Size in buffer pixels of the content last attached
+	 * to the surface, or 0x0 if there is none to read back. */
+	void (*surface_get_content_size)(struct weston_surface *surface,
+					 int *width, int *height);
+	/* Optional.  Read a rectangle of that content, in buffer pixels,
+	 * top row first and tightly packed.  Returns -1 if the content
+	 * can't be read. */
+	int (*surface_read_pixels)(struct weston_surface *surface,
+				   pixman_format_code_t format, void *pixels,
+				   int32_t x, int32_t y,
+				   int32_t width, int32_t height);
 };
 
 enum weston_capability {
@@ -585,6 +631,17 @@ enum weston_capability {
 	WESTON_CAP_ARBITRARY_MODES		= 0x0008,
 };
 
+/* Bindings hashed on (key, button or axis; modifier mask).  list keeps
+ * them in registration order, and so does each bucket. */
+struct weston_binding_table {
+	struct wl_list list;
+	struct wl_list *buckets;
+	uint32_t bucket_count;
+	uint32_t count;
+	/* Buckets must not be reallocated while a lookup walks them */
+	int dispatching;
+};
+
 struct weston_compositor {
 	struct wl_signal destroy_signal;
 
@@ -624,12 +681,13 @@ struct weston_compositor {
 	struct wl_list layer_list;
 	struct wl_list view_list;
 	struct wl_list plane_list;
-	struct wl_list key_binding_list;
-	struct wl_list modifier_binding_list;
-	struct wl_list button_binding_list;
-	struct wl_list touch_binding_list;
-	struct wl_list axis_binding_list;
-	struct wl_list debug_binding_list;
+	struct weston_binding_table key_binding_table;
+	struct weston_binding_table modifier_binding_table;
+	struct weston_binding_table button_binding_table;
+	struct weston_binding_table touch_binding_table;
+	struct weston_binding_table axis_binding_table;
+	struct weston_binding_table debug_binding_table;
+	struct wl_list latency_list;
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
@@ -642,6 +700,11 @@ struct weston_compositor {
 	struct weston_plane primary_plane;
 	uint32_t capabilities; /* combination of enum weston_capability */
 
+	/* View animation frames run, and those that changed nothing
+	 * visible and so neither dirtied the view nor repainted. */
+	uint32_t animation_frames;
+	uint32_t animation_frames_skipped;
+
 	struct weston_renderer *renderer;
 
 	pixman_format_code_t read_format;
@@ -663,6 +726,13 @@ struct weston_compositor {
 
 	int32_t kb_repeat_rate;
 	int32_t kb_repeat_delay;
+
+	/* Pointer motion coalescing: motion is delivered once per frame,
+	 * or every motion_interval ms when that is set. */
+	int coalesce_motion;
+	int32_t motion_interval;
+	struct wl_event_source *motion_timer;
+	int motion_flush_scheduled;
 };
 
 struct weston_buffer {
@@ -1003,6 +1073,17 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 void
 notify_modifiers(struct weston_seat *seat, uint32_t serial);
 
+void
+weston_compositor_flush_motion(struct weston_compositor *compositor);
+
+void
+weston_latency_histogram_init(struct weston_latency_histogram *histogram,
+			      struct weston_compositor *compositor,
+			      const char *name);
+void
+weston_latency_histogram_release(struct weston_latency_histogram *histogram);
+void
+weston_compositor_log_input_latency(struct weston_compositor *compositor);
 void
 notify_pointer_focus(struct weston_seat *seat, struct weston_output *output,
 		     wl_fixed_t x, wl_fixed_t y);
@@ -1033,6 +1114,9 @@ weston_layer_set_mask(struct weston_layer *layer, int x, int y, int width, int h
 void
 weston_layer_set_mask_infinite(struct weston_layer *layer);
 
+void
+weston_layer_set_offset(struct weston_layer *layer, int32_t x, int32_t y);
+
 void
 weston_plane_init(struct weston_plane *plane,
 			struct weston_compositor *ec,
@@ -1128,7 +1212,10 @@ void
 weston_binding_destroy(struct weston_binding *binding);
 
 void
-weston_binding_list_destroy_all(struct wl_list *list);
+weston_binding_table_init(struct weston_binding_table *table);
+
+void
+weston_binding_table_release(struct weston_binding_table *table);
 
 void
 weston_compositor_run_key_binding(struct weston_compositor *compositor,
@@ -1333,6 +1420,18 @@ typedef void (*weston_screenshooter_done_func_t)(void *data,
 int
 weston_screenshooter_shoot(struct weston_output *output, struct weston_buffer *buffer,
 			   weston_screenshooter_done_func_t done, void *data);
+int
+weston_screenshooter_shoot_region(struct weston_output *output,
+				  struct weston_buffer *buffer,
+				  int32_t x, int32_t y,
+				  int32_t width, int32_t height,
+				  weston_screenshooter_done_func_t done,
+				  void *data);
+int
+weston_screenshooter_shoot_surface(struct weston_surface *surface,
+				   struct weston_buffer *buffer,
+				   weston_screenshooter_done_func_t done,
+				   void *data);
 
 struct clipboard *
 clipboard_create(struct weston_seat *seat);
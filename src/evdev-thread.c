@@ -0,0 +1,424 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Input thread for the evdev backend.
+ *
+ * The thread waits on all evdev fds with epoll and reads raw events as
+ * soon as the kernel has them, so their timestamps are the kernel's and
+ * the kernel buffer never overflows while the compositor is busy.  The
+ * events are handed to the main thread through a single-producer,
+ * single-consumer ring and an eventfd registered on the main event loop,
+ * so they are no longer held back until the end of a repaint.  All
+ * decoding past the raw input_event happens on the main thread.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <mtdev.h>
+
+#include "compositor.h"
+#include "evdev.h"
+
+/* Must be a power of two */
+#define EVDEV_THREAD_RING_SIZE 1024
+#define EVDEV_THREAD_READ_MAX 32
+
+struct evdev_thread_event {
+	struct evdev_device *device;
+	struct input_event event;
+	/* Reading from the device failed, it has been dropped */
+	int died;
+};
+
+struct evdev_thread {
+	struct weston_compositor *compositor;
+	pthread_t thread;
+
+	int epoll_fd;
+	/* Main thread to input thread: quit, sync or ring space available */
+	int wake_fd;
+	/* Input thread to main thread: ring not empty */
+	int event_fd;
+	struct wl_event_source *event_source;
+
+	struct evdev_thread_event ring[EVDEV_THREAD_RING_SIZE];
+	/* head is only written by the input thread, tail only by the main
+	 * thread; both only ever increase. */
+	unsigned int head;
+	unsigned int tail;
+	/* Set by the input thread when it waits for ring space */
+	int full;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int sync_request;
+	unsigned int sync_done;
+	int quit;
+	int exited;
+};
+
+static void
+evdev_thread_wake(int fd)
+{
+	uint64_t one = 1;
+
+	if (write(fd, &one, sizeof one) < 0 && errno != EAGAIN)
+		weston_log("evdev thread: failed to signal: %m\n");
+}
+
+static void
+evdev_thread_clear(int fd)
+{
+	uint64_t count;
+
+	while (read(fd, &count, sizeof count) < 0 && errno == EINTR)
+		;
+}
+
+static unsigned int
+evdev_thread_ring_space(struct evdev_thread *thread)
+{
+	unsigned int tail = __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE);
+
+	return EVDEV_THREAD_RING_SIZE - (thread->head - tail);
+}
+
+static void
+evdev_thread_push(struct evdev_thread *thread, struct evdev_device *device,
+		  struct input_event *ev, int count, int died)
+{
+	struct evdev_thread_event *e;
+	unsigned int head = thread->head;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		e = &thread->ring[head++ & (EVDEV_THREAD_RING_SIZE - 1)];
+		e->device = device;
+		e->event = ev[i];
+		e->died = 0;
+	}
+
+	if (died) {
+		e = &thread->ring[head++ & (EVDEV_THREAD_RING_SIZE - 1)];
+		e->device = device;
+		memset(&e->event, 0, sizeof e->event);
+		e->died = 1;
+	}
+
+	__atomic_store_n(&thread->head, head, __ATOMIC_RELEASE);
+}
+
+static void
+evdev_thread_read(struct evdev_thread *thread, struct evdev_device *device)
+{
+	struct input_event ev[EVDEV_THREAD_READ_MAX];
+	unsigned int space;
+	int len, count;
+
+	space = evdev_thread_ring_space(thread);
+	if (space > EVDEV_THREAD_READ_MAX)
+		space = EVDEV_THREAD_READ_MAX;
+
+	/* Leave the events in the kernel until there is room for them;
+	 * the loop waits for the main thread before polling again. */
+	if (space == 0)
+		return;
+
+	if (device->mtdev)
+		len = mtdev_get(device->mtdev, device->fd, ev, space) *
+			sizeof (struct input_event);
+	else
+		len = read(device->fd, ev, space * sizeof ev[0]);
+
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+
+	if (len < 0 || len % sizeof ev[0] != 0) {
+		if (len < 0) {
+			epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL,
+				  device->fd, NULL);
+			evdev_thread_push(thread, device, NULL, 0, 1);
+			evdev_thread_wake(thread->event_fd);
+		}
+		return;
+	}
+
+	count = len / sizeof ev[0];
+	if (count == 0)
+		return;
+
+	evdev_thread_push(thread, device, ev, count, 0);
+	evdev_thread_wake(thread->event_fd);
+}
+
+static void
+evdev_thread_wait_for_space(struct evdev_thread *thread)
+{
+	struct pollfd pfd;
+
+	__atomic_store_n(&thread->full, 1, __ATOMIC_SEQ_CST);
+
+	/* The main thread may have drained the ring before seeing the
+	 * flag; check again so the wakeup isn't lost. */
+	if (evdev_thread_ring_space(thread) == 0) {
+		pfd.fd = thread->wake_fd;
+		pfd.events = POLLIN;
+		while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+			;
+	}
+
+	evdev_thread_clear(thread->wake_fd);
+}
+
+static void *
+evdev_thread_run(void *data)
+{
+	struct evdev_thread *thread = data;
+	struct epoll_event ep[16];
+	int i, count;
+	sigset_t signals;
+
+	/* Signals are handled on the main loop */
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	for (;;) {
+		if (evdev_thread_ring_space(thread) == 0) {
+			evdev_thread_wait_for_space(thread);
+			count = 0;
+		} else {
+			count = epoll_wait(thread->epoll_fd, ep,
+					   ARRAY_LENGTH(ep), -1);
+			if (count < 0 && errno != EINTR) {
+				weston_log("evdev thread: epoll_wait failed: "
+					   "%m\n");
+				break;
+			}
+		}
+
+		for (i = 0; i < count; i++) {
+			if (ep[i].data.ptr == NULL)
+				evdev_thread_clear(thread->wake_fd);
+			else
+				evdev_thread_read(thread, ep[i].data.ptr);
+		}
+
+		/* Any device removed before this point will not be
+		 * touched again. */
+		pthread_mutex_lock(&thread->mutex);
+		thread->sync_done = thread->sync_request;
+		pthread_cond_broadcast(&thread->cond);
+		if (thread->quit) {
+			pthread_mutex_unlock(&thread->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&thread->mutex);
+	}
+
+	pthread_mutex_lock(&thread->mutex);
+	thread->exited = 1;
+	pthread_cond_broadcast(&thread->cond);
+	pthread_mutex_unlock(&thread->mutex);
+
+	return NULL;
+}
+
+static void
+evdev_thread_dispatch(struct evdev_thread *thread)
+{
+	struct evdev_thread_event e;
+	unsigned int head;
+
+	head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+	while (thread->tail != head) {
+		e = thread->ring[thread->tail & (EVDEV_THREAD_RING_SIZE - 1)];
+		__atomic_store_n(&thread->tail, thread->tail + 1,
+				 __ATOMIC_RELEASE);
+
+		if (e.device == NULL)
+			continue;
+
+		if (e.died) {
+			weston_log("device %s died\n", e.device->devnode);
+			continue;
+		}
+
+		if (thread->compositor->session_active)
+			evdev_device_process_event(e.device, &e.event);
+	}
+
+	if (__atomic_exchange_n(&thread->full, 0, __ATOMIC_SEQ_CST))
+		evdev_thread_wake(thread->wake_fd);
+}
+
+static int
+evdev_thread_handle_event(int fd, uint32_t mask, void *data)
+{
+	struct evdev_thread *thread = data;
+
+	evdev_thread_clear(fd);
+	evdev_thread_dispatch(thread);
+
+	return 1;
+}
+
+struct evdev_thread *
+evdev_thread_create(struct weston_compositor *compositor)
+{
+	struct evdev_thread *thread;
+	struct wl_event_loop *loop;
+	struct epoll_event ep;
+
+	thread = zalloc(sizeof *thread);
+	if (thread == NULL)
+		return NULL;
+
+	thread->compositor = compositor;
+	thread->epoll_fd = -1;
+	thread->wake_fd = -1;
+	thread->event_fd = -1;
+
+	thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (thread->epoll_fd < 0)
+		goto err;
+
+	thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->wake_fd < 0)
+		goto err;
+
+	thread->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->event_fd < 0)
+		goto err;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = NULL;
+	if (epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD,
+		      thread->wake_fd, &ep) < 0)
+		goto err;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	thread->event_source =
+		wl_event_loop_add_fd(loop, thread->event_fd,
+				     WL_EVENT_READABLE,
+				     evdev_thread_handle_event, thread);
+	if (thread->event_source == NULL)
+		goto err;
+
+	pthread_mutex_init(&thread->mutex, NULL);
+	pthread_cond_init(&thread->cond, NULL);
+
+	if (pthread_create(&thread->thread, NULL,
+			   evdev_thread_run, thread) != 0) {
+		pthread_cond_destroy(&thread->cond);
+		pthread_mutex_destroy(&thread->mutex);
+		wl_event_source_remove(thread->event_source);
+		goto err;
+	}
+
+	weston_log("evdev: reading input devices on a separate thread\n");
+
+	return thread;
+
+err:
+	weston_log("evdev: failed to start the input thread: %m\n");
+	if (thread->event_fd >= 0)
+		close(thread->event_fd);
+	if (thread->wake_fd >= 0)
+		close(thread->wake_fd);
+	if (thread->epoll_fd >= 0)
+		close(thread->epoll_fd);
+	free(thread);
+	return NULL;
+}
+
+void
+evdev_thread_destroy(struct evdev_thread *thread)
+{
+	pthread_mutex_lock(&thread->mutex);
+	thread->quit = 1;
+	pthread_mutex_unlock(&thread->mutex);
+	evdev_thread_wake(thread->wake_fd);
+	pthread_join(thread->thread, NULL);
+
+	pthread_cond_destroy(&thread->cond);
+	pthread_mutex_destroy(&thread->mutex);
+	wl_event_source_remove(thread->event_source);
+	close(thread->event_fd);
+	close(thread->wake_fd);
+	close(thread->epoll_fd);
+	free(thread);
+}
+
+int
+evdev_thread_add_device(struct evdev_thread *thread,
+			struct evdev_device *device)
+{
+	struct epoll_event ep;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = device;
+
+	return epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, device->fd, &ep);
+}
+
+/* Stop reading from @device and forget its queued events.  Returns once
+ * the input thread can no longer touch the device, so its fd may be
+ * closed and the device freed afterwards. */
+void
+evdev_thread_remove_device(struct evdev_thread *thread,
+			   struct evdev_device *device)
+{
+	unsigned int request, i, head;
+
+	epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+
+	pthread_mutex_lock(&thread->mutex);
+	request = ++thread->sync_request;
+	evdev_thread_wake(thread->wake_fd);
+	while (!thread->exited && (int) (thread->sync_done - request) < 0)
+		pthread_cond_wait(&thread->cond, &thread->mutex);
+	pthread_mutex_unlock(&thread->mutex);
+
+	/* Published entries are owned by the main thread until the tail
+	 * passes them. */
+	head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+	for (i = thread->tail; i != head; i++) {
+		if (thread->ring[i & (EVDEV_THREAD_RING_SIZE - 1)].device ==
+		    device)
+			thread->ring[i & (EVDEV_THREAD_RING_SIZE - 1)].device =
+				NULL;
+	}
+}
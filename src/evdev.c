@@ -404,21 +404,37 @@ fallback_dispatch_create(void)
 	return dispatch;
 }
 
+void
+evdev_device_process_event(struct evdev_device *device,
+			   struct input_event *e)
+{
+	struct evdev_dispatch *dispatch = device->dispatch;
+	struct weston_seat *seat = device->seat;
+	uint32_t time;
+
+	time = e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
+
+	/* Let the first client event this causes account its latency
+	 * to the device. */
+	seat->input_latency = &device->latency;
+	seat->input_event_usec =
+		(uint64_t) e->time.tv_sec * 1000000 + e->time.tv_usec;
+
+	dispatch->interface->process(dispatch, device, e, time);
+
+	seat->input_latency = NULL;
+}
+
 static void
 evdev_process_events(struct evdev_device *device,
 		     struct input_event *ev, int count)
 {
-	struct evdev_dispatch *dispatch = device->dispatch;
 	struct input_event *e, *end;
-	uint32_t time = 0;
 
 	e = ev;
 	end = e + count;
-	for (e = ev; e < end; e++) {
-		time = e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
-
-		dispatch->interface->process(dispatch, device, e, time);
-	}
+	for (e = ev; e < end; e++)
+		evdev_device_process_event(device, e);
 }
 
 static int
@@ -653,6 +669,7 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	ioctl(device->fd, EVIOCGNAME(sizeof(devname)), devname);
 	devname[sizeof(devname) - 1] = '\0';
 	device->devname = strdup(devname);
+	weston_latency_histogram_init(&device->latency, ec, device->devname);
 
 	if (evdev_configure_device(device) == -1)
 		goto err;
@@ -681,11 +698,45 @@ err:
 	return NULL;
 }
 
+/* Hand reading the device over to the input thread */
+int
+evdev_device_set_thread(struct evdev_device *device,
+			struct evdev_thread *thread)
+{
+	if (evdev_thread_add_device(thread, device) < 0)
+		return -1;
+
+	if (device->source) {
+		wl_event_source_remove(device->source);
+		device->source = NULL;
+	}
+	device->thread = thread;
+
+	return 0;
+}
+
+/* Stop reading from the device; must be called before its fd is closed */
+void
+evdev_device_stop(struct evdev_device *device)
+{
+	if (device->thread) {
+		evdev_thread_remove_device(device->thread, device);
+		device->thread = NULL;
+	}
+
+	if (device->source) {
+		wl_event_source_remove(device->source);
+		device->source = NULL;
+	}
+}
+
 void
 evdev_device_destroy(struct evdev_device *device)
 {
 	struct evdev_dispatch *dispatch;
 
+	evdev_device_stop(device);
+
 	if (device->seat_caps & EVDEV_SEAT_POINTER)
 		weston_seat_release_pointer(device->seat);
 	if (device->seat_caps & EVDEV_SEAT_KEYBOARD)
@@ -697,10 +748,9 @@ evdev_device_destroy(struct evdev_device *device)
 	if (dispatch)
 		dispatch->interface->destroy(dispatch);
 
-	if (device->source)
-		wl_event_source_remove(device->source);
 	if (device->output)
 		wl_list_remove(&device->output_destroy_listener.link);
+	weston_latency_histogram_release(&device->latency);
 	wl_list_remove(&device->link);
 	if (device->mtdev)
 		mtdev_close_delete(device->mtdev);
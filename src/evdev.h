@@ -41,6 +41,8 @@ enum evdev_event_type {
 	EVDEV_RELATIVE_MOTION,
 };
 
+struct evdev_thread;
+
 enum evdev_device_seat_capability {
 	EVDEV_SEAT_POINTER = (1 << 0),
 	EVDEV_SEAT_KEYBOARD = (1 << 1),
@@ -51,6 +53,7 @@ struct evdev_device {
 	struct weston_seat *seat;
 	struct wl_list link;
 	struct wl_event_source *source;
+	struct evdev_thread *thread;
 	struct weston_output *output;
 	struct evdev_dispatch *dispatch;
 	struct wl_listener output_destroy_listener;
@@ -83,6 +86,8 @@ struct evdev_device {
 	enum evdev_event_type pending_event;
 	enum evdev_device_seat_capability seat_caps;
 
+	struct weston_latency_histogram latency;
+
 	int is_mt;
 };
 
@@ -124,6 +129,17 @@ evdev_led_update(struct evdev_device *device, enum weston_led leds);
 struct evdev_device *
 evdev_device_create(struct weston_seat *seat, const char *path, int device_fd);
 
+void
+evdev_device_process_event(struct evdev_device *device,
+			   struct input_event *event);
+
+int
+evdev_device_set_thread(struct evdev_device *device,
+			struct evdev_thread *thread);
+
+void
+evdev_device_stop(struct evdev_device *device);
+
 void
 evdev_device_set_output(struct evdev_device *device,
 			struct weston_output *output);
@@ -134,4 +150,18 @@ void
 evdev_notify_keyboard_focus(struct weston_seat *seat,
 			    struct wl_list *evdev_devices);
 
+struct evdev_thread *
+evdev_thread_create(struct weston_compositor *compositor);
+
+void
+evdev_thread_destroy(struct evdev_thread *thread);
+
+int
+evdev_thread_add_device(struct evdev_thread *thread,
+			struct evdev_device *device);
+
+void
+evdev_thread_remove_device(struct evdev_thread *thread,
+			   struct evdev_device *device);
+
 #endif /* EVDEV_H */
@@ -1212,6 +1212,8 @@ gal2d_renderer_create(struct weston_compositor *ec)
 	gr->base.attach = gal2d_renderer_attach;
 	gr->base.surface_set_color = gal2d_renderer_surface_set_color;
 	gr->base.destroy = gal2d_renderer_destroy;
+	gr->base.surface_get_content_size = NULL;
+	gr->base.surface_read_pixels = NULL;
     
     /* Construct the gcoOS object. */
 	gcmONERROR(gcoOS_Construct(gcvNULL, &gr->gcos));
@@ -50,6 +50,9 @@ struct gl_shader {
 
 #define BUFFER_DAMAGE_COUNT 2
 
+/* damage rectangles clipped against one surface rectangle at a time */
+#define CLIP_RECTS_BATCH 16
+
 enum gl_border_status {
 	BORDER_STATUS_CLEAN = 0,
 	BORDER_TOP_DIRTY = 1 << GL_RENDERER_BORDER_TOP,
@@ -103,6 +106,7 @@ struct gl_surface_state {
 	struct weston_buffer_reference buffer_ref;
 	enum buffer_type buffer_type;
 	int pitch; /* in pixels */
+	int width; /* in pixels */
 	int height; /* in pixels */
 	int y_inverted;
 
@@ -220,81 +224,13 @@ gl_renderer_print_egl_error_state(void)
 		egl_error_string(code), (long)code);
 }
 
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) > (b)) ? (b) : (a))
-
 /*
- * Compute the boundary vertices of the intersection of the global coordinate
- * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
- * 'surf_rect' when transformed from surface coordinates into global coordinates.
- * The vertices are written to 'ex' and 'ey', and the return value is the
- * number of vertices. Vertices are produced in clockwise winding order.
- * Guarantees to produce either zero vertices, or 3-8 vertices with non-zero
- * polygon area.
+ * Emit a triangle fan for the intersection of every global coordinate
+ * aligned rectangle of 'region' with every rectangle of 'surf_region'
+ * transformed into global coordinates.  Each surface rectangle is
+ * transformed once and clipped against the region rectangles in batches.
+ * Returns the number of fans.
  */
-static int
-calculate_edges(struct weston_view *ev, pixman_box32_t *rect,
-		pixman_box32_t *surf_rect, GLfloat *ex, GLfloat *ey)
-{
-
-	struct clip_context ctx;
-	int i, n;
-	GLfloat min_x, max_x, min_y, max_y;
-	struct polygon8 surf = {
-		{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
-		{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
-		4
-	};
-
-	ctx.clip.x1 = rect->x1;
-	ctx.clip.y1 = rect->y1;
-	ctx.clip.x2 = rect->x2;
-	ctx.clip.y2 = rect->y2;
-
-	/* transform surface to screen space: */
-	for (i = 0; i < surf.n; i++)
-		weston_view_to_global_float(ev, surf.x[i], surf.y[i],
-					    &surf.x[i], &surf.y[i]);
-
-	/* find bounding box: */
-	min_x = max_x = surf.x[0];
-	min_y = max_y = surf.y[0];
-
-	for (i = 1; i < surf.n; i++) {
-		min_x = min(min_x, surf.x[i]);
-		max_x = max(max_x, surf.x[i]);
-		min_y = min(min_y, surf.y[i]);
-		max_y = max(max_y, surf.y[i]);
-	}
-
-	/* First, simple bounding box check to discard early transformed
-	 * surface rects that do not intersect with the clip region:
-	 */
-	if ((min_x >= ctx.clip.x2) || (max_x <= ctx.clip.x1) ||
-	    (min_y >= ctx.clip.y2) || (max_y <= ctx.clip.y1))
-		return 0;
-
-	/* Simple case, bounding box edges are parallel to surface edges,
-	 * there will be only four edges.  We just need to clip the surface
-	 * vertices to the clip rect bounds:
-	 */
-	if (!ev->transform.enabled)
-		return clip_simple(&ctx, &surf, ex, ey);
-
-	/* Transformed case: use a general polygon clipping algorithm to
-	 * clip the surface rectangle with each side of 'rect'.
-	 * The algorithm is Sutherland-Hodgman, as explained in
-	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
-	 * but without looking at any of that code.
-	 */
-	n = clip_transformed(&ctx, &surf, ex, ey);
-
-	if (n < 3)
-		return 0;
-
-	return n;
-}
-
 static int
 texture_region(struct weston_view *ev, pixman_region32_t *region,
 		pixman_region32_t *surf_region)
@@ -305,7 +241,7 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 	GLfloat *v, inv_width, inv_height;
 	unsigned int *vtxcnt, nvtx = 0;
 	pixman_box32_t *rects, *surf_rects;
-	int i, j, k, nrects, nsurf;
+	int i, j, k, r, nrects, nsurf;
 
 	rects = pixman_region32_rectangles(region, &nrects);
 	surf_rects = pixman_region32_rectangles(surf_region, &nsurf);
@@ -319,13 +255,35 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 	inv_width = 1.0 / gs->pitch;
         inv_height = 1.0 / gs->height;
 
-	for (i = 0; i < nrects; i++) {
-		pixman_box32_t *rect = &rects[i];
-		for (j = 0; j < nsurf; j++) {
-			pixman_box32_t *surf_rect = &surf_rects[j];
-			GLfloat sx, sy, bx, by;
-			GLfloat ex[8], ey[8];          /* edge points in screen space */
-			int n;
+	for (j = 0; j < nsurf; j++) {
+		pixman_box32_t *surf_rect = &surf_rects[j];
+		struct polygon8 quad = {
+			{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
+			{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
+			4
+		};
+
+		/* transform surface to screen space: */
+		for (k = 0; k < quad.n; k++)
+			weston_view_to_global_float(ev, quad.x[k], quad.y[k],
+						    &quad.x[k], &quad.y[k]);
+
+		for (i = 0; i < nrects; i += CLIP_RECTS_BATCH) {
+			struct clip_rect clip[CLIP_RECTS_BATCH];
+			/* edge points in screen space */
+			GLfloat ex[CLIP_RECTS_BATCH * 8], ey[CLIP_RECTS_BATCH * 8];
+			int n[CLIP_RECTS_BATCH];
+			int batch = nrects - i;
+
+			if (batch > CLIP_RECTS_BATCH)
+				batch = CLIP_RECTS_BATCH;
+
+			for (r = 0; r < batch; r++) {
+				clip[r].x1 = rects[i + r].x1;
+				clip[r].y1 = rects[i + r].y1;
+				clip[r].x2 = rects[i + r].x2;
+				clip[r].y2 = rects[i + r].y2;
+			}
 
 			/* The transformed surface, after clipping to the clip region,
 			 * can have as many as eight sides, emitted as a triangle-fan.
@@ -338,33 +296,39 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 			 * intersection point(s) between the surface and the clip region.
 			 *
 			 * To do this, we first calculate the (up to eight) points that
-			 * form the intersection of the clip rect and the transformed
-			 * surface.
+			 * form the intersection of each clip rect and the transformed
+			 * surface, with Sutherland-Hodgman polygon clipping.
 			 */
-			n = calculate_edges(ev, rect, surf_rect, ex, ey);
-			if (n < 3)
-				continue;
-
-			/* emit edge points: */
-			for (k = 0; k < n; k++) {
-				weston_view_from_global_float(ev, ex[k], ey[k],
-							      &sx, &sy);
-				/* position: */
-				*(v++) = ex[k];
-				*(v++) = ey[k];
-				/* texcoord: */
-				weston_surface_to_buffer_float(ev->surface,
-							       sx, sy,
-							       &bx, &by);
-				*(v++) = bx * inv_width;
-				if (gs->y_inverted) {
-					*(v++) = by * inv_height;
-				} else {
-					*(v++) = (gs->height - by) * inv_height;
+			clip_quad_rects(&quad, ev->transform.enabled,
+					clip, batch, ex, ey, n);
+
+			for (r = 0; r < batch; r++) {
+				if (n[r] < 3)
+					continue;
+
+				/* emit edge points: */
+				for (k = r * 8; k < r * 8 + n[r]; k++) {
+					GLfloat sx, sy, bx, by;
+
+					weston_view_from_global_float(ev, ex[k], ey[k],
+								      &sx, &sy);
+					/* position: */
+					*(v++) = ex[k];
+					*(v++) = ey[k];
+					/* texcoord: */
+					weston_surface_to_buffer_float(ev->surface,
+								       sx, sy,
+								       &bx, &by);
+					*(v++) = bx * inv_width;
+					if (gs->y_inverted) {
+						*(v++) = by * inv_height;
+					} else {
+						*(v++) = (gs->height - by) * inv_height;
+					}
 				}
-			}
 
-			vtxcnt[nvtx++] = n;
+				vtxcnt[nvtx++] = n[r];
+			}
 		}
 	}
 
@@ -1168,6 +1132,8 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer,
 
 		ensure_textures(gs, 1);
 	}
+
+	gs->width = buffer->width;
 }
 
 static void
@@ -1241,6 +1207,7 @@ gl_renderer_attach_egl(struct weston_surface *es, struct weston_buffer *buffer,
 	}
 
 	gs->pitch = buffer->width;
+	gs->width = buffer->width;
 	gs->height = buffer->height;
 	gs->buffer_type = BUFFER_TYPE_EGL;
 	gs->y_inverted = buffer->y_inverted;
@@ -1286,6 +1253,121 @@ gl_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 	}
 }
 
+/* Only single plane RGB textures can be attached to a framebuffer and
+ * read back; shm content is only there once it has been uploaded. */
+static int
+surface_content_readable(struct gl_surface_state *gs)
+{
+	switch (gs->buffer_type) {
+	case BUFFER_TYPE_SHM:
+		return !gs->needs_full_upload;
+	case BUFFER_TYPE_EGL:
+		return gs->target == GL_TEXTURE_2D && gs->num_images == 1;
+	default:
+		return 0;
+	}
+}
+
+static void
+gl_renderer_surface_get_content_size(struct weston_surface *surface,
+				     int *width, int *height)
+{
+	struct gl_surface_state *gs = get_surface_state(surface);
+
+	if (surface_content_readable(gs)) {
+		*width = gs->width;
+		*height = gs->height;
+	} else {
+		*width = 0;
+		*height = 0;
+	}
+}
+
+static int
+gl_renderer_surface_read_pixels(struct weston_surface *surface,
+				pixman_format_code_t format, void *pixels,
+				int32_t x, int32_t y,
+				int32_t width, int32_t height)
+{
+	struct gl_surface_state *gs = get_surface_state(surface);
+	struct weston_output *output;
+	GLenum gl_format, status, error = GL_NO_ERROR;
+	GLuint fbo;
+	uint8_t *row, *tmp;
+	int i, stride = width * 4;
+
+	switch (format) {
+	case PIXMAN_a8r8g8b8:
+		gl_format = GL_BGRA_EXT;
+		break;
+	case PIXMAN_a8b8g8r8:
+		gl_format = GL_RGBA;
+		break;
+	default:
+		return -1;
+	}
+
+	if (!surface_content_readable(gs) ||
+	    x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x + width > gs->width || y + height > gs->height)
+		return -1;
+
+	/* Any output's surface will do to get the context current; the
+	 * framebuffer bound below is what we read from. */
+	if (wl_list_empty(&surface->compositor->output_list))
+		return -1;
+	output = container_of(surface->compositor->output_list.next,
+			      struct weston_output, link);
+	if (use_output(output) < 0)
+		return -1;
+
+	/* Texture rows are bottom up unless the buffer is y-inverted. */
+	if (!gs->y_inverted)
+		y = gs->height - y - height;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			       GL_TEXTURE_2D, gs->textures[0], 0);
+	status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status == GL_FRAMEBUFFER_COMPLETE) {
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(x, y, width, height, gl_format,
+			     GL_UNSIGNED_BYTE, pixels);
+		error = glGetError();
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		weston_log("surface texture can't be read back: 0x%x\n",
+			   status);
+		return -1;
+	}
+
+	if (error != GL_NO_ERROR) {
+		weston_log("surface readback failed: 0x%x\n", error);
+		return -1;
+	}
+
+	if (gs->y_inverted)
+		return 0;
+
+	tmp = malloc(stride);
+	if (tmp == NULL)
+		return -1;
+	row = pixels;
+	for (i = 0; i < height / 2; i++) {
+		memcpy(tmp, row + i * stride, stride);
+		memcpy(row + i * stride, row + (height - 1 - i) * stride,
+		       stride);
+		memcpy(row + (height - 1 - i) * stride, tmp, stride);
+	}
+	free(tmp);
+
+	return 0;
+}
+
 static void
 gl_renderer_surface_set_color(struct weston_surface *surface,
 		 float red, float green, float blue, float alpha)
@@ -1932,6 +2014,9 @@ gl_renderer_create(struct weston_compositor *ec, EGLNativeDisplayType display,
 	gr->base.attach = gl_renderer_attach;
 	gr->base.surface_set_color = gl_renderer_surface_set_color;
 	gr->base.destroy = gl_renderer_destroy;
+	gr->base.surface_get_content_size =
+		gl_renderer_surface_get_content_size;
+	gr->base.surface_read_pixels = gl_renderer_surface_read_pixels;
 
 	gr->egl_display = eglGetDisplay(display);
 	if (gr->egl_display == EGL_NO_DISPLAY) {
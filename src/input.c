@@ -26,6 +26,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -143,6 +144,117 @@ move_resources_for_client(struct wl_list *destination,
 	}
 }
 
+WL_EXPORT void
+weston_latency_histogram_init(struct weston_latency_histogram *histogram,
+			      struct weston_compositor *compositor,
+			      const char *name)
+{
+	memset(histogram, 0, sizeof *histogram);
+	histogram->compositor = compositor;
+	histogram->name = name;
+	wl_list_insert(compositor->latency_list.prev, &histogram->link);
+}
+
+WL_EXPORT void
+weston_latency_histogram_release(struct weston_latency_histogram *histogram)
+{
+	struct weston_seat *seat;
+
+	wl_list_for_each(seat, &histogram->compositor->seat_list, link) {
+		if (seat->input_latency == histogram)
+			seat->input_latency = NULL;
+		if (seat->pointer &&
+		    seat->pointer->coalesced_motion.latency == histogram)
+			seat->pointer->coalesced_motion.latency = NULL;
+	}
+
+	wl_list_remove(&histogram->link);
+}
+
+static void
+weston_latency_histogram_add(struct weston_latency_histogram *histogram,
+			     uint64_t usec)
+{
+	uint32_t i = 0;
+
+	while (i < WESTON_LATENCY_BUCKETS - 1 && usec >> (i + 1))
+		i++;
+
+	histogram->buckets[i]++;
+	histogram->count++;
+	histogram->total_usec += usec;
+	if (usec > histogram->max_usec)
+		histogram->max_usec = usec;
+}
+
+/** Log the input latency histograms and start new ones
+ *
+ * Each histogram covers the events since the previous call.
+ */
+WL_EXPORT void
+weston_compositor_log_input_latency(struct weston_compositor *compositor)
+{
+	struct weston_latency_histogram *h;
+	uint32_t i;
+
+	if (wl_list_empty(&compositor->latency_list)) {
+		weston_log("no input latency data from this backend\n");
+		return;
+	}
+
+	wl_list_for_each(h, &compositor->latency_list, link) {
+		if (h->count == 0) {
+			weston_log("input latency, %s: no events\n", h->name);
+			continue;
+		}
+
+		weston_log("input latency, %s: %.0f events, "
+			   "mean %.3f ms, max %.3f ms\n", h->name,
+			   (double) h->count,
+			   h->total_usec / 1000.0 / h->count,
+			   h->max_usec / 1000.0);
+
+		for (i = 0; i < WESTON_LATENCY_BUCKETS; i++) {
+			if (h->buckets[i] == 0)
+				continue;
+			if (i == WESTON_LATENCY_BUCKETS - 1)
+				weston_log_continue(STAMP_SPACE
+						    ">= %7u us: %u\n",
+						    1u << i, h->buckets[i]);
+			else
+				weston_log_continue(STAMP_SPACE
+						    " < %7u us: %u\n",
+						    2u << i, h->buckets[i]);
+		}
+
+		memset(h->buckets, 0, sizeof h->buckets);
+		h->count = 0;
+		h->total_usec = 0;
+		h->max_usec = 0;
+	}
+}
+
+/* A client was just sent an event for the kernel event being dispatched;
+ * account its latency, once per kernel event. */
+static void
+weston_seat_record_input_latency(struct weston_seat *seat)
+{
+	struct timeval tv;
+	uint64_t now;
+
+	if (seat->input_latency == NULL)
+		return;
+
+	gettimeofday(&tv, NULL);
+	now = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+	/* The kernel stamps events with CLOCK_REALTIME, which can step. */
+	weston_latency_histogram_add(seat->input_latency,
+				     now > seat->input_event_usec ?
+				     now - seat->input_event_usec : 0);
+	seat->input_latency = NULL;
+}
+
 static void
 default_grab_pointer_focus(struct weston_pointer_grab *grab)
 {
@@ -180,6 +292,9 @@ default_grab_pointer_motion(struct weston_pointer_grab *grab, uint32_t time,
 		wl_pointer_send_motion(resource, time,
 				       pointer->sx, pointer->sy);
 	}
+
+	if (!wl_list_empty(resource_list))
+		weston_seat_record_input_latency(pointer->seat);
 }
 
 static void
@@ -205,6 +320,7 @@ default_grab_pointer_button(struct weston_pointer_grab *grab,
 					       time,
 					       button,
 					       state_w);
+		weston_seat_record_input_latency(pointer->seat);
 	}
 
 	if (pointer->button_count == 0 &&
@@ -248,6 +364,7 @@ default_grab_touch_down(struct weston_touch_grab *grab, uint32_t time,
 				wl_touch_send_down(resource, serial, time,
 						   touch->focus->surface->resource,
 						   touch_id, sx, sy);
+		weston_seat_record_input_latency(touch->seat);
 	}
 }
 
@@ -267,6 +384,7 @@ default_grab_touch_up(struct weston_touch_grab *grab,
 		serial = wl_display_next_serial(display);
 		wl_resource_for_each(resource, resource_list)
 			wl_touch_send_up(resource, serial, time, touch_id);
+		weston_seat_record_input_latency(touch->seat);
 	}
 }
 
@@ -284,6 +402,9 @@ default_grab_touch_motion(struct weston_touch_grab *grab, uint32_t time,
 		wl_touch_send_motion(resource, time,
 				     touch_id, sx, sy);
 	}
+
+	if (!wl_list_empty(resource_list))
+		weston_seat_record_input_latency(touch->seat);
 }
 
 static void
@@ -327,6 +448,7 @@ default_grab_keyboard_key(struct weston_keyboard_grab *grab,
 					     time,
 					     key,
 					     state);
+		weston_seat_record_input_latency(keyboard->seat);
 	}
 }
 
@@ -935,6 +1057,90 @@ weston_pointer_handle_output_destroy(struct wl_listener *listener, void *data)
 	weston_pointer_move(pointer, fx, fy);
 }
 
+static void
+weston_pointer_flush_motion(struct weston_pointer *pointer)
+{
+	struct weston_seat *seat;
+	struct weston_latency_histogram *latency;
+	uint64_t event_usec;
+
+	if (!pointer || !pointer->coalesced_motion.pending)
+		return;
+
+	/* Account the motion to the kernel event it last came from, not
+	 * to whatever is being dispatched now. */
+	seat = pointer->seat;
+	latency = seat->input_latency;
+	event_usec = seat->input_event_usec;
+	seat->input_latency = pointer->coalesced_motion.latency;
+	seat->input_event_usec = pointer->coalesced_motion.event_usec;
+
+	pointer->coalesced_motion.pending = 0;
+	pointer->grab->interface->motion(pointer->grab,
+					 pointer->coalesced_motion.time,
+					 pointer->coalesced_motion.x,
+					 pointer->coalesced_motion.y);
+
+	seat->input_latency = latency;
+	seat->input_event_usec = event_usec;
+}
+
+/** Deliver the coalesced pointer motion of every seat
+ *
+ * Called before each repaint, from the motion timer, and before any
+ * other pointer or keyboard event so they keep their order relative to
+ * motion.
+ */
+WL_EXPORT void
+weston_compositor_flush_motion(struct weston_compositor *compositor)
+{
+	struct weston_seat *seat;
+
+	if (!compositor->motion_flush_scheduled)
+		return;
+
+	compositor->motion_flush_scheduled = 0;
+	wl_list_for_each(seat, &compositor->seat_list, link)
+		weston_pointer_flush_motion(seat->pointer);
+}
+
+static void
+weston_pointer_coalesce_motion(struct weston_pointer *pointer,
+			       uint32_t time, wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_compositor *ec = pointer->seat->compositor;
+
+	/* Clamp every sample so the accumulated position behaves like the
+	 * individual moves would have at the edges of the outputs. */
+	weston_pointer_clamp(pointer, &x, &y);
+
+	pointer->coalesced_motion.pending = 1;
+	pointer->coalesced_motion.time = time;
+	pointer->coalesced_motion.x = x;
+	pointer->coalesced_motion.y = y;
+	pointer->coalesced_motion.latency = pointer->seat->input_latency;
+	pointer->coalesced_motion.event_usec = pointer->seat->input_event_usec;
+
+	if (ec->motion_flush_scheduled)
+		return;
+
+	ec->motion_flush_scheduled = 1;
+
+	/* Nothing will repaint; don't hold the motion back. */
+	if (ec->state == WESTON_COMPOSITOR_SLEEPING ||
+	    ec->state == WESTON_COMPOSITOR_OFFSCREEN ||
+	    wl_list_empty(&ec->output_list)) {
+		weston_compositor_flush_motion(ec);
+		return;
+	}
+
+	if (ec->motion_interval > 0)
+		wl_event_source_timer_update(ec->motion_timer,
+					     ec->motion_interval);
+	else
+		weston_compositor_schedule_repaint(ec);
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
@@ -943,6 +1149,19 @@ notify_motion(struct weston_seat *seat,
 	struct weston_pointer *pointer = seat->pointer;
 
 	weston_compositor_wake(ec);
+
+	if (ec->coalesce_motion) {
+		if (pointer->coalesced_motion.pending)
+			weston_pointer_coalesce_motion(pointer, time,
+				pointer->coalesced_motion.x + dx,
+				pointer->coalesced_motion.y + dy);
+		else
+			weston_pointer_coalesce_motion(pointer, time,
+						       pointer->x + dx,
+						       pointer->y + dy);
+		return;
+	}
+
 	pointer->grab->interface->motion(pointer->grab, time, pointer->x + dx, pointer->y + dy);
 }
 
@@ -990,6 +1209,12 @@ notify_motion_absolute(struct weston_seat *seat,
 	struct weston_pointer *pointer = seat->pointer;
 
 	weston_compositor_wake(ec);
+
+	if (ec->coalesce_motion) {
+		weston_pointer_coalesce_motion(pointer, time, x, y);
+		return;
+	}
+
 	pointer->grab->interface->motion(pointer->grab, time, x, y);
 }
 
@@ -1014,6 +1239,8 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
 
+	weston_compositor_flush_motion(compositor);
+
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 		if (pointer->button_count == 0) {
@@ -1048,6 +1275,7 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 	struct wl_list *resource_list;
 
 	weston_compositor_wake(compositor);
+	weston_compositor_flush_motion(compositor);
 
 	if (!value)
 		return;
@@ -1317,6 +1545,8 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	struct weston_keyboard_grab *grab = keyboard->grab;
 	uint32_t *k, *end;
 
+	weston_compositor_flush_motion(compositor);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 		keyboard->grab_key = key;
@@ -1365,6 +1595,8 @@ WL_EXPORT void
 notify_pointer_focus(struct weston_seat *seat, struct weston_output *output,
 		     wl_fixed_t x, wl_fixed_t y)
 {
+	weston_compositor_flush_motion(seat->compositor);
+
 	if (output) {
 		weston_pointer_move(seat->pointer, x, y);
 	} else {
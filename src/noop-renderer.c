@@ -112,6 +112,8 @@ noop_renderer_init(struct weston_compositor *ec)
 	renderer->attach = noop_renderer_attach;
 	renderer->surface_set_color = noop_renderer_surface_set_color;
 	renderer->destroy = noop_renderer_destroy;
+	renderer->surface_get_content_size = NULL;
+	renderer->surface_read_pixels = NULL;
 	ec->renderer = renderer;
 
 	return 0;
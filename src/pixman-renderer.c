@@ -496,6 +496,63 @@ pixman_renderer_flush_damage(struct weston_surface *surface)
 	/* No-op for pixman renderer */
 }
 
+static void
+pixman_renderer_surface_get_content_size(struct weston_surface *surface,
+					 int *width, int *height)
+{
+	struct pixman_surface_state *ps = get_surface_state(surface);
+
+	if (ps->image && ps->buffer_ref.buffer) {
+		*width = pixman_image_get_width(ps->image);
+		*height = pixman_image_get_height(ps->image);
+	} else {
+		*width = 0;
+		*height = 0;
+	}
+}
+
+static int
+pixman_renderer_surface_read_pixels(struct weston_surface *surface,
+				    pixman_format_code_t format, void *pixels,
+				    int32_t x, int32_t y,
+				    int32_t width, int32_t height)
+{
+	struct pixman_surface_state *ps = get_surface_state(surface);
+	pixman_image_t *out;
+
+	if (!ps->image || !ps->buffer_ref.buffer)
+		return -1;
+
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x + width > pixman_image_get_width(ps->image) ||
+	    y + height > pixman_image_get_height(ps->image))
+		return -1;
+
+	out = pixman_image_create_bits(format, width, height,
+				       pixels, width * 4);
+	if (!out)
+		return -1;
+
+	/* draw_view() sets the view transform again before every use. */
+	pixman_image_set_transform(ps->image, NULL);
+	pixman_image_set_filter(ps->image, PIXMAN_FILTER_NEAREST, NULL, 0);
+
+	wl_shm_buffer_begin_access(ps->buffer_ref.buffer->shm_buffer);
+	pixman_image_composite32(PIXMAN_OP_SRC,
+				 ps->image, /* src */
+				 NULL, /* mask */
+				 out, /* dest */
+				 x, y, /* src_x, src_y */
+				 0, 0, /* mask_x, mask_y */
+				 0, 0, /* dest_x, dest_y */
+				 width, height);
+	wl_shm_buffer_end_access(ps->buffer_ref.buffer->shm_buffer);
+
+	pixman_image_unref(out);
+
+	return 0;
+}
+
 static void
 buffer_state_handle_buffer_destroy(struct wl_listener *listener, void *data)
 {
@@ -713,6 +770,10 @@ pixman_renderer_init(struct weston_compositor *ec)
 	renderer->base.attach = pixman_renderer_attach;
 	renderer->base.surface_set_color = pixman_renderer_surface_set_color;
 	renderer->base.destroy = pixman_renderer_destroy;
+	renderer->base.surface_get_content_size =
+		pixman_renderer_surface_get_content_size;
+	renderer->base.surface_read_pixels =
+		pixman_renderer_surface_read_pixels;
 	ec->renderer = &renderer->base;
 	ec->capabilities |= WESTON_CAP_ROTATION_ANY;
 	ec->capabilities |= WESTON_CAP_CAPTURE_YFLIP;
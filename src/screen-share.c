@@ -70,6 +70,16 @@ struct shared_output {
 
 	int cache_dirty;
 	pixman_image_t *cache_image;
+
+	/* Transform currently set on cache_image, recomputed only when
+	 * the output geometry changes or cache_image is recreated. */
+	struct {
+		int valid;
+		int identity;
+		int32_t width, height, scale;
+		uint32_t transform;
+	} cache_transform;
+
 	uint32_t *tmp_data;
 	size_t tmp_data_size;
 };
@@ -594,13 +604,49 @@ static const struct wl_callback_listener shared_output_frame_listener = {
 	shared_output_frame_callback
 };
 
+static void
+shared_output_update_transform(struct shared_output *so)
+{
+	struct weston_output *output = so->output;
+	pixman_transform_t transform;
+
+	if (so->cache_transform.valid &&
+	    so->cache_transform.width == output->width &&
+	    so->cache_transform.height == output->height &&
+	    so->cache_transform.scale == output->current_scale &&
+	    so->cache_transform.transform == output->transform)
+		return;
+
+	output_compute_transform(output, &transform);
+	pixman_image_set_transform(so->cache_image, &transform);
+
+	if (output->current_scale == 1) {
+		pixman_image_set_filter(so->cache_image,
+					PIXMAN_FILTER_NEAREST, NULL, 0);
+	} else {
+		pixman_image_set_filter(so->cache_image,
+					PIXMAN_FILTER_BILINEAR, NULL, 0);
+	}
+
+	so->cache_transform.valid = 1;
+	so->cache_transform.identity =
+		output->current_scale == 1 &&
+		output->transform == WL_OUTPUT_TRANSFORM_NORMAL;
+	so->cache_transform.width = output->width;
+	so->cache_transform.height = output->height;
+	so->cache_transform.scale = output->current_scale;
+	so->cache_transform.transform = output->transform;
+}
+
 static void
 shared_output_update(struct shared_output *so)
 {
 	struct ss_shm_buffer *sb;
 	pixman_box32_t *r;
 	int i, nrects;
-	pixman_transform_t transform;
+	int32_t x, y, width, height;
+	uint32_t *src_data, *dst_data;
+	int src_stride, dst_stride;
 
 	/* Only update if we need to */
 	if (!so->cache_dirty || so->parent.frame_cb)
@@ -612,36 +658,40 @@ shared_output_update(struct shared_output *so)
 		return;
 	}
 
-	output_compute_transform(so->output, &transform);
-	pixman_image_set_transform(so->cache_image, &transform);
+	shared_output_update_transform(so);
 
-	pixman_image_set_clip_region32(sb->pm_image, &sb->damage);
-
-	if (so->output->current_scale == 1) {
-		pixman_image_set_filter(so->cache_image,
-					PIXMAN_FILTER_NEAREST, NULL, 0);
-	} else {
-		pixman_image_set_filter(so->cache_image,
-					PIXMAN_FILTER_BILINEAR, NULL, 0);
-	}
-
-	pixman_image_composite32(PIXMAN_OP_SRC,
-				 so->cache_image, /* src */
-				 NULL, /* mask */
-				 sb->pm_image, /* dest */
-				 0, 0, /* src_x, src_y */
-				 0, 0, /* mask_x, mask_y */
-				 0, 0, /* dest_x, dest_y */
-				 so->output->width, /* width */
-				 so->output->height /* height */);
-
-	pixman_image_set_transform(sb->pm_image, NULL);
-	pixman_image_set_clip_region32(sb->pm_image, NULL);
+	/* With scale 1 and a normal transform the cache image has the
+	 * same layout as the shm buffer, so the damaged rectangles can be
+	 * copied directly.  Otherwise only the damaged rectangles are
+	 * composited through the cached transform. */
+	src_data = pixman_image_get_data(so->cache_image);
+	src_stride = pixman_image_get_stride(so->cache_image) / 4;
+	dst_data = pixman_image_get_data(sb->pm_image);
+	dst_stride = pixman_image_get_stride(sb->pm_image) / 4;
 
 	r = pixman_region32_rectangles(&sb->damage, &nrects);
-	for (i = 0; i < nrects; ++i)
-		wl_surface_damage(so->parent.surface, r[i].x1, r[i].y1,
-				  r[i].x2 - r[i].x1, r[i].y2 - r[i].y1);
+	for (i = 0; i < nrects; ++i) {
+		x = r[i].x1;
+		y = r[i].y1;
+		width = r[i].x2 - r[i].x1;
+		height = r[i].y2 - r[i].y1;
+
+		wl_surface_damage(so->parent.surface, x, y, width, height);
+
+		if (so->cache_transform.identity &&
+		    pixman_blt(src_data, dst_data, src_stride, dst_stride,
+			       32, 32, x, y, x, y, width, height))
+			continue;
+
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 so->cache_image, /* src */
+					 NULL, /* mask */
+					 sb->pm_image, /* dest */
+					 x, y, /* src_x, src_y */
+					 0, 0, /* mask_x, mask_y */
+					 x, y, /* dest_x, dest_y */
+					 width, height);
+	}
 
 	wl_surface_attach(so->parent.surface, sb->buffer, 0, 0);
 
@@ -786,6 +836,12 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 				  &so->output->previous_damage);
 	pixman_region32_translate(&damage, -so->output->x, -so->output->y);
 
+	/* Nothing changed on this output; keep the parent's contents. */
+	if (so->cache_image && !pixman_region32_not_empty(&damage)) {
+		pixman_region32_fini(&damage);
+		return;
+	}
+
 	/* Apply damage to all buffers */
 	wl_list_for_each(sb, &so->shm.buffers, link)
 		pixman_region32_union(&sb->damage, &sb->damage, &damage);
@@ -814,6 +870,7 @@ shared_output_repainted(struct wl_listener *listener, void *data)
 			shared_output_destroy(so);
 			return;
 		}
+		so->cache_transform.valid = 0;
 
 		pixman_region32_fini(&damage);
 		pixman_region32_init_rect(&damage, 0, 0, width, height);
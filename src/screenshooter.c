@@ -28,7 +28,11 @@
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/uio.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "compositor.h"
 #include "screenshooter-server-protocol.h"
@@ -46,71 +50,108 @@ struct screenshooter {
 struct screenshooter_frame_listener {
 	struct wl_listener listener;
 	struct weston_buffer *buffer;
+	pixman_box32_t rect;
 	weston_screenshooter_done_func_t done;
 	void *data;
 };
 
-static void
-copy_bgra_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+/* Swap R and B of two pixels at a time; the compiler turns the loops
+ * below into wide vector code on both x86 and ARM. */
+static inline uint64_t
+swap_RB_2(uint64_t v)
 {
-	uint8_t *end;
-
-	end = dst + height * stride;
-	while (dst < end) {
-		memcpy(dst, src, stride);
-		dst += stride;
-		src -= stride;
-	}
+	/*                    A R G B A R G B */
+	return (v & 0xff00ff00ff00ff00ULL) |
+		((v >> 16) & 0x000000ff000000ffULL) |
+		((v << 16) & 0x00ff000000ff0000ULL);
 }
 
-static void
-copy_bgra(uint8_t *dst, uint8_t *src, int height, int stride)
+static inline uint32_t
+swap_RB(uint32_t v)
 {
-	/* TODO: optimize this out */
-	memcpy(dst, src, height * stride);
+	return (v & 0xff00ff00) | ((v >> 16) & 0x000000ff) |
+		((v << 16) & 0x00ff0000);
 }
 
 static void
-copy_row_swap_RB(void *vdst, void *vsrc, int bytes)
+row_swap_RB(uint8_t *row, int width)
 {
-	uint32_t *dst = vdst;
-	uint32_t *src = vsrc;
-	uint32_t *end = dst + bytes / 4;
+	uint64_t v;
+	uint32_t w;
+	int i;
+
+	for (i = 0; i + 2 <= width; i += 2) {
+		memcpy(&v, row + i * 4, sizeof v);
+		v = swap_RB_2(v);
+		memcpy(row + i * 4, &v, sizeof v);
+	}
 
-	while (dst < end) {
-		uint32_t v = *src++;
-		/*                    A R G B */
-		uint32_t tmp = v & 0xff00ff00;
-		tmp |= (v >> 16) & 0x000000ff;
-		tmp |= (v << 16) & 0x00ff0000;
-		*dst++ = tmp;
+	if (i < width) {
+		memcpy(&w, row + i * 4, sizeof w);
+		w = swap_RB(w);
+		memcpy(row + i * 4, &w, sizeof w);
 	}
 }
 
+/* Exchange two rows, optionally swapping R and B on the way. */
 static void
-copy_rgba_yflip(uint8_t *dst, uint8_t *src, int height, int stride)
+row_exchange(uint8_t *a, uint8_t *b, int width, int swap)
 {
-	uint8_t *end;
+	uint64_t va, vb;
+	uint32_t wa, wb;
+	int i;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src -= stride;
+	for (i = 0; i + 2 <= width; i += 2) {
+		memcpy(&va, a + i * 4, sizeof va);
+		memcpy(&vb, b + i * 4, sizeof vb);
+		if (swap) {
+			va = swap_RB_2(va);
+			vb = swap_RB_2(vb);
+		}
+		memcpy(a + i * 4, &vb, sizeof vb);
+		memcpy(b + i * 4, &va, sizeof va);
+	}
+
+	if (i < width) {
+		memcpy(&wa, a + i * 4, sizeof wa);
+		memcpy(&wb, b + i * 4, sizeof wb);
+		if (swap) {
+			wa = swap_RB(wa);
+			wb = swap_RB(wb);
+		}
+		memcpy(a + i * 4, &wb, sizeof wb);
+		memcpy(b + i * 4, &wa, sizeof wa);
 	}
 }
 
+/* The renderer reads width x height pixels tightly packed into the start
+ * of the client buffer.  Fix them up in place: flip and/or swap R and B
+ * as required, then spread the rows out to the buffer stride, starting
+ * from the bottom so nothing is overwritten before it has been moved. */
 static void
-copy_rgba(uint8_t *dst, uint8_t *src, int height, int stride)
+fixup_pixels(uint8_t *pixels, int width, int height, int stride,
+	     int yflip, int swap)
 {
-	uint8_t *end;
+	int row = width * 4;
+	int i;
 
-	end = dst + height * stride;
-	while (dst < end) {
-		copy_row_swap_RB(dst, src, stride);
-		dst += stride;
-		src += stride;
+	if (yflip) {
+		for (i = 0; i < height / 2; i++)
+			row_exchange(pixels + i * row,
+				     pixels + (height - 1 - i) * row,
+				     width, swap);
+		if (swap && (height & 1))
+			row_swap_RB(pixels + (height / 2) * row, width);
+	} else if (swap) {
+		for (i = 0; i < height; i++)
+			row_swap_RB(pixels + i * row, width);
 	}
+
+	if (stride == row)
+		return;
+
+	for (i = height - 1; i > 0; i--)
+		memmove(pixels + i * stride, pixels + i * row, row);
 }
 
 static void
@@ -121,62 +162,64 @@ screenshooter_frame_notify(struct wl_listener *listener, void *data)
 			     struct screenshooter_frame_listener, listener);
 	struct weston_output *output = data;
 	struct weston_compositor *compositor = output->compositor;
-	int32_t stride;
-	uint8_t *pixels, *d, *s;
+	struct wl_shm_buffer *shm_buffer = l->buffer->shm_buffer;
+	int32_t width, height, stride, y;
+	int yflip, swap, ret;
+	uint8_t *pixels;
 
 	output->disable_planes--;
 	wl_list_remove(&listener->link);
-	stride = l->buffer->width * (PIXMAN_FORMAT_BPP(compositor->read_format) / 8);
-	pixels = malloc(stride * l->buffer->height);
-
-	if (pixels == NULL) {
-		l->done(l->data, WESTON_SCREENSHOOTER_NO_MEMORY);
-		free(l);
-		return;
-	}
-
-	compositor->renderer->read_pixels(output,
-			     compositor->read_format, pixels,
-			     0, 0, output->current_mode->width,
-			     output->current_mode->height);
-
-	stride = wl_shm_buffer_get_stride(l->buffer->shm_buffer);
-
-	d = wl_shm_buffer_get_data(l->buffer->shm_buffer);
-	s = pixels + stride * (l->buffer->height - 1);
-
-	wl_shm_buffer_begin_access(l->buffer->shm_buffer);
 
 	switch (compositor->read_format) {
 	case PIXMAN_a8r8g8b8:
 	case PIXMAN_x8r8g8b8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_bgra_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_bgra(d, pixels, output->current_mode->height, stride);
+		swap = 0;
 		break;
 	case PIXMAN_x8b8g8r8:
 	case PIXMAN_a8b8g8r8:
-		if (compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP)
-			copy_rgba_yflip(d, s, output->current_mode->height, stride);
-		else
-			copy_rgba(d, pixels, output->current_mode->height, stride);
+		swap = 1;
 		break;
 	default:
-		break;
+		l->done(l->data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		free(l);
+		return;
 	}
 
-	wl_shm_buffer_end_access(l->buffer->shm_buffer);
+	yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
+	width = l->rect.x2 - l->rect.x1;
+	height = l->rect.y2 - l->rect.y1;
+	if (yflip)
+		y = output->current_mode->height - l->rect.y2;
+	else
+		y = l->rect.y1;
+
+	stride = wl_shm_buffer_get_stride(shm_buffer);
+	pixels = wl_shm_buffer_get_data(shm_buffer);
+
+	wl_shm_buffer_begin_access(shm_buffer);
 
-	l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
-	free(pixels);
+	ret = compositor->renderer->read_pixels(output,
+			compositor->read_format, pixels,
+			l->rect.x1, y, width, height);
+	if (ret == 0)
+		fixup_pixels(pixels, width, height, stride, yflip, swap);
+
+	wl_shm_buffer_end_access(shm_buffer);
+
+	if (ret < 0)
+		l->done(l->data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+	else
+		l->done(l->data, WESTON_SCREENSHOOTER_SUCCESS);
 	free(l);
 }
 
 WL_EXPORT int
-weston_screenshooter_shoot(struct weston_output *output,
-			   struct weston_buffer *buffer,
-			   weston_screenshooter_done_func_t done, void *data)
+weston_screenshooter_shoot_region(struct weston_output *output,
+				  struct weston_buffer *buffer,
+				  int32_t x, int32_t y,
+				  int32_t width, int32_t height,
+				  weston_screenshooter_done_func_t done,
+				  void *data)
 {
 	struct screenshooter_frame_listener *l;
 
@@ -189,8 +232,11 @@ weston_screenshooter_shoot(struct weston_output *output,
 	buffer->width = wl_shm_buffer_get_width(buffer->shm_buffer);
 	buffer->height = wl_shm_buffer_get_height(buffer->shm_buffer);
 
-	if (buffer->width < output->current_mode->width ||
-	    buffer->height < output->current_mode->height) {
+	if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+	    x + width > output->current_mode->width ||
+	    y + height > output->current_mode->height ||
+	    buffer->width < width || buffer->height < height ||
+	    wl_shm_buffer_get_stride(buffer->shm_buffer) < width * 4) {
 		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
 		return -1;
 	}
@@ -202,6 +248,10 @@ weston_screenshooter_shoot(struct weston_output *output,
 	}
 
 	l->buffer = buffer;
+	l->rect.x1 = x;
+	l->rect.y1 = y;
+	l->rect.x2 = x + width;
+	l->rect.y2 = y + height;
 	l->done = done;
 	l->data = data;
 	l->listener.notify = screenshooter_frame_notify;
@@ -212,6 +262,99 @@ weston_screenshooter_shoot(struct weston_output *output,
 	return 0;
 }
 
+WL_EXPORT int
+weston_screenshooter_shoot(struct weston_output *output,
+			   struct weston_buffer *buffer,
+			   weston_screenshooter_done_func_t done, void *data)
+{
+	return weston_screenshooter_shoot_region(output, buffer, 0, 0,
+						 output->current_mode->width,
+						 output->current_mode->height,
+						 done, data);
+}
+
+/* Capture the surface's own content, as last attached, independent of
+ * what is stacked above it or where it is shown.  The renderer reads into
+ * a temporary copy first: wl_shm only allows touching one pool at a time
+ * and the renderer's source may itself be a client shm buffer. */
+WL_EXPORT int
+weston_screenshooter_shoot_surface(struct weston_surface *surface,
+				   struct weston_buffer *buffer,
+				   weston_screenshooter_done_func_t done,
+				   void *data)
+{
+	struct weston_compositor *compositor = surface->compositor;
+	struct weston_renderer *renderer = compositor->renderer;
+	struct wl_shm_buffer *shm_buffer;
+	int32_t width, height, stride, i;
+	uint8_t *pixels, *content;
+	int swap;
+
+	shm_buffer = wl_shm_buffer_get(buffer->resource);
+	if (!shm_buffer || !renderer->surface_get_content_size ||
+	    !renderer->surface_read_pixels) {
+		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		return -1;
+	}
+
+	/* Read in whatever the renderer reads natively and swizzle
+	 * into the client's ARGB8888 afterwards, as for outputs. */
+	switch (compositor->read_format) {
+	case PIXMAN_a8r8g8b8:
+	case PIXMAN_x8r8g8b8:
+		swap = 0;
+		break;
+	case PIXMAN_x8b8g8r8:
+	case PIXMAN_a8b8g8r8:
+		swap = 1;
+		break;
+	default:
+		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		return -1;
+	}
+
+	buffer->shm_buffer = shm_buffer;
+	buffer->width = wl_shm_buffer_get_width(shm_buffer);
+	buffer->height = wl_shm_buffer_get_height(shm_buffer);
+	stride = wl_shm_buffer_get_stride(shm_buffer);
+
+	renderer->surface_get_content_size(surface, &width, &height);
+	if (width <= 0 || height <= 0 ||
+	    buffer->width < width || buffer->height < height ||
+	    stride < width * 4) {
+		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		return -1;
+	}
+
+	content = malloc(width * height * 4);
+	if (content == NULL) {
+		done(data, WESTON_SCREENSHOOTER_NO_MEMORY);
+		return -1;
+	}
+
+	if (renderer->surface_read_pixels(surface, compositor->read_format,
+					  content, 0, 0, width, height) < 0) {
+		free(content);
+		done(data, WESTON_SCREENSHOOTER_BAD_BUFFER);
+		return -1;
+	}
+
+	pixels = wl_shm_buffer_get_data(shm_buffer);
+	wl_shm_buffer_begin_access(shm_buffer);
+	for (i = 0; i < height; i++) {
+		memcpy(pixels + i * stride, content + i * width * 4,
+		       width * 4);
+		if (swap)
+			row_swap_RB(pixels + i * stride, width);
+	}
+	wl_shm_buffer_end_access(shm_buffer);
+
+	free(content);
+	done(data, WESTON_SCREENSHOOTER_SUCCESS);
+
+	return 0;
+}
+
 static void
 screenshooter_done(void *data, enum weston_screenshooter_outcome outcome)
 {
@@ -248,8 +391,51 @@ screenshooter_shoot(struct wl_client *client,
 	weston_screenshooter_shoot(output, buffer, screenshooter_done, resource);
 }
 
+static void
+screenshooter_shoot_region(struct wl_client *client,
+			   struct wl_resource *resource,
+			   struct wl_resource *output_resource,
+			   struct wl_resource *buffer_resource,
+			   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct weston_output *output =
+		wl_resource_get_user_data(output_resource);
+	struct weston_buffer *buffer =
+		weston_buffer_from_resource(buffer_resource);
+
+	if (buffer == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	weston_screenshooter_shoot_region(output, buffer, x, y, width, height,
+					  screenshooter_done, resource);
+}
+
+static void
+screenshooter_shoot_surface(struct wl_client *client,
+			    struct wl_resource *resource,
+			    struct wl_resource *surface_resource,
+			    struct wl_resource *buffer_resource)
+{
+	struct weston_surface *surface =
+		wl_resource_get_user_data(surface_resource);
+	struct weston_buffer *buffer =
+		weston_buffer_from_resource(buffer_resource);
+
+	if (buffer == NULL) {
+		wl_resource_post_no_memory(resource);
+		return;
+	}
+
+	weston_screenshooter_shoot_surface(surface, buffer,
+					   screenshooter_done, resource);
+}
+
 struct screenshooter_interface screenshooter_implementation = {
-	screenshooter_shoot
+	screenshooter_shoot,
+	screenshooter_shoot_region,
+	screenshooter_shoot_surface
 };
 
 static void
@@ -260,7 +446,8 @@ bind_shooter(struct wl_client *client,
 	struct wl_resource *resource;
 
 	resource = wl_resource_create(client,
-				      &screenshooter_interface, 1, id);
+				      &screenshooter_interface,
+				      MIN(version, 2), id);
 
 	if (client != shooter->client) {
 		wl_resource_post_error(resource, WL_DISPLAY_ERROR_INVALID_OBJECT,
@@ -304,16 +491,287 @@ screenshooter_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 	free(screenshooter_exe);
 }
 
+enum weston_recorder_sink_type {
+	WESTON_RECORDER_SINK_FILE,
+	WESTON_RECORDER_SINK_PIPE,
+	WESTON_RECORDER_SINK_SOCKET
+};
+
+/* A recorder sink is where the wcap stream goes.  Plain files are
+ * written synchronously, while pipes/FIFOs and UNIX sockets are
+ * non-blocking: a frame is only encoded once the previous one has been
+ * fully consumed, otherwise it is skipped and its damage is carried
+ * over to the next frame so the delta encoding stays consistent. */
+struct weston_recorder_sink {
+	enum weston_recorder_sink_type type;
+	int fd;
+	struct wl_array queue;
+	size_t offset;
+	struct wl_event_source *source;
+	struct sockaddr_un addr;
+	struct wl_event_source *retry;
+	int connecting;
+};
+
 struct weston_recorder {
 	struct weston_output *output;
 	uint32_t *frame, *rect;
-	uint32_t *tmpbuf;
 	uint32_t total;
-	int fd;
+	struct weston_recorder_sink sink;
+	pixman_region32_t skipped_damage;
 	struct wl_listener frame_listener;
-	int count, destroying;
+	int count, skipped, destroying, draining, failed;
 };
 
+static void
+weston_recorder_free(struct weston_recorder *recorder);
+
+static void
+weston_recorder_destroy(struct weston_recorder *recorder);
+
+static ssize_t
+recorder_sink_write(struct weston_recorder_sink *sink,
+		    const void *data, size_t size)
+{
+	sigset_t set, old, pending;
+	struct timespec zero = { 0, 0 };
+	ssize_t len;
+
+	switch (sink->type) {
+	case WESTON_RECORDER_SINK_SOCKET:
+		return send(sink->fd, data, size, MSG_NOSIGNAL);
+	case WESTON_RECORDER_SINK_PIPE:
+		/* A reader going away must not take the compositor down
+		 * with SIGPIPE; swallow the signal and report EPIPE. */
+		sigemptyset(&set);
+		sigaddset(&set, SIGPIPE);
+		sigprocmask(SIG_BLOCK, &set, &old);
+		len = write(sink->fd, data, size);
+		if (len < 0 && errno == EPIPE) {
+			sigpending(&pending);
+			if (sigismember(&pending, SIGPIPE))
+				sigtimedwait(&set, NULL, &zero);
+			errno = EPIPE;
+		}
+		sigprocmask(SIG_SETMASK, &old, NULL);
+		return len;
+	case WESTON_RECORDER_SINK_FILE:
+	default:
+		return write(sink->fd, data, size);
+	}
+}
+
+#define RECORDER_CONNECT_RETRY_MSEC 10
+
+/* Finishes a connect that failed with EAGAIN because the listener's
+ * backlog was full.  Returns 1 once connected, 0 if the backlog is still
+ * full and -1 on error. */
+static int
+recorder_sink_connect(struct weston_recorder_sink *sink)
+{
+	if (connect(sink->fd, (struct sockaddr *) &sink->addr,
+		    sizeof sink->addr) < 0 && errno != EISCONN) {
+		if (errno == EAGAIN || errno == EINTR) {
+			/* An unconnected socket polls writable, so back
+			 * off instead of spinning on it. */
+			wl_event_source_fd_update(sink->source, 0);
+			wl_event_source_timer_update(sink->retry,
+						     RECORDER_CONNECT_RETRY_MSEC);
+			return 0;
+		}
+		weston_log("recorder: connect failed: %m\n");
+		return -1;
+	}
+
+	sink->connecting = 0;
+	wl_event_source_fd_update(sink->source, 0);
+
+	return 1;
+}
+
+static int
+recorder_sink_retry(void *data)
+{
+	struct weston_recorder_sink *sink = data;
+
+	wl_event_source_fd_update(sink->source, WL_EVENT_WRITABLE);
+
+	return 1;
+}
+
+/* Returns 1 once the queue is empty, 0 if the sink would block and -1 on
+ * error. */
+static int
+recorder_sink_flush(struct weston_recorder *recorder)
+{
+	struct weston_recorder_sink *sink = &recorder->sink;
+	ssize_t len;
+
+	/* Keep the queued data until the listener accepts us. */
+	if (sink->connecting)
+		return 0;
+
+	while (sink->offset < sink->queue.size) {
+		len = recorder_sink_write(sink,
+					  (char *) sink->queue.data + sink->offset,
+					  sink->queue.size - sink->offset);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && errno == EAGAIN && sink->source) {
+			wl_event_source_fd_update(sink->source,
+						  WL_EVENT_WRITABLE);
+			return 0;
+		}
+		if (len < 0) {
+			weston_log("recorder: write failed: %m\n");
+			return -1;
+		}
+
+		sink->offset += len;
+		recorder->total += len;
+	}
+
+	sink->queue.size = 0;
+	sink->offset = 0;
+	if (sink->source)
+		wl_event_source_fd_update(sink->source, 0);
+
+	return 1;
+}
+
+static int
+recorder_sink_busy(struct weston_recorder_sink *sink)
+{
+	return sink->queue.size > 0;
+}
+
+static int
+recorder_sink_data(int fd, uint32_t mask, void *data)
+{
+	struct weston_recorder *recorder = data;
+	int ret = -1;
+
+	if (recorder->sink.connecting) {
+		ret = recorder_sink_connect(&recorder->sink);
+		if (ret == 0)
+			return 1;
+		if (ret > 0)
+			ret = recorder_sink_flush(recorder);
+		/* A stream socket polls as hung up until it's connected. */
+		mask &= ~(WL_EVENT_HANGUP | WL_EVENT_ERROR);
+	} else if (mask & WL_EVENT_WRITABLE) {
+		ret = recorder_sink_flush(recorder);
+	}
+
+	if (ret < 0 || (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))) {
+		weston_log("recorder: consumer went away, stopping\n");
+		recorder->failed = 1;
+		if (recorder->draining)
+			weston_recorder_free(recorder);
+		else
+			weston_recorder_destroy(recorder);
+	} else if (ret > 0 && recorder->draining) {
+		weston_recorder_free(recorder);
+	} else if (ret > 0 &&
+		   pixman_region32_not_empty(&recorder->skipped_damage)) {
+		/* Catch up on what was skipped while the consumer lagged. */
+		weston_output_schedule_repaint(recorder->output);
+	}
+
+	return 1;
+}
+
+static int
+recorder_sink_open(struct weston_recorder *recorder, const char *path)
+{
+	struct weston_recorder_sink *sink = &recorder->sink;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(recorder->output->compositor->wl_display);
+	struct sockaddr_un *addr = &sink->addr;
+
+	if (strncmp(path, "pipe:", 5) == 0) {
+		sink->type = WESTON_RECORDER_SINK_PIPE;
+		path += 5;
+		/* Fails with ENXIO if nobody has the FIFO open for reading
+		 * yet, rather than blocking the compositor. */
+		sink->fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	} else if (strncmp(path, "unix:", 5) == 0) {
+		sink->type = WESTON_RECORDER_SINK_SOCKET;
+		path += 5;
+		if (strlen(path) >= sizeof addr->sun_path) {
+			weston_log("recorder: socket path too long: %s\n", path);
+			return -1;
+		}
+		memset(addr, 0, sizeof *addr);
+		addr->sun_family = AF_LOCAL;
+		strcpy(addr->sun_path, path);
+		sink->fd = socket(PF_LOCAL,
+				  SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (sink->fd >= 0 &&
+		    connect(sink->fd, (struct sockaddr *) addr, sizeof *addr) < 0) {
+			/* A full listen backlog makes a non-blocking
+			 * AF_UNIX connect fail with EAGAIN; retry it once
+			 * the socket polls writable. */
+			if (errno == EAGAIN) {
+				sink->connecting = 1;
+			} else if (errno != EINPROGRESS) {
+				close(sink->fd);
+				sink->fd = -1;
+			}
+		}
+	} else {
+		sink->type = WESTON_RECORDER_SINK_FILE;
+		if (strncmp(path, "file:", 5) == 0)
+			path += 5;
+		sink->fd = open(path,
+				O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+
+	if (sink->fd < 0) {
+		weston_log("problem opening recorder output %s: %m\n", path);
+		return -1;
+	}
+
+	if (sink->type != WESTON_RECORDER_SINK_FILE) {
+		sink->source = wl_event_loop_add_fd(loop, sink->fd, 0,
+						    recorder_sink_data,
+						    recorder);
+		if (sink->source == NULL) {
+			close(sink->fd);
+			sink->fd = -1;
+			return -1;
+		}
+	}
+
+	if (sink->connecting) {
+		sink->retry = wl_event_loop_add_timer(loop,
+						      recorder_sink_retry,
+						      sink);
+		if (sink->retry == NULL) {
+			wl_event_source_remove(sink->source);
+			sink->source = NULL;
+			close(sink->fd);
+			sink->fd = -1;
+			return -1;
+		}
+		wl_event_source_fd_update(sink->source, WL_EVENT_WRITABLE);
+	}
+
+	return 0;
+}
+
+static void
+recorder_sink_close(struct weston_recorder_sink *sink)
+{
+	if (sink->retry)
+		wl_event_source_remove(sink->retry);
+	if (sink->source)
+		wl_event_source_remove(sink->source);
+	if (sink->fd >= 0)
+		close(sink->fd);
+	wl_array_release(&sink->queue);
+}
+
 static uint32_t *
 output_run(uint32_t *p, uint32_t delta, int run)
 {
@@ -345,9 +803,6 @@ component_delta(uint32_t next, uint32_t prev)
 	return (dr << 16) | (dg << 8) | (db << 0);
 }
 
-static void
-weston_recorder_destroy(struct weston_recorder *recorder);
-
 static void
 weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 {
@@ -355,30 +810,37 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		container_of(listener, struct weston_recorder, frame_listener);
 	struct weston_output *output = data;
 	struct weston_compositor *compositor = output->compositor;
+	struct weston_recorder_sink *sink = &recorder->sink;
 	uint32_t msecs = output->frame_time;
 	pixman_box32_t *r;
 	pixman_region32_t damage, transformed_damage;
 	int i, j, k, n, width, height, run, stride;
-	uint32_t delta, prev, *d, *s, *p, next;
+	uint32_t delta, prev, *d, *s, *p, *outbuf, next;
 	struct {
 		uint32_t msecs;
 		uint32_t nrects;
-	} header;
-	struct iovec v[2];
+	} *header;
 	int do_yflip;
 	int y_orig;
-	uint32_t *outbuf;
+
+	if (recorder_sink_busy(sink)) {
+		/* The consumer hasn't caught up with the previous frame;
+		 * drop this one and fold its damage into the next. */
+		pixman_region32_union(&recorder->skipped_damage,
+				      &recorder->skipped_damage,
+				      &output->previous_damage);
+		recorder->skipped++;
+		goto out;
+	}
 
 	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-	if (do_yflip)
-		outbuf = recorder->rect;
-	else
-		outbuf = recorder->tmpbuf;
 
 	pixman_region32_init(&damage);
 	pixman_region32_init(&transformed_damage);
-	pixman_region32_intersect(&damage, &output->region,
-				  &output->previous_damage);
+	pixman_region32_union(&damage, &recorder->skipped_damage,
+			      &output->previous_damage);
+	pixman_region32_intersect(&damage, &output->region, &damage);
+	pixman_region32_clear(&recorder->skipped_damage);
 	pixman_region32_translate(&damage, -output->x, -output->y);
 	weston_transformed_region(output->width, output->height,
 				 output->transform, output->current_scale,
@@ -388,16 +850,19 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	r = pixman_region32_rectangles(&transformed_damage, &n);
 	if (n == 0) {
 		pixman_region32_fini(&transformed_damage);
-		return;
+		goto out;
 	}
 
-	header.msecs = msecs;
-	header.nrects = n;
-	v[0].iov_base = &header;
-	v[0].iov_len = sizeof header;
-	v[1].iov_base = r;
-	v[1].iov_len = n * sizeof *r;
-	recorder->total += writev(recorder->fd, v, 2);
+	header = wl_array_add(&sink->queue, sizeof *header + n * sizeof *r);
+	if (header == NULL) {
+		weston_log("%s: out of memory\n", __func__);
+		pixman_region32_fini(&transformed_damage);
+		recorder->failed = 1;
+		goto out;
+	}
+	header->msecs = msecs;
+	header->nrects = n;
+	memcpy(header + 1, r, n * sizeof *r);
 	stride = output->current_mode->width;
 
 	for (i = 0; i < n; i++) {
@@ -413,6 +878,15 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 				compositor->read_format, recorder->rect,
 				r[i].x1, y_orig, width, height);
 
+		/* The RLE output is never longer than the input, so encode
+		 * straight into the sink queue and trim it afterwards. */
+		outbuf = wl_array_add(&sink->queue, width * height * 4);
+		if (outbuf == NULL) {
+			weston_log("%s: out of memory\n", __func__);
+			recorder->failed = 1;
+			break;
+		}
+
 		s = recorder->rect;
 		p = outbuf;
 		run = prev = 0; /* quiet gcc */
@@ -438,9 +912,7 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 		}
 
 		p = output_run(p, prev, run);
-
-		recorder->total += write(recorder->fd,
-					 outbuf, (p - outbuf) * 4);
+		sink->queue.size -= (width * height - (p - outbuf)) * 4;
 
 #if 0
 		fprintf(stderr,
@@ -455,7 +927,11 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	pixman_region32_fini(&transformed_damage);
 	recorder->count++;
 
-	if (recorder->destroying)
+	if (!recorder->failed && recorder_sink_flush(recorder) < 0)
+		recorder->failed = 1;
+
+out:
+	if (recorder->destroying || recorder->failed)
 		weston_recorder_destroy(recorder);
 }
 
@@ -464,24 +940,23 @@ weston_recorder_free(struct weston_recorder *recorder)
 {
 	if (recorder == NULL)
 		return;
+	recorder_sink_close(&recorder->sink);
+	pixman_region32_fini(&recorder->skipped_damage);
 	free(recorder->rect);
-	free(recorder->tmpbuf);
 	free(recorder->frame);
 	free(recorder);
 }
 
 static void
-weston_recorder_create(struct weston_output *output, const char *filename)
+weston_recorder_create(struct weston_output *output, const char *path)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct weston_recorder *recorder;
 	int stride, size;
 	struct { uint32_t magic, format, width, height; } header;
-	int do_yflip;
+	void *p;
 
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-
-	recorder = malloc(sizeof *recorder);
+	recorder = zalloc(sizeof *recorder);
 	if (recorder == NULL) {
 		weston_log("%s: out of memory\n", __func__);
 		return;
@@ -491,10 +966,10 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 	size = stride * 4 * output->current_mode->height;
 	recorder->frame = zalloc(size);
 	recorder->rect = malloc(size);
-	recorder->total = 0;
-	recorder->count = 0;
-	recorder->destroying = 0;
 	recorder->output = output;
+	recorder->sink.fd = -1;
+	wl_array_init(&recorder->sink.queue);
+	pixman_region32_init(&recorder->skipped_damage);
 
 	if ((recorder->frame == NULL) || (recorder->rect == NULL)) {
 		weston_log("%s: out of memory\n", __func__);
@@ -502,11 +977,6 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		return;
 	}
 
-	if (do_yflip)
-		recorder->tmpbuf = NULL;
-	else
-		recorder->tmpbuf = malloc(size);
-
 	header.magic = WCAP_HEADER_MAGIC;
 
 	switch (compositor->read_format) {
@@ -523,18 +993,24 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 		return;
 	}
 
-	recorder->fd = open(filename,
-			    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
-
-	if (recorder->fd < 0) {
-		weston_log("problem opening output file %s: %m\n", filename);
+	if (recorder_sink_open(recorder, path) < 0) {
 		weston_recorder_free(recorder);
 		return;
 	}
 
 	header.width = output->current_mode->width;
 	header.height = output->current_mode->height;
-	recorder->total += write(recorder->fd, &header, sizeof header);
+	p = wl_array_add(&recorder->sink.queue, sizeof header);
+	if (p == NULL) {
+		weston_log("%s: out of memory\n", __func__);
+		weston_recorder_free(recorder);
+		return;
+	}
+	memcpy(p, &header, sizeof header);
+	if (recorder_sink_flush(recorder) < 0) {
+		weston_recorder_free(recorder);
+		return;
+	}
 
 	recorder->frame_listener.notify = weston_recorder_frame_notify;
 	wl_signal_add(&output->frame_signal, &recorder->frame_listener);
@@ -546,8 +1022,16 @@ static void
 weston_recorder_destroy(struct weston_recorder *recorder)
 {
 	wl_list_remove(&recorder->frame_listener.link);
-	close(recorder->fd);
 	recorder->output->disable_planes--;
+
+	/* Let a partially written frame drain so the stream stays
+	 * decodable; the sink frees the recorder once it's done. */
+	if (recorder_sink_busy(&recorder->sink) && recorder->sink.source &&
+	    !recorder->sink.connecting && !recorder->failed) {
+		recorder->draining = 1;
+		return;
+	}
+
 	weston_recorder_free(recorder);
 }
 
@@ -559,7 +1043,8 @@ recorder_binding(struct weston_seat *seat, uint32_t time, uint32_t key, void *da
 	struct weston_output *output;
 	struct wl_listener *listener = NULL;
 	struct weston_recorder *recorder;
-	static const char filename[] = "capture.wcap";
+	struct weston_config_section *section;
+	char *path;
 
 	wl_list_for_each(output, &seat->compositor->output_list, link) {
 		listener = wl_signal_get(&output->frame_signal,
@@ -573,8 +1058,10 @@ recorder_binding(struct weston_seat *seat, uint32_t time, uint32_t key, void *da
 					frame_listener);
 
 		weston_log(
-			"stopping recorder, total file size %dM, %d frames\n",
-			recorder->total / (1024 * 1024), recorder->count);
+			"stopping recorder, total size %dM, %d frames, "
+			"%d skipped\n",
+			recorder->total / (1024 * 1024), recorder->count,
+			recorder->skipped);
 
 		recorder->destroying = 1;
 		weston_output_schedule_repaint(recorder->output);
@@ -586,9 +1073,15 @@ recorder_binding(struct weston_seat *seat, uint32_t time, uint32_t key, void *da
 			output = container_of(ec->output_list.next,
 					      struct weston_output, link);
 
-		weston_log("starting recorder for output %s, file %s\n",
-			   output->name, filename);
-		weston_recorder_create(output, filename);
+		section = weston_config_get_section(ec->config,
+						    "recorder", NULL, NULL);
+		weston_config_section_get_string(section, "path", &path,
+						 "capture.wcap");
+
+		weston_log("starting recorder for output %s, sink %s\n",
+			   output->name, path);
+		weston_recorder_create(output, path);
+		free(path);
 	}
 }
 
@@ -615,7 +1108,7 @@ screenshooter_create(struct weston_compositor *ec)
 	shooter->client = NULL;
 
 	shooter->global = wl_global_create(ec->wl_display,
-					   &screenshooter_interface, 1,
+					   &screenshooter_interface, 2,
 					   shooter, bind_shooter);
 	weston_compositor_add_key_binding(ec, KEY_S, MODIFIER_SUPER,
 					  screenshooter_binding, shooter);
@@ -112,6 +112,10 @@ device_added(struct udev_device *udev_device, struct udev_input *input)
 			    device->abs.calibration[5]);
 	}
 
+	if (input->thread && evdev_device_set_thread(device, input->thread) < 0)
+		weston_log("failed to read input device '%s' on the input "
+			   "thread: %m\n", devnode);
+
 	wl_list_insert(seat->devices_list.prev, &device->link);
 
 	if (seat->base.output && seat->base.pointer)
@@ -222,6 +226,7 @@ evdev_udev_handler(int fd, uint32_t mask, void *data)
 				if (!strcmp(device->devnode, devnode)) {
 					weston_log("input device %s, %s removed\n",
 							device->devname, device->devnode);
+					evdev_device_stop(device);
 					weston_launcher_close(input->compositor->launcher,
 							      device->fd);
 					evdev_device_destroy(device);
@@ -284,6 +289,7 @@ udev_input_remove_devices(struct udev_input *input)
 
 	wl_list_for_each(seat, &input->compositor->seat_list, base.link) {
 		wl_list_for_each_safe(device, next, &seat->devices_list, link) {
+			evdev_device_stop(device);
 			weston_launcher_close(input->compositor->launcher,
 					      device->fd);
 			evdev_device_destroy(device);
@@ -313,17 +319,29 @@ int
 udev_input_init(struct udev_input *input, struct weston_compositor *c, struct udev *udev,
 		const char *seat_id)
 {
+	struct weston_config_section *section;
+	int input_thread;
+
 	memset(input, 0, sizeof *input);
 	input->seat_id = strdup(seat_id);
 	input->compositor = c;
 	input->udev = udev;
 	input->udev = udev_ref(udev);
+
+	section = weston_config_get_section(c->config, "core", NULL, NULL);
+	weston_config_section_get_bool(section, "input-thread",
+				       &input_thread, 0);
+	if (input_thread)
+		input->thread = evdev_thread_create(c);
+
 	if (udev_input_enable(input) < 0)
 		goto err;
 
 	return 0;
 
  err:
+	if (input->thread)
+		evdev_thread_destroy(input->thread);
 	free(input->seat_id);
 	return -1;
 }
@@ -335,6 +353,8 @@ udev_input_destroy(struct udev_input *input)
 	udev_input_disable(input);
 	wl_list_for_each_safe(seat, next, &input->compositor->seat_list, base.link)
 		udev_seat_destroy(seat);
+	if (input->thread)
+		evdev_thread_destroy(input->thread);
 	udev_unref(input->udev);
 	free(input->seat_id);
 }
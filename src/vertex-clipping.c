@@ -293,21 +293,11 @@ clip_simple(struct clip_context *ctx,
 	return surf->n;
 }
 
-int
-clip_transformed(struct clip_context *ctx,
-		 struct polygon8 *surf,
-		 float *ex,
-		 float *ey)
+static int
+clip_remove_duplicates(const struct polygon8 *surf, float *ex, float *ey)
 {
-	struct polygon8 polygon;
 	int i, n;
 
-	polygon.n = clip_polygon_left(ctx, surf, polygon.x, polygon.y);
-	surf->n = clip_polygon_right(ctx, &polygon, surf->x, surf->y);
-	polygon.n = clip_polygon_top(ctx, surf, polygon.x, polygon.y);
-	surf->n = clip_polygon_bottom(ctx, &polygon, surf->x, surf->y);
-
-	/* Get rid of duplicate vertices */
 	ex[0] = surf->x[0];
 	ey[0] = surf->y[0];
 	n = 1;
@@ -325,3 +315,147 @@ clip_transformed(struct clip_context *ctx,
 
 	return n;
 }
+
+int
+clip_transformed(struct clip_context *ctx,
+		 struct polygon8 *surf,
+		 float *ex,
+		 float *ey)
+{
+	struct polygon8 polygon;
+
+	polygon.n = clip_polygon_left(ctx, surf, polygon.x, polygon.y);
+	surf->n = clip_polygon_right(ctx, &polygon, surf->x, surf->y);
+	polygon.n = clip_polygon_top(ctx, surf, polygon.x, polygon.y);
+	surf->n = clip_polygon_bottom(ctx, &polygon, surf->x, surf->y);
+
+	/* Get rid of duplicate vertices */
+	return clip_remove_duplicates(surf, ex, ey);
+}
+
+/* The edge tests compare every vertex against the same value and only
+ * count the results, so they compile to a few vector compares. */
+static int
+all_at_least(const float *v, int n, float edge)
+{
+	int i, in = 0;
+
+	for (i = 0; i < n; i++)
+		in += v[i] >= edge;
+
+	return in == n;
+}
+
+static int
+all_below(const float *v, int n, float edge)
+{
+	int i, in = 0;
+
+	for (i = 0; i < n; i++)
+		in += v[i] < edge;
+
+	return in == n;
+}
+
+static inline void
+swap_polygons(struct polygon8 **a, struct polygon8 **b)
+{
+	struct polygon8 *tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+/* Same result as clip_transformed(), but a pass is skipped when the
+ * polygon is already inside its edge, where it would only copy the
+ * vertices. */
+static int
+clip_quad_transformed(const struct polygon8 *quad,
+		      const struct clip_rect *rect,
+		      float *ex, float *ey)
+{
+	struct clip_context ctx;
+	struct polygon8 buf[2], *src, *dst;
+
+	ctx.clip.x1 = rect->x1;
+	ctx.clip.y1 = rect->y1;
+	ctx.clip.x2 = rect->x2;
+	ctx.clip.y2 = rect->y2;
+
+	buf[0] = *quad;
+	src = &buf[0];
+	dst = &buf[1];
+
+	if (!all_at_least(src->x, src->n, ctx.clip.x1)) {
+		dst->n = clip_polygon_left(&ctx, src, dst->x, dst->y);
+		swap_polygons(&src, &dst);
+	}
+	if (!all_below(src->x, src->n, ctx.clip.x2)) {
+		dst->n = clip_polygon_right(&ctx, src, dst->x, dst->y);
+		swap_polygons(&src, &dst);
+	}
+	if (!all_at_least(src->y, src->n, ctx.clip.y1)) {
+		dst->n = clip_polygon_top(&ctx, src, dst->x, dst->y);
+		swap_polygons(&src, &dst);
+	}
+	if (!all_below(src->y, src->n, ctx.clip.y2)) {
+		dst->n = clip_polygon_bottom(&ctx, src, dst->x, dst->y);
+		swap_polygons(&src, &dst);
+	}
+
+	if (src->n < 3)
+		return 0;
+
+	return clip_remove_duplicates(src, ex, ey);
+}
+
+static int
+clip_quad_simple(const struct polygon8 *quad, const struct clip_rect *rect,
+		 float *ex, float *ey)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		ex[i] = clip(quad->x[i], rect->x1, rect->x2);
+		ey[i] = clip(quad->y[i], rect->y1, rect->y2);
+	}
+
+	return 4;
+}
+
+void
+clip_quad_rects(const struct polygon8 *quad, int transformed,
+		const struct clip_rect *rects, int nrects,
+		float *ex, float *ey, int *n)
+{
+	float min_x, max_x, min_y, max_y;
+	int i;
+
+	assert(quad->n == 4);
+
+	min_x = min(min(quad->x[0], quad->x[1]), min(quad->x[2], quad->x[3]));
+	max_x = max(max(quad->x[0], quad->x[1]), max(quad->x[2], quad->x[3]));
+	min_y = min(min(quad->y[0], quad->y[1]), min(quad->y[2], quad->y[3]));
+	max_y = max(max(quad->y[0], quad->y[1]), max(quad->y[2], quad->y[3]));
+
+	/* Bounding box rejection for all rectangles first.  The test has
+	 * no branches, so it runs on several rectangles at a time. */
+	for (i = 0; i < nrects; i++)
+		n[i] = !((min_x >= rects[i].x2) | (max_x <= rects[i].x1) |
+			 (min_y >= rects[i].y2) | (max_y <= rects[i].y1));
+
+	for (i = 0; i < nrects; i++) {
+		if (!n[i])
+			continue;
+
+		if (transformed)
+			n[i] = clip_quad_transformed(quad, &rects[i],
+						     ex + i * 8, ey + i * 8);
+		else
+			n[i] = clip_quad_simple(quad, &rects[i],
+						ex + i * 8, ey + i * 8);
+
+		if (n[i] < 3)
+			n[i] = 0;
+	}
+}
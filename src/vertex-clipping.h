@@ -58,6 +58,20 @@ int
 clip_transformed(struct clip_context *ctx,
 		 struct polygon8 *surf,
 		 float *ex,
-		 float *ey);\
+		 float *ey);
+
+struct clip_rect {
+	float x1, y1;
+	float x2, y2;
+};
+
+/* Clip a quad against each of nrects rectangles.  The polygon left by
+ * rectangle i is written to ex and ey starting at index 8 * i, with
+ * n[i] vertices, or n[i] = 0 when less than a triangle remains.  Quads
+ * that are not transformed are clamped like clip_simple(). */
+void
+clip_quad_rects(const struct polygon8 *quad, int transformed,
+		const struct clip_rect *rects, int nrects,
+		float *ex, float *ey, int *n);
 
 #endif
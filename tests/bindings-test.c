@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "../src/compositor.h"
+
+#define NUM_BINDINGS	200
+#define ITERATIONS	1000000
+
+static int order[4];
+static int fired;
+
+static void
+record_button(struct weston_seat *seat, uint32_t time, uint32_t button,
+	      void *data)
+{
+	order[fired++ % 4] = (int) (intptr_t) data;
+}
+
+static void
+count_button(struct weston_seat *seat, uint32_t time, uint32_t button,
+	     void *data)
+{
+	fired++;
+}
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+		(end->tv_nsec - start->tv_nsec);
+}
+
+static double
+time_dispatch(struct weston_compositor *compositor, struct weston_seat *seat,
+	      uint32_t button)
+{
+	struct timespec start, end;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ITERATIONS; i++)
+		weston_compositor_run_button_binding(compositor, seat, i,
+						     button,
+						     WL_POINTER_BUTTON_STATE_PRESSED);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed_ns(&start, &end) / ITERATIONS;
+}
+
+static void
+binding_dispatch(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_binding *a, *b, *bindings[NUM_BINDINGS];
+	struct weston_seat seat;
+	double few, many;
+	int i;
+
+	/* Button dispatch only looks at the modifier state, so a bare
+	 * seat is enough. */
+	memset(&seat, 0, sizeof seat);
+	seat.modifier_state = MODIFIER_SUPER;
+
+	/* Bindings sharing a button and modifier run in the order they
+	 * were added, and a destroyed binding no longer runs. */
+	a = weston_compositor_add_button_binding(compositor, 1, MODIFIER_SUPER,
+						 record_button, (void *) 1);
+	b = weston_compositor_add_button_binding(compositor, 1, MODIFIER_SUPER,
+						 record_button, (void *) 2);
+	assert(a && b);
+	weston_compositor_run_button_binding(compositor, &seat, 0, 1,
+					     WL_POINTER_BUTTON_STATE_PRESSED);
+	assert(fired == 2 && order[0] == 1 && order[1] == 2);
+
+	weston_compositor_run_button_binding(compositor, &seat, 0, 1,
+					     WL_POINTER_BUTTON_STATE_RELEASED);
+	seat.modifier_state = MODIFIER_CTRL;
+	weston_compositor_run_button_binding(compositor, &seat, 0, 1,
+					     WL_POINTER_BUTTON_STATE_PRESSED);
+	assert(fired == 2);
+
+	seat.modifier_state = MODIFIER_SUPER;
+	weston_binding_destroy(a);
+	weston_compositor_run_button_binding(compositor, &seat, 0, 1,
+					     WL_POINTER_BUTTON_STATE_PRESSED);
+	assert(fired == 3 && order[2] == 2);
+	weston_binding_destroy(b);
+
+	/* Dispatch cost shouldn't depend on how many bindings exist. */
+	fired = 0;
+	a = weston_compositor_add_button_binding(compositor, 1, MODIFIER_SUPER,
+						 count_button, NULL);
+	few = time_dispatch(compositor, &seat, 1);
+	assert(fired == ITERATIONS);
+
+	for (i = 0; i < NUM_BINDINGS; i++) {
+		bindings[i] =
+			weston_compositor_add_button_binding(compositor,
+							     1000 + i,
+							     i % 16,
+							     count_button,
+							     NULL);
+		assert(bindings[i]);
+	}
+
+	fired = 0;
+	many = time_dispatch(compositor, &seat, 1);
+	assert(fired == ITERATIONS);
+
+	fprintf(stderr, "button dispatch: %.1f ns with 1 binding, "
+		"%.1f ns with %d bindings\n", few, many, NUM_BINDINGS + 1);
+	fprintf(stderr, "unbound button: %.1f ns\n",
+		time_dispatch(compositor, &seat, 999));
+	assert(fired == ITERATIONS);
+
+	for (i = 0; i < NUM_BINDINGS; i++)
+		weston_binding_destroy(bindings[i]);
+	weston_binding_destroy(a);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, binding_dispatch, compositor);
+
+	return 0;
+}
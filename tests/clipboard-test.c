@@ -0,0 +1,283 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../src/compositor.h"
+
+#define SELECTION_SIZE	(32 * 1024 * 1024)
+#define CHUNK_SIZE	65536
+
+struct test_source {
+	struct weston_data_source base;
+	struct wl_event_source *event_source;
+	size_t written;
+};
+
+struct paste {
+	struct weston_compositor *compositor;
+	struct weston_seat *seat;
+	struct wl_event_source *event_source;
+	size_t received;
+	long hwm_before;
+	long shmem_before;
+};
+
+static struct test_source test_source;
+static struct weston_seat seat;
+static struct paste paste;
+
+static unsigned char
+pattern(size_t offset)
+{
+	return (offset * 31 + (offset >> 16)) & 0xff;
+}
+
+static long
+status_kb(const char *field)
+{
+	char line[256];
+	long kb = -1;
+	size_t len = strlen(field);
+	FILE *fp;
+
+	fp = fopen("/proc/self/status", "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, sizeof line, fp))
+		if (strncmp(line, field, len) == 0 && line[len] == ':' &&
+		    sscanf(line + len + 1, "%ld kB", &kb) == 1)
+			break;
+
+	fclose(fp);
+
+	return kb;
+}
+
+/* Memory actually allocated to the compositor's copy of the selection.
+ * It lives in shmem that is never mapped, so neither VmHWM nor RssShmem
+ * sees it; look the file up among our fds instead. */
+static long
+clipboard_store_kb(void)
+{
+	char target[256];
+	struct dirent *de;
+	struct stat st;
+	long kb = -1;
+	ssize_t len;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	if (dir == NULL)
+		return -1;
+
+	while ((de = readdir(dir))) {
+		len = readlinkat(dirfd(dir), de->d_name,
+				 target, sizeof target - 1);
+		if (len < 0)
+			continue;
+		target[len] = '\0';
+		if (strstr(target, "weston-clipboard") == NULL &&
+		    strstr(target, "weston-shared") == NULL)
+			continue;
+		if (fstatat(dirfd(dir), de->d_name, &st, 0) == 0 &&
+		    st.st_size >= SELECTION_SIZE) {
+			kb = st.st_blocks / 2;
+			break;
+		}
+	}
+
+	closedir(dir);
+
+	return kb;
+}
+
+static int
+source_writable(int fd, uint32_t mask, void *data)
+{
+	struct test_source *source = data;
+	unsigned char buffer[CHUNK_SIZE];
+	size_t i, len;
+	ssize_t n;
+
+	len = SELECTION_SIZE - source->written;
+	if (len > sizeof buffer)
+		len = sizeof buffer;
+
+	for (i = 0; i < len; i++)
+		buffer[i] = pattern(source->written + i);
+
+	n = write(fd, buffer, len);
+	if (n < 0 && errno == EAGAIN)
+		return 1;
+	assert(n > 0);
+
+	source->written += n;
+	if (source->written == SELECTION_SIZE) {
+		wl_event_source_remove(source->event_source);
+		close(fd);
+	}
+
+	return 1;
+}
+
+static void
+source_accept(struct weston_data_source *source,
+	      uint32_t time, const char *mime_type)
+{
+}
+
+static void
+source_send(struct weston_data_source *base, const char *mime_type,
+	    int32_t fd)
+{
+	struct test_source *source =
+		container_of(base, struct test_source, base);
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(seat.compositor->wl_display);
+
+	assert(strcmp(mime_type, "text/plain") == 0);
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	source->event_source =
+		wl_event_loop_add_fd(loop, fd, WL_EVENT_WRITABLE,
+				     source_writable, source);
+	assert(source->event_source);
+}
+
+static void
+source_cancel(struct weston_data_source *source)
+{
+}
+
+static int
+paste_readable(int fd, uint32_t mask, void *data)
+{
+	struct paste *paste = data;
+	unsigned char buffer[CHUNK_SIZE];
+	long growth, shmem, store;
+	ssize_t i, n;
+
+	n = read(fd, buffer, sizeof buffer);
+	if (n < 0 && errno == EAGAIN)
+		return 1;
+	assert(n >= 0);
+
+	for (i = 0; i < n; i++)
+		assert(buffer[i] == pattern(paste->received + i));
+	paste->received += n;
+
+	if (n > 0)
+		return 1;
+
+	/* The paste was served while the copy was still coming in, and
+	 * every byte made it through. */
+	assert(paste->received == SELECTION_SIZE);
+
+	growth = status_kb("VmHWM") - paste->hwm_before;
+	shmem = status_kb("RssShmem");
+	if (shmem >= 0)
+		shmem -= paste->shmem_before;
+	store = clipboard_store_kb();
+	fprintf(stderr, "pasted %d bytes, peak RSS grew by %ld kB, "
+		"RssShmem by %ld kB, clipboard store holds %ld kB\n",
+		SELECTION_SIZE, growth, shmem, store);
+	assert(growth < SELECTION_SIZE / 4 / 1024);
+
+	/* The store grows with the data, without room reserved ahead. */
+	assert(store >= 0);
+	assert(store <= SELECTION_SIZE / 1024 + 1024);
+
+	wl_event_source_remove(paste->event_source);
+	close(fd);
+	weston_seat_release(paste->seat);
+	wl_display_terminate(paste->compositor->wl_display);
+
+	return 1;
+}
+
+static void
+clipboard_paste(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(compositor->wl_display);
+	struct weston_data_source *selection;
+	char **type;
+	int p[2], ret;
+
+	paste.compositor = compositor;
+	paste.seat = &seat;
+	paste.hwm_before = status_kb("VmHWM");
+	paste.shmem_before = status_kb("RssShmem");
+
+	weston_seat_init(&seat, compositor, "clipboard-test");
+
+	wl_array_init(&test_source.base.mime_types);
+	type = wl_array_add(&test_source.base.mime_types, sizeof *type);
+	assert(type);
+	*type = strdup("text/plain");
+	test_source.base.accept = source_accept;
+	test_source.base.send = source_send;
+	test_source.base.cancel = source_cancel;
+	wl_signal_init(&test_source.base.destroy_signal);
+
+	weston_seat_set_selection(&seat, &test_source.base, 1);
+
+	/* Go away as a client would; the compositor's copy takes over
+	 * the selection and keeps receiving what we are still writing. */
+	wl_signal_emit(&test_source.base.destroy_signal, &test_source.base);
+	selection = seat.selection_data_source;
+	assert(selection && selection != &test_source.base);
+
+	ret = pipe2(p, O_CLOEXEC);
+	assert(ret == 0);
+	fcntl(p[0], F_SETFL, O_NONBLOCK);
+	selection->send(selection, "text/plain", p[1]);
+
+	paste.event_source =
+		wl_event_loop_add_fd(loop, p[0], WL_EVENT_READABLE,
+				     paste_readable, &paste);
+	assert(paste.event_source);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, clipboard_paste, compositor);
+
+	return 0;
+}
@@ -0,0 +1,241 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+
+#include "../xwayland/hash.h"
+#include "hash-baseline.h"
+
+/* Roughly how X hands out ids: a client base plus a counter */
+#define XID(client, n) (((client) << 21) | (n))
+
+static void *
+value(uint32_t key)
+{
+	return (void *) (uintptr_t) (key | 1);
+}
+
+static void
+count_entry(void *element, void *data)
+{
+	int *count = data;
+
+	(*count)++;
+}
+
+TEST(hash_insert_lookup_remove)
+{
+	struct hash_table *ht;
+	uint32_t i;
+	int count = 0;
+
+	ht = hash_table_create();
+	assert(ht);
+
+	for (i = 1; i <= 10000; i++)
+		assert(hash_table_insert(ht, XID(i % 7, i), value(i)) == 0);
+
+	for (i = 1; i <= 10000; i++)
+		assert(hash_table_lookup(ht, XID(i % 7, i)) == value(i));
+	assert(hash_table_lookup(ht, XID(8, 1)) == NULL);
+
+	hash_table_for_each(ht, count_entry, &count);
+	assert(count == 10000);
+
+	/* Remove every other entry; the rest must stay reachable. */
+	for (i = 1; i <= 10000; i += 2)
+		hash_table_remove(ht, XID(i % 7, i));
+	for (i = 1; i <= 10000; i++)
+		assert(hash_table_lookup(ht, XID(i % 7, i)) ==
+		       (i & 1 ? NULL : value(i)));
+
+	for (i = 2; i <= 10000; i += 2)
+		hash_table_remove(ht, XID(i % 7, i));
+	count = 0;
+	hash_table_for_each(ht, count_entry, &count);
+	assert(count == 0);
+
+	hash_table_destroy(ht);
+}
+
+TEST(hash_insert_replaces)
+{
+	struct hash_table *ht;
+
+	ht = hash_table_create();
+	assert(ht);
+
+	assert(hash_table_insert(ht, 42, value(1)) == 0);
+	assert(hash_table_insert(ht, 42, value(2)) == 0);
+	assert(hash_table_lookup(ht, 42) == value(2));
+
+	hash_table_remove(ht, 42);
+	assert(hash_table_lookup(ht, 42) == NULL);
+	hash_table_remove(ht, 42);
+
+	hash_table_destroy(ht);
+}
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+		(end->tv_nsec - start->tv_nsec);
+}
+
+#define BENCH_WINDOWS	5000
+#define BENCH_ROUNDS	200
+
+/* The table under test and the one it replaced, behind one interface. */
+struct bench_table {
+	const char *name;
+	void *(*create)(void);
+	void (*destroy)(void *ht);
+	void *(*lookup)(void *ht, uint32_t key);
+	int (*insert)(void *ht, uint32_t key, void *data);
+	void (*remove)(void *ht, uint32_t key);
+};
+
+static void *
+current_create(void)
+{
+	return hash_table_create();
+}
+
+static void
+current_destroy(void *ht)
+{
+	hash_table_destroy(ht);
+}
+
+static void *
+current_lookup(void *ht, uint32_t key)
+{
+	return hash_table_lookup(ht, key);
+}
+
+static int
+current_insert(void *ht, uint32_t key, void *data)
+{
+	return hash_table_insert(ht, key, data);
+}
+
+static void
+current_remove(void *ht, uint32_t key)
+{
+	hash_table_remove(ht, key);
+}
+
+static void *
+baseline_create(void)
+{
+	return baseline_hash_table_create();
+}
+
+static void
+baseline_destroy(void *ht)
+{
+	baseline_hash_table_destroy(ht);
+}
+
+static void *
+baseline_lookup(void *ht, uint32_t key)
+{
+	return baseline_hash_table_lookup(ht, key);
+}
+
+static int
+baseline_insert(void *ht, uint32_t key, void *data)
+{
+	return baseline_hash_table_insert(ht, key, data);
+}
+
+static void
+baseline_remove(void *ht, uint32_t key)
+{
+	baseline_hash_table_remove(ht, key);
+}
+
+static const struct bench_table bench_tables[] = {
+	{ "robin hood", current_create, current_destroy,
+	  current_lookup, current_insert, current_remove },
+	{ "old double hashing", baseline_create, baseline_destroy,
+	  baseline_lookup, baseline_insert, baseline_remove },
+};
+
+/* Window churn: a steady set of windows while override-redirect ones
+ * come and go, looking each up a few times as its events arrive. */
+TEST_P(hash_churn_benchmark, bench_tables)
+{
+	const struct bench_table *t = data;
+	void *ht;
+	struct timespec start, end;
+	double insert = 0, lookup = 0, remove = 0;
+	uint32_t i, round, id = 1;
+
+	ht = t->create();
+	assert(ht);
+
+	for (i = 0; i < BENCH_WINDOWS; i++, id++)
+		assert(t->insert(ht, XID(1, id), value(id)) == 0);
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		uint32_t first = id;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < BENCH_WINDOWS; i++, id++)
+			t->insert(ht, XID(2, id), value(id));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		insert += elapsed_ns(&start, &end);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = first; i < id; i++) {
+			assert(t->lookup(ht, XID(2, i)) == value(i));
+			assert(t->lookup(ht, XID(3, i)) == NULL);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		lookup += elapsed_ns(&start, &end);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = first; i < id; i++)
+			t->remove(ht, XID(2, i));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		remove += elapsed_ns(&start, &end);
+	}
+
+	fprintf(stderr, "%s, per operation with %d live windows: "
+		"insert %.1f ns, lookup %.1f ns, remove %.1f ns\n",
+		t->name, BENCH_WINDOWS,
+		insert / (BENCH_ROUNDS * BENCH_WINDOWS),
+		lookup / (BENCH_ROUNDS * BENCH_WINDOWS * 2),
+		remove / (BENCH_ROUNDS * BENCH_WINDOWS));
+
+	t->destroy(ht);
+}
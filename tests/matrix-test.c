@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <unistd.h>
 #include <signal.h>
@@ -179,6 +180,169 @@ randomize_matrix(struct weston_matrix *m)
 #else
 		m->d[i] = frand();
 #endif
+	m->type = WESTON_MATRIX_TRANSFORM_OTHER;
+}
+
+/* A matrix built the way the compositor builds them, so its type bits
+ * are the ones the specialized kernels dispatch on. */
+static void
+randomize_typed_matrix(struct weston_matrix *m, unsigned type)
+{
+	double angle;
+
+	weston_matrix_init(m);
+
+	if (type & WESTON_MATRIX_TRANSFORM_SCALE)
+		weston_matrix_scale(m, frand() * 4.0, frand() * 4.0,
+				    frand() * 4.0);
+	if (type & WESTON_MATRIX_TRANSFORM_ROTATE) {
+		angle = frand() * M_PI;
+		weston_matrix_rotate_xy(m, cos(angle), sin(angle));
+	}
+	if (type & WESTON_MATRIX_TRANSFORM_TRANSLATE)
+		weston_matrix_translate(m, frand() * 1000.0, frand() * 1000.0,
+					frand() * 10.0);
+	if (type & WESTON_MATRIX_TRANSFORM_OTHER)
+		randomize_matrix(m);
+}
+
+/* The generic n * m product that weston_matrix_multiply() used to do for
+ * every matrix. */
+static void
+reference_multiply(struct weston_matrix *m, const struct weston_matrix *n)
+{
+	struct weston_matrix tmp;
+	const float *row, *column;
+	div_t d;
+	int i, j;
+
+	for (i = 0; i < 16; i++) {
+		tmp.d[i] = 0;
+		d = div(i, 4);
+		row = m->d + d.quot * 4;
+		column = n->d + d.rem;
+		for (j = 0; j < 4; j++)
+			tmp.d[i] += row[j] * column[j * 4];
+	}
+	tmp.type = m->type | n->type;
+	*m = tmp;
+}
+
+static double
+matrix_error(const struct weston_matrix *a, const struct weston_matrix *b)
+{
+	double err, errsup = 0.0, scale = 1.0;
+	unsigned i;
+
+	for (i = 0; i < 16; ++i)
+		if (fabs(b->d[i]) > scale)
+			scale = fabs(b->d[i]);
+
+	for (i = 0; i < 16; ++i) {
+		err = fabs(a->d[i] - b->d[i]) / scale;
+		if (err > errsup)
+			errsup = err;
+	}
+
+	return errsup;
+}
+
+static const unsigned matrix_types[] = {
+	0,
+	WESTON_MATRIX_TRANSFORM_TRANSLATE,
+	WESTON_MATRIX_TRANSFORM_SCALE,
+	WESTON_MATRIX_TRANSFORM_TRANSLATE | WESTON_MATRIX_TRANSFORM_SCALE,
+	WESTON_MATRIX_TRANSFORM_ROTATE,
+	WESTON_MATRIX_TRANSFORM_TRANSLATE | WESTON_MATRIX_TRANSFORM_SCALE |
+		WESTON_MATRIX_TRANSFORM_ROTATE,
+	WESTON_MATRIX_TRANSFORM_OTHER,
+};
+
+#define NUM_MATRIX_TYPES (sizeof matrix_types / sizeof matrix_types[0])
+
+/* Check the type specialized kernels against the generic ones for every
+ * combination of matrix types.  Returns the number of failures. */
+static int
+test_specialized(void)
+{
+	struct weston_matrix m, n, a, b;
+	struct inverse_matrix q;
+	struct weston_vector v[8], w[8];
+	unsigned i, j, k, iter;
+	int fails = 0;
+	double err;
+
+	printf("\nChecking the specialized matrix kernels...\n");
+
+	for (iter = 0; iter < 1000; iter++) {
+		for (i = 0; i < NUM_MATRIX_TYPES; i++) {
+			randomize_typed_matrix(&m, matrix_types[i]);
+
+			for (j = 0; j < NUM_MATRIX_TYPES; j++) {
+				randomize_typed_matrix(&n, matrix_types[j]);
+
+				a = m;
+				weston_matrix_multiply(&a, &n);
+				b = m;
+				reference_multiply(&b, &n);
+
+				err = matrix_error(&a, &b);
+				if (err > 1e-6 || a.type != b.type) {
+					printf("multiply fail, types %#x * %#x, "
+					       "error %g\n", matrix_types[j],
+					       matrix_types[i], err);
+					fails++;
+				}
+			}
+
+			if (weston_matrix_invert(&a, &m) < 0) {
+				if (matrix_invert(q.LU, q.perm, &m) == 0 &&
+				    fabs(determinant(&m)) > 1e-5) {
+					printf("invert fail, type %#x refused\n",
+					       matrix_types[i]);
+					fails++;
+				}
+			} else if (matrix_invert(q.LU, q.perm, &m) == 0) {
+				weston_matrix_init(&b);
+				for (k = 0; k < 4; ++k)
+					inverse_transform(q.LU, q.perm,
+							  &b.d[k * 4]);
+				b.type = m.type;
+
+				err = matrix_error(&a, &b);
+				if (err > 1e-5 || a.type != b.type) {
+					printf("invert fail, type %#x, "
+					       "error %g\n", matrix_types[i],
+					       err);
+					fails++;
+				}
+			}
+
+			for (k = 0; k < 8; k++) {
+				v[k].f[0] = frand() * 1000.0;
+				v[k].f[1] = frand() * 1000.0;
+				v[k].f[2] = frand();
+				v[k].f[3] = k & 1 ? 1.0 : frand();
+				w[k] = v[k];
+				weston_matrix_transform(&m, &w[k]);
+			}
+			weston_matrix_transform_points(&m, v, 8);
+
+			for (k = 0; k < 8 * 4; k++) {
+				err = fabs(v[k / 4].f[k % 4] - w[k / 4].f[k % 4]);
+				if (err > 1e-5 * (1.0 + fabs(w[k / 4].f[k % 4]))) {
+					printf("transform points fail, type %#x, "
+					       "error %g\n", matrix_types[i], err);
+					fails++;
+					break;
+				}
+			}
+		}
+	}
+
+	printf("%d failures.\n", fails);
+
+	return fails;
 }
 
 /* Take a matrix, compute inverse, multiply together
@@ -347,19 +511,22 @@ test_loop_speed_invert(void)
 static void __attribute__((noinline))
 test_loop_speed_invert_explicit(void)
 {
-	struct weston_matrix m;
+	struct weston_matrix m, r;
 	unsigned long count = 0;
 	double t;
 
 	printf("\nRunning 3 s test on weston_matrix_invert()...\n");
 
-	weston_matrix_init(&m);
+	/* A general matrix, so this times the full inverse rather than
+	 * one of the shortcuts for simpler types. */
+	randomize_matrix(&m);
 
 	running = 1;
 	alarm(3);
 	reset_timer();
 	while (running) {
-		weston_matrix_invert(&m, &m);
+		weston_matrix_invert(&r, &m);
+		__asm__ __volatile__("" : : "g"(&r) : "memory");
 		count++;
 	}
 	t = read_timer();
@@ -368,6 +535,131 @@ test_loop_speed_invert_explicit(void)
 	       count, t, 1e9 * t / count);
 }
 
+static const char *
+matrix_type_name(unsigned type)
+{
+	switch (type) {
+	case 0:
+		return "identity";
+	case WESTON_MATRIX_TRANSFORM_TRANSLATE:
+		return "translate";
+	case WESTON_MATRIX_TRANSFORM_SCALE:
+		return "scale";
+	case WESTON_MATRIX_TRANSFORM_TRANSLATE | WESTON_MATRIX_TRANSFORM_SCALE:
+		return "translate+scale";
+	case WESTON_MATRIX_TRANSFORM_ROTATE:
+		return "rotate";
+	case WESTON_MATRIX_TRANSFORM_OTHER:
+		return "general";
+	default:
+		return "2D affine";
+	}
+}
+
+#define SPEED_ITERATIONS 1000000
+
+static void __attribute__((noinline))
+test_loop_speed_specialized(void)
+{
+	struct weston_matrix m, n, r;
+	struct weston_vector v[64], w[64];
+	double t_new, t_ref;
+	unsigned i, k;
+	int j;
+
+	printf("\nComparing kernels by matrix type, ns/iter "
+	       "(specialized vs. generic):\n");
+
+	for (i = 0; i < NUM_MATRIX_TYPES; i++) {
+		randomize_typed_matrix(&m, matrix_types[i]);
+		randomize_typed_matrix(&n, matrix_types[i]);
+
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS; j++) {
+			r = m;
+			weston_matrix_multiply(&r, &n);
+			__asm__ __volatile__("" : : "g"(&r) : "memory");
+		}
+		t_new = read_timer();
+
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS; j++) {
+			r = m;
+			reference_multiply(&r, &n);
+			__asm__ __volatile__("" : : "g"(&r) : "memory");
+		}
+		t_ref = read_timer();
+
+		printf("  multiply  %-16s %6.1f vs. %6.1f\n",
+		       matrix_type_name(matrix_types[i]),
+		       1e9 * t_new / SPEED_ITERATIONS,
+		       1e9 * t_ref / SPEED_ITERATIONS);
+	}
+
+	for (i = 0; i < NUM_MATRIX_TYPES; i++) {
+		struct inverse_matrix q;
+
+		randomize_typed_matrix(&m, matrix_types[i]);
+
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS; j++) {
+			weston_matrix_invert(&r, &m);
+			__asm__ __volatile__("" : : "g"(&r) : "memory");
+		}
+		t_new = read_timer();
+
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS; j++) {
+			if (matrix_invert(q.LU, q.perm, &m) == 0)
+				for (k = 0; k < 4; ++k)
+					inverse_transform(q.LU, q.perm,
+							  &r.d[k * 4]);
+			__asm__ __volatile__("" : : "g"(&r) : "memory");
+		}
+		t_ref = read_timer();
+
+		printf("  invert    %-16s %6.1f vs. %6.1f\n",
+		       matrix_type_name(matrix_types[i]),
+		       1e9 * t_new / SPEED_ITERATIONS,
+		       1e9 * t_ref / SPEED_ITERATIONS);
+	}
+
+	for (k = 0; k < 64; k++) {
+		v[k].f[0] = frand() * 1000.0;
+		v[k].f[1] = frand() * 1000.0;
+		v[k].f[2] = 0.0;
+		v[k].f[3] = 1.0;
+	}
+
+	for (i = 0; i < NUM_MATRIX_TYPES; i++) {
+		randomize_typed_matrix(&m, matrix_types[i]);
+
+		/* Transform fresh copies, so repeated scaling can't run
+		 * the points off to inf or NaN. */
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS / 64; j++) {
+			memcpy(w, v, sizeof w);
+			weston_matrix_transform_points(&m, w, 64);
+			__asm__ __volatile__("" : : "g"(w) : "memory");
+		}
+		t_new = read_timer();
+
+		reset_timer();
+		for (j = 0; j < SPEED_ITERATIONS / 64; j++) {
+			memcpy(w, v, sizeof w);
+			for (k = 0; k < 64; k++)
+				weston_matrix_transform(&m, &w[k]);
+			__asm__ __volatile__("" : : "g"(w) : "memory");
+		}
+		t_ref = read_timer();
+
+		printf("  transform %-16s %6.1f vs. %6.1f per point\n",
+		       matrix_type_name(matrix_types[i]),
+		       1e9 * t_new / (SPEED_ITERATIONS / 64 * 64),
+		       1e9 * t_ref / (SPEED_ITERATIONS / 64 * 64));
+	}
+}
+
 int main(void)
 {
 	struct sigaction ding;
@@ -411,11 +703,15 @@ int main(void)
 	print_matrix(&M);
 	printf("max abs error: %g, original determinant %g\n", errsup, det);
 
+	if (test_specialized() != 0)
+		return 1;
+
 	test_loop_precision();
 	test_loop_speed_matrixvector();
 	test_loop_speed_inversetransform();
 	test_loop_speed_invert();
 	test_loop_speed_invert_explicit();
+	test_loop_speed_specialized();
 
 	return 0;
 }
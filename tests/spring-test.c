@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "../src/compositor.h"
+
+#define ITERATIONS	100000
+
+/* The step integration weston_spring_update() used to do for every
+ * spring, kept here as the reference trajectory. */
+static void
+reference_update(struct weston_spring *spring, uint32_t msec)
+{
+	double force, v, current, step;
+
+	if (msec - spring->timestamp > 1000)
+		spring->timestamp = msec - 1000;
+
+	step = 0.01;
+	while (4 < msec - spring->timestamp) {
+		current = spring->current;
+		v = current - spring->previous;
+		force = spring->k * (spring->target - current) / 10.0 +
+			(spring->previous - current) - v * spring->friction;
+
+		spring->current =
+			current + (current - spring->previous) +
+			force * step * step;
+		spring->previous = current;
+
+		spring->timestamp += 4;
+	}
+}
+
+static void
+check_trajectory(double k, double friction)
+{
+	struct weston_spring spring, reference;
+	uint32_t msec = 1000;
+	int i;
+
+	weston_spring_init(&spring, k, 0.0, 1.0);
+	spring.friction = friction;
+	spring.timestamp = msec;
+	reference = spring;
+
+	/* Frames at 60 Hz, with a stall in the middle */
+	for (i = 0; i < 300; i++) {
+		msec += i == 100 ? 700 : 16 + i % 3;
+		weston_spring_update(&spring, msec);
+		reference_update(&reference, msec);
+
+		assert(fabs(spring.current - reference.current) < 1e-9);
+		assert(fabs(spring.previous - reference.previous) < 1e-9);
+		assert(spring.timestamp == reference.timestamp);
+	}
+}
+
+static double
+time_updates(void (*update)(struct weston_spring *, uint32_t))
+{
+	struct weston_spring spring;
+	struct timespec start, end;
+	uint32_t msec = 0;
+	int i;
+
+	weston_spring_init(&spring, 300.0, 0.0, 1.0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ITERATIONS; i++) {
+		/* A 1 s stall since the last update: the worst case that
+		 * isn't clamped, and logged, as a timestamp jump */
+		spring.timestamp = msec;
+		msec += 1000;
+		update(&spring, msec);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		(end.tv_nsec - start.tv_nsec)) / ITERATIONS;
+}
+
+static void
+spring_trajectories(void *data)
+{
+	struct weston_compositor *compositor = data;
+	double b = 401 * 0.01 * 0.01;
+
+	check_trajectory(300.0, 400.0);		/* underdamped */
+	check_trajectory(1e5 * (2 - b - 2 * sqrt(1 - b)), 400.0);
+	check_trajectory(20.0, 400.0);		/* overdamped */
+	check_trajectory(1000.0, 100.0);
+
+	fprintf(stderr, "spring update after a 1 s stall: %.1f ns stepped, "
+		"%.1f ns solved\n",
+		time_updates(reference_update),
+		time_updates(weston_spring_update));
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, spring_trajectories, compositor);
+
+	return 0;
+}
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #include "weston-test-runner.h"
 
@@ -210,6 +211,182 @@ TEST_P(clip_polygon_expected_vertices, test_data)
 	}
 }
 
+TEST_P(clip_quad_rects_expected_vertices, test_data)
+{
+	struct vertex_clip_test_data *tdata = data;
+	struct clip_rect rect = {
+		BOUNDING_BOX_LEFT_X, BOUNDING_BOX_BOTTOM_Y,
+		BOUNDING_BOX_RIGHT_X, BOUNDING_BOX_TOP_Y
+	};
+	float vertices_x[8];
+	float vertices_y[8];
+	int i, n;
+
+	clip_quad_rects(&tdata->surface, 1, &rect, 1,
+			vertices_x, vertices_y, &n);
+
+	assert(n == tdata->expected.n);
+	for (i = 0; i < n; i++) {
+		assert(vertices_x[i] == tdata->expected.x[i]);
+		assert(vertices_y[i] == tdata->expected.y[i]);
+	}
+}
+
+/* What the GL renderer did for every pair of rectangles before it
+ * clipped in batches. */
+static int
+reference_clip_quad(const struct polygon8 *quad, int transformed,
+		    const struct clip_rect *rect, float *ex, float *ey)
+{
+	struct clip_context ctx;
+	struct polygon8 surf = *quad;
+	float min_x, max_x, min_y, max_y;
+	int i, n;
+
+	ctx.clip.x1 = rect->x1;
+	ctx.clip.y1 = rect->y1;
+	ctx.clip.x2 = rect->x2;
+	ctx.clip.y2 = rect->y2;
+
+	min_x = max_x = surf.x[0];
+	min_y = max_y = surf.y[0];
+	for (i = 1; i < surf.n; i++) {
+		min_x = fminf(min_x, surf.x[i]);
+		max_x = fmaxf(max_x, surf.x[i]);
+		min_y = fminf(min_y, surf.y[i]);
+		max_y = fmaxf(max_y, surf.y[i]);
+	}
+
+	if ((min_x >= ctx.clip.x2) || (max_x <= ctx.clip.x1) ||
+	    (min_y >= ctx.clip.y2) || (max_y <= ctx.clip.y1))
+		return 0;
+
+	if (!transformed)
+		return clip_simple(&ctx, &surf, ex, ey);
+
+	n = clip_transformed(&ctx, &surf, ex, ey);
+	if (n < 3)
+		return 0;
+
+	return n;
+}
+
+#define RANDOM_QUADS	2000
+#define RANDOM_RECTS	37
+
+static void
+random_quad(struct polygon8 *quad, int transformed)
+{
+	float cx, cy, w, h, a, c, s;
+	float px[4] = { -1, 1, 1, -1 };
+	float py[4] = { -1, -1, 1, 1 };
+	int i;
+
+	cx = random() % 1000;
+	cy = random() % 1000;
+	w = 1 + random() % 400;
+	h = 1 + random() % 400;
+	a = transformed ? (random() % 3600) * M_PI / 1800.0 : 0.0;
+	c = cosf(a);
+	s = sinf(a);
+
+	for (i = 0; i < 4; i++) {
+		quad->x[i] = cx + c * px[i] * w - s * py[i] * h;
+		quad->y[i] = cy + s * px[i] * w + c * py[i] * h;
+	}
+	quad->n = 4;
+}
+
+static void
+random_rects(struct clip_rect *rects, int nrects)
+{
+	int i;
+
+	for (i = 0; i < nrects; i++) {
+		rects[i].x1 = random() % 1000;
+		rects[i].y1 = random() % 1000;
+		rects[i].x2 = rects[i].x1 + 1 + random() % 300;
+		rects[i].y2 = rects[i].y1 + 1 + random() % 300;
+	}
+}
+
+TEST(clip_quad_rects_matches_single)
+{
+	struct polygon8 quad;
+	struct clip_rect rects[RANDOM_RECTS];
+	float ex[RANDOM_RECTS * 8], ey[RANDOM_RECTS * 8];
+	float rx[8], ry[8];
+	int n[RANDOM_RECTS];
+	int iter, i, k, rn, transformed;
+
+	srandom(42);
+
+	for (iter = 0; iter < RANDOM_QUADS; iter++) {
+		transformed = iter & 1;
+		random_quad(&quad, transformed);
+		random_rects(rects, RANDOM_RECTS);
+
+		clip_quad_rects(&quad, transformed, rects, RANDOM_RECTS,
+				ex, ey, n);
+
+		for (i = 0; i < RANDOM_RECTS; i++) {
+			rn = reference_clip_quad(&quad, transformed,
+						 &rects[i], rx, ry);
+			assert(n[i] == rn);
+			for (k = 0; k < rn; k++) {
+				assert(ex[i * 8 + k] == rx[k]);
+				assert(ey[i * 8 + k] == ry[k]);
+			}
+		}
+	}
+}
+
+static double
+timespec_diff_ns(const struct timespec *a, const struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+/* Fragmented damage over a rotated view: one quad against many small
+ * rectangles, most of which it misses. */
+TEST(clip_quad_rects_benchmark)
+{
+	struct polygon8 quad;
+	struct clip_rect rects[64];
+	float ex[64 * 8], ey[64 * 8];
+	int n[64];
+	struct timespec begin, end;
+	double t_single, t_batch;
+	int iter, i, total_single = 0, total_batch = 0;
+
+	srandom(7);
+	random_quad(&quad, 1);
+	random_rects(rects, 64);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (iter = 0; iter < 2000; iter++)
+		for (i = 0; i < 64; i++)
+			total_single += reference_clip_quad(&quad, 1, &rects[i],
+							    ex, ey);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t_single = timespec_diff_ns(&begin, &end);
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (iter = 0; iter < 2000; iter++) {
+		clip_quad_rects(&quad, 1, rects, 64, ex, ey, n);
+		for (i = 0; i < 64; i++)
+			total_batch += n[i];
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	t_batch = timespec_diff_ns(&begin, &end);
+
+	assert(total_single == total_batch);
+
+	fprintf(stderr, "clipping a rotated quad: %.1f ns per rect single, "
+		"%.1f ns batched\n",
+		t_single / (2000 * 64), t_batch / (2000 * 64));
+}
+
 TEST(float_difference_different)
 {
 	assert(float_difference(1.0f, 0.0f) == 1.0f);
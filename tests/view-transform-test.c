@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "../src/compositor.h"
+
+#define DEPTH		4
+#define ITERATIONS	10000
+
+struct view_tree {
+	struct weston_layer layer;
+	struct weston_transform scale;
+	struct weston_view *views[DEPTH];
+};
+
+static void
+tree_create(struct weston_compositor *compositor, struct view_tree *tree)
+{
+	struct weston_surface *surface;
+	struct weston_view *view;
+	int i;
+
+	weston_layer_init(&tree->layer, NULL);
+
+	for (i = 0; i < DEPTH; i++) {
+		surface = weston_surface_create(compositor);
+		assert(surface);
+		view = weston_view_create(surface);
+		assert(view);
+		surface->width = 200 - i * 20;
+		surface->height = 100 - i * 10;
+
+		if (i == 0) {
+			weston_layer_entry_insert(&tree->layer.view_list,
+						  &view->layer_link);
+		} else {
+			view->parent_view = tree->views[i - 1];
+			weston_view_set_transform_parent(view,
+							 tree->views[i - 1]);
+		}
+
+		weston_view_set_position(view, 10 + i, 5 + i);
+		tree->views[i] = view;
+	}
+
+	/* A scaled top level, so the children's moves are scaled too. */
+	weston_matrix_init(&tree->scale.matrix);
+	weston_matrix_scale(&tree->scale.matrix, 2.0f, 2.0f, 1.0f);
+	wl_list_insert(&tree->views[0]->geometry.transformation_list,
+		       &tree->scale.link);
+	weston_view_geometry_dirty(tree->views[0]);
+
+	for (i = 0; i < DEPTH; i++)
+		weston_view_update_transform(tree->views[i]);
+}
+
+struct view_state {
+	struct weston_matrix matrix;
+	struct weston_matrix inverse;
+	pixman_box32_t boundingbox;
+};
+
+static void
+view_state_get(struct weston_view *view, struct view_state *state)
+{
+	state->matrix = view->transform.matrix;
+	state->inverse = view->transform.inverse;
+	state->boundingbox = *pixman_region32_extents(&view->transform.boundingbox);
+}
+
+static void
+view_state_check(const struct view_state *a, const struct view_state *b)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		assert(fabsf(a->matrix.d[i] - b->matrix.d[i]) < 1e-3);
+		assert(fabsf(a->inverse.d[i] - b->inverse.d[i]) < 1e-3);
+	}
+
+	assert(a->boundingbox.x1 == b->boundingbox.x1);
+	assert(a->boundingbox.y1 == b->boundingbox.y1);
+	assert(a->boundingbox.x2 == b->boundingbox.x2);
+	assert(a->boundingbox.y2 == b->boundingbox.y2);
+}
+
+/* Move one view of the tree, then compare every view's translated
+ * transform against one rebuilt from scratch. */
+static void
+check_move(struct view_tree *tree, int index, float x, float y)
+{
+	struct view_state moved[DEPTH], rebuilt;
+	int i;
+
+	weston_view_set_position(tree->views[index], x, y);
+	for (i = 0; i < DEPTH; i++) {
+		weston_view_update_transform(tree->views[i]);
+		view_state_get(tree->views[i], &moved[i]);
+	}
+
+	weston_view_geometry_dirty(tree->views[0]);
+	for (i = 0; i < DEPTH; i++) {
+		weston_view_update_transform(tree->views[i]);
+		view_state_get(tree->views[i], &rebuilt);
+		view_state_check(&moved[i], &rebuilt);
+	}
+}
+
+static double
+bench_moves(struct view_tree *tree, int rebuild)
+{
+	struct timespec begin, end;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < ITERATIONS; i++) {
+		if (rebuild)
+			weston_view_geometry_dirty(tree->views[0]);
+		weston_view_set_position(tree->views[0],
+					 100 + (i & 63), 50 + (i & 31));
+		for (j = 0; j < DEPTH; j++)
+			weston_view_update_transform(tree->views[j]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - begin.tv_sec) * 1e9 +
+		(end.tv_nsec - begin.tv_nsec)) / ITERATIONS;
+}
+
+static void
+view_transform(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct view_tree tree;
+	double fast, slow;
+
+	tree_create(compositor, &tree);
+
+	/* Whole pixel moves of the top level and of a child. */
+	check_move(&tree, 0, 137, 59);
+	check_move(&tree, 0, -20, 300);
+	check_move(&tree, 2, 30, 41);
+
+	/* Moves the scale turns into fractions go the slow way. */
+	tree.scale.matrix.d[0] = 1.5f;
+	tree.scale.matrix.d[5] = 1.5f;
+	weston_view_geometry_dirty(tree.views[0]);
+	check_move(&tree, 1, 7, 3);
+
+	/* So do fractional top level moves. */
+	check_move(&tree, 0, 40.5, 12.25);
+
+	/* And views under a layer offset. */
+	weston_layer_set_offset(&tree.layer, 0, 240);
+	check_move(&tree, 0, 64, 32);
+	weston_layer_set_offset(&tree.layer, 0, 0);
+	check_move(&tree, 0, 66, 30);
+
+	tree.scale.matrix.d[0] = 2.0f;
+	tree.scale.matrix.d[5] = 2.0f;
+	weston_view_geometry_dirty(tree.views[0]);
+
+	fast = bench_moves(&tree, 0);
+	slow = bench_moves(&tree, 1);
+	fprintf(stderr, "moving a %d deep view tree: %.0f ns translated, "
+		"%.0f ns rebuilt\n", DEPTH, fast, slow);
+
+	weston_layer_entry_remove(&tree.views[0]->layer_link);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, view_transform, compositor);
+
+	return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "weston-test-client-helper.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <xcb/xcb.h>
+
+/* Pasting a large Wayland selection into an X client goes through the
+ * window manager's INCR transfer with bounded, growing chunks. */
+
+#define TRANSFER_SIZE (100 * 1024 * 1024)
+#define MIME_TYPE "text/plain;charset=utf-8"
+
+static unsigned char
+pattern(size_t offset)
+{
+	return 'a' + offset % 23;
+}
+
+static xcb_atom_t
+intern_atom(xcb_connection_t *c, const char *name)
+{
+	xcb_intern_atom_reply_t *reply;
+	xcb_atom_t atom;
+
+	reply = xcb_intern_atom_reply(c,
+				      xcb_intern_atom(c, 0, strlen(name),
+						      name),
+				      NULL);
+	assert(reply);
+	atom = reply->atom;
+	free(reply);
+
+	return atom;
+}
+
+/* Takes the property off our window and checks it continues the
+ * pattern.  Returns the number of bytes, or -1 for an INCR header. */
+static int
+take_property(xcb_connection_t *c, xcb_window_t win, xcb_atom_t property,
+	      xcb_atom_t incr, size_t *received)
+{
+	xcb_get_property_reply_t *reply;
+	unsigned char *data;
+	int i, len;
+
+	reply = xcb_get_property_reply(c,
+				       xcb_get_property(c, 1, win, property,
+							XCB_GET_PROPERTY_TYPE_ANY,
+							0, 0x1fffffff),
+				       NULL);
+	assert(reply);
+
+	if (reply->type == incr) {
+		free(reply);
+		return -1;
+	}
+
+	data = xcb_get_property_value(reply);
+	len = xcb_get_property_value_length(reply);
+	for (i = 0; i < len; i++)
+		assert(data[i] == pattern(*received + i));
+	*received += len;
+	free(reply);
+
+	return len;
+}
+
+static void
+x11_paste(void)
+{
+	xcb_connection_t *c;
+	xcb_screen_t *screen;
+	xcb_window_t win, owner;
+	xcb_get_selection_owner_reply_t *owner_reply;
+	xcb_generic_event_t *event;
+	xcb_selection_notify_event_t *selection_notify;
+	xcb_property_notify_event_t *property_notify;
+	xcb_atom_t clipboard, utf8_string, incr, property;
+	uint32_t values[1];
+	size_t received = 0;
+	int i, in_incr = 0, done = 0;
+
+	c = xcb_connect(NULL, NULL);
+	assert(!xcb_connection_has_error(c));
+	screen = xcb_setup_roots_iterator(xcb_get_setup(c)).data;
+
+	clipboard = intern_atom(c, "CLIPBOARD");
+	utf8_string = intern_atom(c, "UTF8_STRING");
+	incr = intern_atom(c, "INCR");
+	property = intern_atom(c, "WESTON_TEST_PASTE");
+
+	win = xcb_generate_id(c);
+	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_create_window(c, XCB_COPY_FROM_PARENT, win, screen->root,
+			  0, 0, 10, 10, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			  screen->root_visual, XCB_CW_EVENT_MASK, values);
+
+	/* Wait for the window manager to take over the Wayland selection */
+	for (i = 0, owner = XCB_WINDOW_NONE; owner == XCB_WINDOW_NONE; i++) {
+		assert(i < 500);
+		if (i > 0)
+			usleep(10000);
+		owner_reply =
+			xcb_get_selection_owner_reply(c,
+				xcb_get_selection_owner(c, clipboard), NULL);
+		assert(owner_reply);
+		owner = owner_reply->owner;
+		free(owner_reply);
+	}
+
+	xcb_convert_selection(c, win, clipboard, utf8_string, property,
+			      XCB_TIME_CURRENT_TIME);
+	xcb_flush(c);
+
+	while (!done && (event = xcb_wait_for_event(c))) {
+		switch (event->response_type & ~0x80) {
+		case XCB_SELECTION_NOTIFY:
+			selection_notify =
+				(xcb_selection_notify_event_t *) event;
+			assert(selection_notify->property == property);
+			if (take_property(c, win, property, incr,
+					  &received) < 0)
+				in_incr = 1;
+			else
+				done = 1;
+			break;
+		case XCB_PROPERTY_NOTIFY:
+			property_notify = (xcb_property_notify_event_t *) event;
+			if (in_incr &&
+			    property_notify->atom == property &&
+			    property_notify->state == XCB_PROPERTY_NEW_VALUE &&
+			    take_property(c, win, property, incr,
+					  &received) == 0)
+				done = 1;
+			break;
+		}
+		free(event);
+		xcb_flush(c);
+	}
+
+	assert(done && in_incr);
+	assert(received == TRANSFER_SIZE);
+
+	xcb_destroy_window(c, win);
+	xcb_disconnect(c);
+}
+
+static void
+data_source_target(void *data, struct wl_data_source *source,
+		   const char *mime_type)
+{
+}
+
+static void
+data_source_send(void *data, struct wl_data_source *source,
+		 const char *mime_type, int32_t fd)
+{
+	int *sent = data;
+	char buffer[65536];
+	size_t offset = 0, i;
+	ssize_t len, n;
+
+	assert(strcmp(mime_type, MIME_TYPE) == 0);
+	fcntl(fd, F_SETFL, 0);
+
+	while (offset < TRANSFER_SIZE) {
+		len = sizeof buffer;
+		if (len > TRANSFER_SIZE - offset)
+			len = TRANSFER_SIZE - offset;
+		for (i = 0; i < (size_t) len; i++)
+			buffer[i] = pattern(offset + i);
+
+		for (i = 0; i < (size_t) len; i += n) {
+			n = write(fd, buffer + i, len - i);
+			assert(n > 0 || (n == -1 && errno == EINTR));
+			if (n < 0)
+				n = 0;
+		}
+		offset += len;
+	}
+
+	close(fd);
+	*sent = 1;
+}
+
+static void
+data_source_cancelled(void *data, struct wl_data_source *source)
+{
+}
+
+static const struct wl_data_source_listener data_source_listener = {
+	data_source_target,
+	data_source_send,
+	data_source_cancelled
+};
+
+TEST(xwayland_selection_100mb)
+{
+	struct client *client;
+	struct global *global;
+	struct wl_data_device_manager *manager = NULL;
+	struct wl_data_device *device;
+	struct wl_data_source *source;
+	pid_t pid;
+	int status, sent = 0;
+
+	client = client_create(100, 100, 100, 100);
+	assert(client);
+
+	wl_list_for_each(global, &client->global_list, link)
+		if (strcmp(global->interface, "wl_data_device_manager") == 0)
+			manager = wl_registry_bind(client->wl_registry,
+						   global->name,
+						   &wl_data_device_manager_interface,
+						   1);
+	assert(manager);
+
+	source = wl_data_device_manager_create_data_source(manager);
+	wl_data_source_add_listener(source, &data_source_listener, &sent);
+	wl_data_source_offer(source, MIME_TYPE);
+	device = wl_data_device_manager_get_data_device(manager,
+						       client->input->wl_seat);
+	wl_data_device_set_selection(device, source, 0);
+	client_roundtrip(client);
+
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		x11_paste();
+		_exit(EXIT_SUCCESS);
+	}
+
+	while (!sent)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
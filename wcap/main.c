@@ -195,14 +195,15 @@ usage(int exit_code)
 {
 	fprintf(stderr, "usage: wcap-decode "
 		"[--help] [--yuv4mpeg2] [--frame=<frame>] [--all] \n"
-		"\t[--rate=<num:denom>] <wcap file>\n\n"
+		"\t[--rate=<num:denom>] <wcap file | ->\n\n"
 		"\t--help\t\t\tthis help text\n"
 		"\t--yuv4mpeg2\t\tdump wcap file to stdout in yuv4mpeg2 format\n"
 		"\t--yuv4mpeg2-444\t\tdump wcap file to stdout in yuv4mpeg2 444 format\n"
 		"\t--frame=<frame>\t\twrite out the given frame number as png\n"
 		"\t--all\t\t\twrite all frames as pngs\n"
 		"\t--rate=<num:denom>\treplay frame rate for yuv4mpeg2,\n"
-		"\t\t\t\tspecified as an integer fraction\n\n");
+		"\t\t\t\tspecified as an integer fraction\n\n"
+		"\tPass - as the file name to decode a live stream from stdin.\n\n");
 
 	exit(exit_code);
 }
@@ -233,7 +234,7 @@ int main(int argc, char *argv[])
 			;
 		} else if (strcmp(argv[i], "--") == 0) {
 			break;
-		} else if (argv[i][0] == '-') {
+		} else if (argv[i][0] == '-' && argv[i][1] != '\0') {
 			fprintf(stderr,
 				"unknown option or invalid argument: %s\n", argv[i]);
 			usage(EXIT_FAILURE);
@@ -26,18 +26,62 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/mman.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include <cairo.h>
 
 #include "wcap-decode.h"
 
-static void
+/* Make sure at least size bytes are available at decoder->p.  For mapped
+ * files that's just a bounds check; for streams (stdin, pipes, sockets)
+ * we move the unconsumed tail to the front of the buffer and read until
+ * enough data has arrived. */
+static int
+wcap_decoder_ensure(struct wcap_decoder *decoder, size_t size)
+{
+	size_t avail = (char *) decoder->end - (char *) decoder->p;
+	char *buf;
+	ssize_t len;
+
+	if (avail >= size)
+		return 1;
+	if (!decoder->stream)
+		return 0;
+
+	if (size > decoder->size) {
+		buf = malloc(size);
+		if (buf == NULL)
+			return 0;
+		memcpy(buf, decoder->p, avail);
+		free(decoder->map);
+		decoder->map = buf;
+		decoder->size = size;
+	} else {
+		memmove(decoder->map, decoder->p, avail);
+	}
+
+	decoder->p = decoder->map;
+	decoder->end = (char *) decoder->map + avail;
+
+	while (avail < size) {
+		len = read(decoder->fd, decoder->end, decoder->size - avail);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			return 0;
+		avail += len;
+		decoder->end = (char *) decoder->end + len;
+	}
+
+	return 1;
+}
+
+static int
 wcap_decoder_decode_rectangle(struct wcap_decoder *decoder,
 			      struct wcap_rectangle *rect)
 {
@@ -50,6 +94,13 @@ wcap_decoder_decode_rectangle(struct wcap_decoder *decoder,
 	x = rect->x1;
 	i = 0;
 	while (i < count) {
+		if ((char *) decoder->end - (char *) p < 4) {
+			decoder->p = p;
+			if (!wcap_decoder_ensure(decoder, 4))
+				return -1;
+			p = decoder->p;
+		}
+
 		v = *p++;
 		l = v >> 24;
 		if (l < 0xe0) {
@@ -80,26 +131,46 @@ wcap_decoder_decode_rectangle(struct wcap_decoder *decoder,
 		       i, count);
 
 	decoder->p = p;
+
+	return 0;
 }
 
 int
 wcap_decoder_get_frame(struct wcap_decoder *decoder)
 {
 	struct wcap_rectangle *rects;
-	struct wcap_frame_header *header;
+	struct wcap_frame_header header;
 	uint32_t i;
+	size_t size;
 
-	if (decoder->p == decoder->end)
+	if (!wcap_decoder_ensure(decoder, sizeof header))
 		return 0;
 
-	header = decoder->p;
-	decoder->msecs = header->msecs;
-	decoder->count++;
+	memcpy(&header, decoder->p, sizeof header);
+	decoder->p = (char *) decoder->p + sizeof header;
+	decoder->msecs = header.msecs;
+
+	/* Copy the rectangles out, the stream buffer gets recycled while
+	 * we decode the pixel data following them. */
+	size = header.nrects * sizeof *rects;
+	if (!wcap_decoder_ensure(decoder, size))
+		return 0;
+	if (header.nrects > decoder->rects_size) {
+		rects = realloc(decoder->rects, size);
+		if (rects == NULL)
+			return 0;
+		decoder->rects = rects;
+		decoder->rects_size = header.nrects;
+	}
+	rects = decoder->rects;
+	memcpy(rects, decoder->p, size);
+	decoder->p = (char *) decoder->p + size;
 
-	rects = (void *) (header + 1);
-	decoder->p = (uint32_t *) (rects + header->nrects);
-	for (i = 0; i < header->nrects; i++)
-		wcap_decoder_decode_rectangle(decoder, &rects[i]);
+	for (i = 0; i < header.nrects; i++)
+		if (wcap_decoder_decode_rectangle(decoder, &rects[i]) < 0)
+			return 0;
+
+	decoder->count++;
 
 	return 1;
 }
@@ -108,7 +179,7 @@ struct wcap_decoder *
 wcap_decoder_create(const char *filename)
 {
 	struct wcap_decoder *decoder;
-	struct wcap_header *header;
+	struct wcap_header header;
 	int frame_size;
 	struct stat buf;
 
@@ -116,34 +187,65 @@ wcap_decoder_create(const char *filename)
 	if (decoder == NULL)
 		return NULL;
 
-	decoder->fd = open(filename, O_RDONLY);
+	if (strcmp(filename, "-") == 0)
+		decoder->fd = dup(STDIN_FILENO);
+	else
+		decoder->fd = open(filename, O_RDONLY);
 	if (decoder->fd == -1) {
 		free(decoder);
 		return NULL;
 	}
 
-	fstat(decoder->fd, &buf);
-	decoder->size = buf.st_size;
-	decoder->map = mmap(NULL, decoder->size,
-			    PROT_READ, MAP_PRIVATE, decoder->fd, 0);
-	if (decoder->map == MAP_FAILED) {
-		fprintf(stderr, "mmap failed\n");
-		free(decoder);
+	decoder->rects = NULL;
+	decoder->rects_size = 0;
+	decoder->frame = NULL;
+
+	/* Regular files are mapped in one go; anything else (stdin, a
+	 * FIFO fed by the compositor recorder) is decoded as it streams
+	 * in. */
+	if (fstat(decoder->fd, &buf) == 0 && S_ISREG(buf.st_mode)) {
+		decoder->stream = 0;
+		decoder->size = buf.st_size;
+		decoder->map = mmap(NULL, decoder->size,
+				    PROT_READ, MAP_PRIVATE, decoder->fd, 0);
+		if (decoder->map == MAP_FAILED) {
+			fprintf(stderr, "mmap failed\n");
+			close(decoder->fd);
+			free(decoder);
+			return NULL;
+		}
+	} else {
+		decoder->stream = 1;
+		decoder->size = WCAP_STREAM_BUFFER_SIZE;
+		decoder->map = malloc(decoder->size);
+		if (decoder->map == NULL) {
+			close(decoder->fd);
+			free(decoder);
+			return NULL;
+		}
+	}
+
+	decoder->p = decoder->map;
+	decoder->end = decoder->stream ?
+		decoder->map : (char *) decoder->map + decoder->size;
+
+	if (!wcap_decoder_ensure(decoder, sizeof header)) {
+		fprintf(stderr, "short wcap header\n");
+		wcap_decoder_destroy(decoder);
 		return NULL;
 	}
-		
-	header = decoder->map;
-	decoder->format = header->format;
+
+	memcpy(&header, decoder->p, sizeof header);
+	decoder->p = (char *) decoder->p + sizeof header;
+	decoder->format = header.format;
 	decoder->count = 0;
-	decoder->width = header->width;
-	decoder->height = header->height;
-	decoder->p = header + 1;
-	decoder->end = decoder->map + decoder->size;
+	decoder->width = header.width;
+	decoder->height = header.height;
 
-	frame_size = header->width * header->height * 4;
+	frame_size = header.width * header.height * 4;
 	decoder->frame = malloc(frame_size);
 	if (decoder->frame == NULL) {
-		free(decoder);
+		wcap_decoder_destroy(decoder);
 		return NULL;
 	}
 	memset(decoder->frame, 0, frame_size);
@@ -154,8 +256,12 @@ wcap_decoder_create(const char *filename)
 void
 wcap_decoder_destroy(struct wcap_decoder *decoder)
 {
-	munmap(decoder->map, decoder->size);
+	if (decoder->stream)
+		free(decoder->map);
+	else
+		munmap(decoder->map, decoder->size);
 	close(decoder->fd);
+	free(decoder->rects);
 	free(decoder->frame);
 	free(decoder);
 }
@@ -45,10 +45,15 @@ struct wcap_rectangle {
 	int32_t x1, y1, x2, y2;
 };
 
+#define WCAP_STREAM_BUFFER_SIZE	(64 * 1024)
+
 struct wcap_decoder {
 	int fd;
+	int stream;
 	size_t size;
 	void *map, *p, *end;
+	struct wcap_rectangle *rects;
+	uint32_t rects_size;
 	uint32_t *frame;
 	uint32_t format;
 	uint32_t msecs;
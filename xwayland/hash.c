@@ -39,66 +39,33 @@
 
 #include "hash.h"
 
+/*
+ * Robin Hood hashing with linear probing over a power-of-two table.
+ * Each entry remembers how far it sits from its home slot; an insert
+ * that meets an entry closer to home than itself takes that slot and
+ * carries the displaced entry on.  That keeps probe sequences short and
+ * sorted, so a lookup can stop as soon as it sees an entry closer to
+ * home than the key would be.  Removal shifts the rest of the probe
+ * sequence back one slot instead of leaving a tombstone, so the table
+ * never needs rehashing in place and churn can't degrade it.
+ */
+
 struct hash_entry {
 	uint32_t hash;
+	uint32_t distance;
 	void *data;
 };
 
 struct hash_table {
 	struct hash_entry *table;
 	uint32_t size;
-	uint32_t rehash;
+	uint32_t shift;
 	uint32_t max_entries;
-	uint32_t size_index;
+	uint32_t min_entries;
 	uint32_t entries;
-	uint32_t deleted_entries;
 };
 
-#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
-
-/*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
-
-static const uint32_t deleted_data;
-
-static const struct {
-   uint32_t max_entries, size, rehash;
-} hash_sizes[] = {
-    { 2,		5,		3	  },
-    { 4,		7,		5	  },
-    { 8,		13,		11	  },
-    { 16,		19,		17	  },
-    { 32,		43,		41        },
-    { 64,		73,		71        },
-    { 128,		151,		149       },
-    { 256,		283,		281       },
-    { 512,		571,		569       },
-    { 1024,		1153,		1151      },
-    { 2048,		2269,		2267      },
-    { 4096,		4519,		4517      },
-    { 8192,		9013,		9011      },
-    { 16384,		18043,		18041     },
-    { 32768,		36109,		36107     },
-    { 65536,		72091,		72089     },
-    { 131072,		144409,		144407    },
-    { 262144,		288361,		288359    },
-    { 524288,		576883,		576881    },
-    { 1048576,		1153459,	1153457   },
-    { 2097152,		2307163,	2307161   },
-    { 4194304,		4613893,	4613891   },
-    { 8388608,		9227641,	9227639   },
-    { 16777216,		18455029,	18455027  },
-    { 33554432,		36911011,	36911009  },
-    { 67108864,		73819861,	73819859  },
-    { 134217728,	147639589,	147639587 },
-    { 268435456,	295279081,	295279079 },
-    { 536870912,	590559793,	590559791 },
-    { 1073741824,	1181116273,	1181116271},
-    { 2147483648ul,	2362232233ul,	2362232231ul}
-};
+#define HASH_TABLE_MIN_SIZE 8
 
 static int
 entry_is_free(struct hash_entry *entry)
@@ -106,16 +73,35 @@ entry_is_free(struct hash_entry *entry)
 	return entry->data == NULL;
 }
 
-static int
-entry_is_deleted(struct hash_entry *entry)
+/* X resource ids are mostly sequential, so spread them with a
+ * multiplicative hash and take the top bits. */
+static uint32_t
+hash_table_home(struct hash_table *ht, uint32_t hash)
 {
-	return entry->data == &deleted_data;
+	return (hash * 2654435769u) >> ht->shift;
 }
 
 static int
-entry_is_present(struct hash_entry *entry)
+hash_table_set_size(struct hash_table *ht, uint32_t size)
 {
-	return entry->data != NULL && entry->data != &deleted_data;
+	struct hash_entry *table;
+	uint32_t shift = 32;
+
+	table = calloc(size, sizeof(*table));
+	if (table == NULL)
+		return -1;
+
+	while ((1u << (32 - shift)) < size)
+		shift--;
+
+	ht->table = table;
+	ht->size = size;
+	ht->shift = shift;
+	ht->max_entries = size - size / 8;
+	ht->min_entries = size > HASH_TABLE_MIN_SIZE ? size / 8 : 0;
+	ht->entries = 0;
+
+	return 0;
 }
 
 struct hash_table *
@@ -127,15 +113,7 @@ hash_table_create(void)
 	if (ht == NULL)
 		return NULL;
 
-	ht->size_index = 0;
-	ht->size = hash_sizes[ht->size_index].size;
-	ht->rehash = hash_sizes[ht->size_index].rehash;
-	ht->max_entries = hash_sizes[ht->size_index].max_entries;
-	ht->table = calloc(ht->size, sizeof(*ht->table));
-	ht->entries = 0;
-	ht->deleted_entries = 0;
-
-	if (ht->table == NULL) {
+	if (hash_table_set_size(ht, HASH_TABLE_MIN_SIZE) < 0) {
 		free(ht);
 		return NULL;
 	}
@@ -162,31 +140,31 @@ hash_table_destroy(struct hash_table *ht)
  * Returns NULL if no entry is found.  Note that the data pointer may be
  * modified by the user.
  */
-static void *
+static struct hash_entry *
 hash_table_search(struct hash_table *ht, uint32_t hash)
 {
-	uint32_t hash_address;
-
-	hash_address = hash % ht->size;
-	do {
-		uint32_t double_hash;
+	struct hash_entry *entry;
+	uint32_t mask = ht->size - 1;
+	uint32_t i, distance;
 
-		struct hash_entry *entry = ht->table + hash_address;
+	i = hash_table_home(ht, hash);
+	for (distance = 0; ; distance++) {
+		entry = ht->table + i;
 
-		if (entry_is_free(entry)) {
+		if (entry_is_free(entry) || entry->distance < distance)
 			return NULL;
-		} else if (entry_is_present(entry) && entry->hash == hash) {
+		if (entry->hash == hash)
 			return entry;
-		}
-
-		double_hash = 1 + hash % ht->rehash;
-
-		hash_address = (hash_address + double_hash) % ht->size;
-	} while (hash_address != hash % ht->size);
 
-	return NULL;
+		i = (i + 1) & mask;
+	}
 }
 
+/**
+ * Calls func for every entry in the table.
+ *
+ * func must not insert into or remove from the table.
+ */
 void
 hash_table_for_each(struct hash_table *ht,
 		    hash_table_iterator_func_t func, void *data)
@@ -196,7 +174,7 @@ hash_table_for_each(struct hash_table *ht,
 
 	for (i = 0; i < ht->size; i++) {
 		entry = ht->table + i;
-		if (entry_is_present(entry))
+		if (!entry_is_free(entry))
 			func(entry->data, data);
 	}
 }
@@ -213,42 +191,65 @@ hash_table_lookup(struct hash_table *ht, uint32_t hash)
 	return NULL;
 }
 
+/* Places a key known not to be in the table; there must be a free slot. */
 static void
-hash_table_rehash(struct hash_table *ht, unsigned int new_size_index)
+hash_table_place(struct hash_table *ht, uint32_t hash, void *data)
 {
-	struct hash_table old_ht;
-	struct hash_entry *table, *entry;
+	struct hash_entry entry, tmp, *slot;
+	uint32_t mask = ht->size - 1;
+	uint32_t i;
 
-	if (new_size_index >= ARRAY_SIZE(hash_sizes))
-		return;
+	entry.hash = hash;
+	entry.distance = 0;
+	entry.data = data;
 
-	table = calloc(hash_sizes[new_size_index].size, sizeof(*ht->table));
-	if (table == NULL)
-		return;
+	i = hash_table_home(ht, hash);
+	for (;;) {
+		slot = ht->table + i;
 
-	old_ht = *ht;
+		if (entry_is_free(slot)) {
+			*slot = entry;
+			break;
+		}
 
-	ht->table = table;
-	ht->size_index = new_size_index;
-	ht->size = hash_sizes[ht->size_index].size;
-	ht->rehash = hash_sizes[ht->size_index].rehash;
-	ht->max_entries = hash_sizes[ht->size_index].max_entries;
-	ht->entries = 0;
-	ht->deleted_entries = 0;
+		if (slot->distance < entry.distance) {
+			tmp = *slot;
+			*slot = entry;
+			entry = tmp;
+		}
+
+		i = (i + 1) & mask;
+		entry.distance++;
+	}
+
+	ht->entries++;
+}
+
+static int
+hash_table_resize(struct hash_table *ht, uint32_t size)
+{
+	struct hash_table old_ht;
+	struct hash_entry *entry;
+
+	old_ht = *ht;
+	if (hash_table_set_size(ht, size) < 0)
+		return -1;
 
 	for (entry = old_ht.table;
 	     entry != old_ht.table + old_ht.size;
 	     entry++) {
-		if (entry_is_present(entry)) {
-			hash_table_insert(ht, entry->hash, entry->data);
-		}
+		if (!entry_is_free(entry))
+			hash_table_place(ht, entry->hash, entry->data);
 	}
 
 	free(old_ht.table);
+
+	return 0;
 }
 
 /**
- * Inserts the data with the given hash into the table.
+ * Inserts the data with the given hash into the table, replacing the
+ * data already stored under that hash, if any.
  *
  * Note that insertion may rearrange the table on a resize or rehash,
  * so previously found hash_entries are no longer valid after this function.
@@ -256,54 +257,60 @@ hash_table_rehash(struct hash_table *ht, unsigned int new_size_index)
 int
 hash_table_insert(struct hash_table *ht, uint32_t hash, void *data)
 {
-	uint32_t hash_address;
+	struct hash_entry *entry;
 
-	if (ht->entries >= ht->max_entries) {
-		hash_table_rehash(ht, ht->size_index + 1);
-	} else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-		hash_table_rehash(ht, ht->size_index);
+	entry = hash_table_search(ht, hash);
+	if (entry != NULL) {
+		entry->data = data;
+		return 0;
 	}
 
-	hash_address = hash % ht->size;
-	do {
-		struct hash_entry *entry = ht->table + hash_address;
-		uint32_t double_hash;
-
-		if (!entry_is_present(entry)) {
-			if (entry_is_deleted(entry))
-				ht->deleted_entries--;
-			entry->hash = hash;
-			entry->data = data;
-			ht->entries++;
-			return 0;
-		}
-
-		double_hash = 1 + hash % ht->rehash;
+	/* A table that can't grow keeps filling up, but always leaves one
+	 * free slot to end the probe sequences. */
+	if (ht->entries >= ht->max_entries &&
+	    (ht->size * 2 == 0 || hash_table_resize(ht, ht->size * 2) < 0) &&
+	    ht->entries + 1 >= ht->size)
+		return -1;
 
-		hash_address = (hash_address + double_hash) % ht->size;
-	} while (hash_address != hash % ht->size);
+	hash_table_place(ht, hash, data);
 
-	/* We could hit here if a required resize failed. An unchecked-malloc
-	 * application could ignore this result.
-	 */
-	return -1;
+	return 0;
 }
 
 /**
  * This function deletes the given hash table entry.
  *
- * Note that deletion doesn't otherwise modify the table, so an iteration over
- * the table deleting entries is safe.
+ * The entries following it in its probe sequence move back one slot, and
+ * a table that drops below an eighth full shrinks, so removing entries
+ * while iterating over the table is not allowed.
  */
 void
 hash_table_remove(struct hash_table *ht, uint32_t hash)
 {
-	struct hash_entry *entry;
+	struct hash_entry *entry, *next;
+	uint32_t mask = ht->size - 1;
+	uint32_t i;
 
 	entry = hash_table_search(ht, hash);
-	if (entry != NULL) {
-		entry->data = (void *) &deleted_data;
-		ht->entries--;
-		ht->deleted_entries++;
+	if (entry == NULL)
+		return;
+
+	i = entry - ht->table;
+	for (;;) {
+		next = ht->table + ((i + 1) & mask);
+		if (entry_is_free(next) || next->distance == 0)
+			break;
+
+		ht->table[i] = *next;
+		ht->table[i].distance--;
+		i = (i + 1) & mask;
 	}
+
+	ht->table[i].data = NULL;
+	ht->table[i].distance = 0;
+	ht->entries--;
+
+	/* Failing to shrink is harmless. */
+	if (ht->entries < ht->min_entries)
+		hash_table_resize(ht, ht->size / 2);
 }
@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <time.h>
 
 #include "xwayland.h"
 
@@ -45,6 +46,7 @@ handle_sigusr1(int signal_number, void *data)
 	 * this came from Xwayland.*/
 	wxs->wm = weston_wm_create(wxs, wxs->wm_fd);
 	wl_event_source_remove(wxs->sigusr1_source);
+	wxs->sigusr1_source = NULL;
 
 	return 1;
 }
@@ -68,6 +70,12 @@ weston_xserver_handle_event(int listen_fd, uint32_t mask, void *data)
 		return 1;
 	}
 
+	/* Xwayland raises SIGUSR1 once it is ready for the WM; listen
+	 * again on every start, since the handler stops listening. */
+	wxs->sigusr1_source = wl_event_loop_add_signal(wxs->loop, SIGUSR1,
+						       handle_sigusr1, wxs);
+	clock_gettime(CLOCK_MONOTONIC, &wxs->spawn_time);
+
 	wxs->process.pid = fork();
 	switch (wxs->process.pid) {
 	case 0:
@@ -142,6 +150,8 @@ weston_xserver_handle_event(int listen_fd, uint32_t mask, void *data)
 
 	case -1:
 		weston_log( "failed to fork\n");
+		wl_event_source_remove(wxs->sigusr1_source);
+		wxs->sigusr1_source = NULL;
 		break;
 	}
 
@@ -199,6 +209,10 @@ weston_xserver_cleanup(struct weston_process *process, int status)
 		 * xserver interface, shut down and don't try
 		 * again. */
 		weston_log("xserver crashing too fast: %d\n", status);
+		if (wxs->sigusr1_source) {
+			wl_event_source_remove(wxs->sigusr1_source);
+			wxs->sigusr1_source = NULL;
+		}
 		weston_xserver_shutdown(wxs);
 	}
 }
@@ -341,6 +355,7 @@ weston_xserver_destroy(struct wl_listener *l, void *data)
 	if (wxs->loop)
 		weston_xserver_shutdown(wxs);
 
+	weston_wm_cursor_cache_destroy(wxs->cursor_cache);
 	free(wxs);
 }
 
@@ -404,8 +419,6 @@ module_init(struct weston_compositor *compositor,
 				     WL_EVENT_READABLE,
 				     weston_xserver_handle_event, wxs);
 
-	wxs->sigusr1_source = wl_event_loop_add_signal(wxs->loop, SIGUSR1,
-						       handle_sigusr1, wxs);
 	wxs->destroy_listener.notify = weston_xserver_destroy;
 	wl_signal_add(&compositor->destroy_signal, &wxs->destroy_listener);
 
@@ -26,6 +26,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "xwayland.h"
 
@@ -41,6 +42,8 @@ writable_callback(int fd, uint32_t mask, void *data)
 		wm->property_start;
 
 	len = write(fd, property + wm->property_start, remainder);
+	if (len == -1 && errno == EAGAIN)
+		return 1;
 	if (len == -1) {
 		free(wm->property_reply);
 		wm->property_reply = NULL;
@@ -51,10 +54,6 @@ writable_callback(int fd, uint32_t mask, void *data)
 		return 1;
 	}
 
-	weston_log("wrote %d (chunk size %d) of %d bytes\n",
-		wm->property_start + len,
-		len, xcb_get_property_value_length(wm->property_reply));
-
 	wm->property_start += len;
 	if (len == remainder) {
 		free(wm->property_reply);
@@ -255,7 +254,12 @@ weston_wm_handle_selection_notify(struct weston_wm *wm,
 	}
 }
 
-static const size_t incr_chunk_size = 64 * 1024;
+/* Data from a Wayland source is handed to X clients in chunks that
+ * start at INCR_CHUNK_MIN and double whenever the source fills one
+ * before the requestor has taken the previous one, up to what a single
+ * ChangeProperty request can carry.  At most one chunk is buffered. */
+#define INCR_CHUNK_MIN (64 * 1024)
+#define INCR_CHUNK_MAX (4 * 1024 * 1024)
 
 static void
 weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
@@ -341,26 +345,33 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 	void *p;
 
 	current = wm->source_data.size;
-	if (wm->source_data.size < incr_chunk_size)
-		p = wl_array_add(&wm->source_data, incr_chunk_size);
-	else
-		p = (char *) wm->source_data.data + wm->source_data.size;
-	available = wm->source_data.alloc - current;
+	if (wm->source_data.alloc < wm->incr_chunk_size &&
+	    !wl_array_add(&wm->source_data, wm->incr_chunk_size - current)) {
+		weston_log("out of memory for selection data\n");
+		len = -1;
+	} else {
+		p = (char *) wm->source_data.data + current;
+		available = wm->incr_chunk_size - current;
+
+		len = read(fd, p, available);
+		if (len == -1 && errno == EAGAIN) {
+			wm->source_data.size = current;
+			return 1;
+		}
+		if (len == -1)
+			weston_log("read error from data source: %m\n");
+	}
 
-	len = read(fd, p, available);
 	if (len == -1) {
-		weston_log("read error from data source: %m\n");
 		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
 		wl_event_source_remove(wm->property_source);
 		close(fd);
 		wl_array_release(&wm->source_data);
+		return 1;
 	}
 
-	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
-		len, available, mask, len, (char *) p);
-
 	wm->source_data.size = current + len;
-	if (wm->source_data.size >= incr_chunk_size) {
+	if (wm->source_data.size >= wm->incr_chunk_size) {
 		if (!wm->incr) {
 			weston_log("got %zu bytes, starting incr\n",
 				wm->source_data.size);
@@ -371,7 +382,7 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 					    wm->selection_request.property,
 					    wm->atom.incr,
 					    32, /* format */
-					    1, &incr_chunk_size);
+					    1, &wm->incr_chunk_size);
 			wm->selection_property_set = 1;
 			wm->flush_property_on_delete = 1;
 			wl_event_source_remove(wm->property_source);
@@ -415,9 +426,6 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		wl_event_source_remove(wm->property_source);
 		close(wm->data_source_fd);
 		wm->data_source_fd = -1;
-		close(fd);
-	} else {
-		weston_log("nothing happened, buffered the bytes\n");
 	}
 
 	return 1;
@@ -437,6 +445,7 @@ weston_wm_send_data(struct weston_wm *wm, xcb_atom_t target, const char *mime_ty
 	}
 
 	wl_array_init(&wm->source_data);
+	wm->incr_chunk_size = INCR_CHUNK_MIN;
 	wm->selection_target = target;
 	wm->data_source_fd = p[0];
 	wm->property_source = wl_event_loop_add_fd(wm->server->loop,
@@ -464,6 +473,10 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 		wm->flush_property_on_delete = 0;
 		length = weston_wm_flush_source_data(wm);
 
+		if (length >= (int) wm->incr_chunk_size &&
+		    wm->incr_chunk_size * 2 <= wm->incr_chunk_max)
+			wm->incr_chunk_size *= 2;
+
 		if (wm->data_source_fd >= 0) {
 			wm->property_source =
 				wl_event_loop_add_fd(wm->server->loop,
@@ -675,10 +688,18 @@ void
 weston_wm_selection_init(struct weston_wm *wm)
 {
 	struct weston_seat *seat;
-	uint32_t values[1], mask;
+	uint32_t values[1], mask, max;
 
 	wm->selection_request.requestor = XCB_NONE;
 
+	max = xcb_get_maximum_request_length(wm->conn) * 4 -
+		sizeof(xcb_change_property_request_t);
+	if (max > INCR_CHUNK_MAX)
+		max = INCR_CHUNK_MAX;
+	if (max < INCR_CHUNK_MIN)
+		max = INCR_CHUNK_MIN;
+	wm->incr_chunk_max = max;
+
 	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
 	wm->selection_window = xcb_generate_id(wm->conn);
 	xcb_create_window(wm->conn,
@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <X11/Xcursor/Xcursor.h>
+#include <xcb/bigreq.h>
 #include <linux/input.h>
 
 #include "xwayland.h"
@@ -115,12 +116,23 @@ struct motif_wm_hints {
 #define _NET_WM_MOVERESIZE_MOVE_KEYBOARD    10   /* move via keyboard */
 #define _NET_WM_MOVERESIZE_CANCEL           11   /* cancel operation */
 
+/* A rendered frame background: border, shadow and title, no buttons */
+struct weston_wm_decoration {
+	cairo_surface_t *surface;
+	int width, height;
+	char *title;
+	uint32_t serial;
+};
+
 struct weston_wm_window {
 	struct weston_wm *wm;
 	xcb_window_t id;
 	xcb_window_t frame_id;
 	struct frame *frame;
 	cairo_surface_t *cairo_surface;
+	struct weston_wm_decoration decoration[2]; /* inactive, active */
+	struct weston_wm_decoration *shown_decoration;
+	uint32_t shown_serial;
 	uint32_t surface_id;
 	struct weston_surface *surface;
 	struct shell_surface *shsurf;
@@ -128,7 +140,7 @@ struct weston_wm_window {
 	struct wl_listener surface_destroy_listener;
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
-	int properties_dirty;
+	uint32_t properties_dirty;
 	int pid;
 	char *machine;
 	char *class;
@@ -266,16 +278,14 @@ xcb_cursor_images_load_cursor(struct weston_wm *wm, const XcursorImages *images)
 	return xcb_cursor_image_load_cursor(wm, images->images[0]);
 }
 
-static xcb_cursor_t
-xcb_cursor_library_load_cursor(struct weston_wm *wm, const char *file)
+static XcursorImages *
+xcursor_library_load_images(const char *file)
 {
-	xcb_cursor_t cursor;
-	XcursorImages *images;
 	char *v = NULL;
 	int size = 0;
 
 	if (!file)
-		return 0;
+		return NULL;
 
 	v = getenv ("XCURSOR_SIZE");
 	if (v)
@@ -284,14 +294,7 @@ xcb_cursor_library_load_cursor(struct weston_wm *wm, const char *file)
 	if (!size)
 		size = 32;
 
-	images = XcursorLibraryLoadImages (file, NULL, size);
-	if (!images)
-		return -1;
-
-	cursor = xcb_cursor_images_load_cursor (wm, images);
-	XcursorImagesDestroy (images);
-
-	return cursor;
+	return XcursorLibraryLoadImages (file, NULL, size);
 }
 
 void
@@ -350,6 +353,7 @@ static void
 read_and_dump_property(struct weston_wm *wm,
 		       xcb_window_t window, xcb_atom_t property)
 {
+#ifdef WM_DEBUG
 	xcb_get_property_reply_t *reply;
 	xcb_get_property_cookie_t cookie;
 
@@ -360,6 +364,7 @@ read_and_dump_property(struct weston_wm *wm,
 	dump_property(wm, property, reply);
 
 	free(reply);
+#endif
 }
 
 /* We reuse some predefined, but otherwise useles atoms */
@@ -368,57 +373,145 @@ read_and_dump_property(struct weston_wm *wm,
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 #define TYPE_WM_NORMAL_HINTS	XCB_ATOM_CUT_BUFFER3
 
+struct weston_wm_property {
+	xcb_atom_t atom;
+	xcb_atom_t type;
+	int offset;
+};
+
+/* Indices into the table filled by weston_wm_get_properties(), and bits
+ * in weston_wm_window::properties_dirty. */
+enum {
+	WM_PROPERTY_CLASS,
+	WM_PROPERTY_NAME,
+	WM_PROPERTY_TRANSIENT_FOR,
+	WM_PROPERTY_PROTOCOLS,
+	WM_PROPERTY_NORMAL_HINTS,
+	WM_PROPERTY_NET_WM_STATE,
+	WM_PROPERTY_WINDOW_TYPE,
+	WM_PROPERTY_NET_WM_NAME,
+	WM_PROPERTY_PID,
+	WM_PROPERTY_MOTIF_HINTS,
+	WM_PROPERTY_CLIENT_MACHINE,
+	WM_PROPERTY_COUNT
+};
+
+#define WM_PROPERTIES_ALL ((1 << WM_PROPERTY_COUNT) - 1)
+
+static void
+weston_wm_get_properties(struct weston_wm *wm,
+			 struct weston_wm_property props[WM_PROPERTY_COUNT])
+{
+#define P(index, atom_, type_, field) \
+	props[index].atom = (atom_); \
+	props[index].type = (type_); \
+	props[index].offset = offsetof(struct weston_wm_window, field)
+
+	P(WM_PROPERTY_CLASS, XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, class);
+	P(WM_PROPERTY_NAME, XCB_ATOM_WM_NAME, XCB_ATOM_STRING, name);
+	P(WM_PROPERTY_TRANSIENT_FOR, XCB_ATOM_WM_TRANSIENT_FOR,
+	  XCB_ATOM_WINDOW, transient_for);
+	P(WM_PROPERTY_PROTOCOLS, wm->atom.wm_protocols,
+	  TYPE_WM_PROTOCOLS, protocols);
+	P(WM_PROPERTY_NORMAL_HINTS, wm->atom.wm_normal_hints,
+	  TYPE_WM_NORMAL_HINTS, size_hints);
+	P(WM_PROPERTY_NET_WM_STATE, wm->atom.net_wm_state,
+	  TYPE_NET_WM_STATE, fullscreen);
+	P(WM_PROPERTY_WINDOW_TYPE, wm->atom.net_wm_window_type,
+	  XCB_ATOM_ATOM, type);
+	P(WM_PROPERTY_NET_WM_NAME, wm->atom.net_wm_name,
+	  XCB_ATOM_STRING, name);
+	P(WM_PROPERTY_PID, wm->atom.net_wm_pid, XCB_ATOM_CARDINAL, pid);
+	P(WM_PROPERTY_MOTIF_HINTS, wm->atom.motif_wm_hints,
+	  TYPE_MOTIF_WM_HINTS, motif_hints);
+	P(WM_PROPERTY_CLIENT_MACHINE, wm->atom.wm_client_machine,
+	  XCB_ATOM_WM_CLIENT_MACHINE, machine);
+#undef P
+}
+
+/* Which of the properties we track a change to atom invalidates */
+static uint32_t
+weston_wm_property_mask(struct weston_wm *wm, xcb_atom_t atom)
+{
+	struct weston_wm_property props[WM_PROPERTY_COUNT];
+	uint32_t i;
+
+	weston_wm_get_properties(wm, props);
+
+	for (i = 0; i < WM_PROPERTY_COUNT; i++) {
+		if (props[i].atom != atom)
+			continue;
+
+		/* WM_NAME and _NET_WM_NAME share window->name, with
+		 * _NET_WM_NAME winning when both are set, so a change to
+		 * either re-reads both. */
+		if (i == WM_PROPERTY_NAME || i == WM_PROPERTY_NET_WM_NAME)
+			return 1 << WM_PROPERTY_NAME |
+				1 << WM_PROPERTY_NET_WM_NAME;
+
+		return 1 << i;
+	}
+
+	return 0;
+}
+
 static void
 weston_wm_window_read_properties(struct weston_wm_window *window)
 {
 	struct weston_wm *wm = window->wm;
 	struct weston_shell_interface *shell_interface =
 		&wm->server->compositor->shell_interface;
-
-#define F(field) offsetof(struct weston_wm_window, field)
-	const struct {
-		xcb_atom_t atom;
-		xcb_atom_t type;
-		int offset;
-	} props[] = {
-		{ XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, F(class) },
-		{ XCB_ATOM_WM_NAME, XCB_ATOM_STRING, F(name) },
-		{ XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, F(transient_for) },
-		{ wm->atom.wm_protocols, TYPE_WM_PROTOCOLS, F(protocols) },
-		{ wm->atom.wm_normal_hints, TYPE_WM_NORMAL_HINTS, F(protocols) },
-		{ wm->atom.net_wm_state, TYPE_NET_WM_STATE },
-		{ wm->atom.net_wm_window_type, XCB_ATOM_ATOM, F(type) },
-		{ wm->atom.net_wm_name, XCB_ATOM_STRING, F(name) },
-		{ wm->atom.net_wm_pid, XCB_ATOM_CARDINAL, F(pid) },
-		{ wm->atom.motif_wm_hints, TYPE_MOTIF_WM_HINTS, 0 },
-		{ wm->atom.wm_client_machine, XCB_ATOM_WM_CLIENT_MACHINE, F(machine) },
-	};
-#undef F
-
-	xcb_get_property_cookie_t cookie[ARRAY_LENGTH(props)];
+	struct weston_wm_property props[WM_PROPERTY_COUNT];
+	xcb_get_property_cookie_t cookie[WM_PROPERTY_COUNT];
 	xcb_get_property_reply_t *reply;
+	uint32_t dirty;
 	void *p;
 	uint32_t *xid;
 	xcb_atom_t *atom;
-	uint32_t i;
+	uint32_t i, j;
 
-	if (!window->properties_dirty)
+	dirty = window->properties_dirty;
+	if (!dirty)
 		return;
 	window->properties_dirty = 0;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
+	weston_wm_get_properties(wm, props);
+
+	for (i = 0; i < WM_PROPERTY_COUNT; i++) {
+		if (!(dirty & (1 << i))) {
+			wm->properties_skipped++;
+			continue;
+		}
 		cookie[i] = xcb_get_property(wm->conn,
 					     0, /* delete */
 					     window->id,
 					     props[i].atom,
 					     XCB_ATOM_ANY, 0, 2048);
+		wm->properties_read++;
+	}
 
-	window->decorate = !window->override_redirect;
-	window->size_hints.flags = 0;
-	window->motif_hints.flags = 0;
-	window->delete_window = 0;
+	wm_log("XCB properties: window %d, read 0x%03x "
+	       "(%u read, %u skipped in total)\n",
+	       window->id, dirty,
+	       wm->properties_read, wm->properties_skipped);
+
+	if (dirty & (1 << WM_PROPERTY_MOTIF_HINTS)) {
+		window->decorate = !window->override_redirect;
+		window->motif_hints.flags = 0;
+	}
+	if (dirty & (1 << WM_PROPERTY_NORMAL_HINTS))
+		window->size_hints.flags = 0;
+	if (dirty & (1 << WM_PROPERTY_PROTOCOLS))
+		window->delete_window = 0;
+	if (dirty & (1 << WM_PROPERTY_NAME | 1 << WM_PROPERTY_NET_WM_NAME)) {
+		free(window->name);
+		window->name = NULL;
+	}
+
+	for (i = 0; i < WM_PROPERTY_COUNT; i++)  {
+		if (!(dirty & (1 << i)))
+			continue;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
 		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
 		if (!reply)
 			/* Bad window, typically */
@@ -455,12 +548,10 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 			break;
 		case TYPE_WM_PROTOCOLS:
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.wm_delete_window)
+			for (j = 0; j < reply->value_len; j++)
+				if (atom[j] == wm->atom.wm_delete_window)
 					window->delete_window = 1;
 			break;
-
-			break;
 		case TYPE_WM_NORMAL_HINTS:
 			memcpy(&window->size_hints,
 			       xcb_get_property_value(reply),
@@ -469,8 +560,8 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		case TYPE_NET_WM_STATE:
 			window->fullscreen = 0;
 			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.net_wm_state_fullscreen)
+			for (j = 0; j < reply->value_len; j++)
+				if (atom[j] == wm->atom.net_wm_state_fullscreen)
 					window->fullscreen = 1;
 			break;
 		case TYPE_MOTIF_WM_HINTS:
@@ -487,6 +578,9 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		free(reply);
 	}
 
+	if (!(dirty & (1 << WM_PROPERTY_NAME | 1 << WM_PROPERTY_NET_WM_NAME)))
+		return;
+
 	if (window->shsurf && window->name)
 		shell_interface->set_title(window->shsurf, window->name);
 	if (window->frame && window->name)
@@ -883,6 +977,9 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	if (window->frame_id == XCB_WINDOW_NONE)
 		weston_wm_window_create_frame(window);
 
+	/* The frame window loses its contents while unmapped. */
+	window->shown_decoration = NULL;
+
 	wm_log("XCB_MAP_REQUEST (window %d, %p, frame %d)\n",
 	       window->id, window, window->frame_id);
 
@@ -938,6 +1035,103 @@ weston_wm_handle_unmap_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 	xcb_unmap_window(wm->conn, window->frame_id);
 }
 
+static int
+title_equal(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	return strcmp(a, b) == 0;
+}
+
+static void
+weston_wm_decoration_fini(struct weston_wm_decoration *decoration)
+{
+	if (decoration->surface)
+		cairo_surface_destroy(decoration->surface);
+	free(decoration->title);
+	decoration->surface = NULL;
+	decoration->title = NULL;
+}
+
+/* The background for the window's current look, rendered into a pixmap
+ * next to the frame window only when its size or title changed.  The
+ * active and inactive looks are kept apart, so focus changes are just
+ * copies. */
+static struct weston_wm_decoration *
+weston_wm_window_get_decoration(struct weston_wm_window *window,
+				int width, int height)
+{
+	struct weston_wm_decoration *decoration;
+	cairo_t *cr;
+
+	decoration = &window->decoration[window->wm->focus_window == window];
+	if (decoration->surface &&
+	    decoration->width == width && decoration->height == height &&
+	    title_equal(decoration->title, window->name))
+		return decoration;
+
+	if (!decoration->surface ||
+	    decoration->width != width || decoration->height != height) {
+		weston_wm_decoration_fini(decoration);
+		decoration->surface =
+			cairo_surface_create_similar(window->cairo_surface,
+						     CAIRO_CONTENT_COLOR_ALPHA,
+						     width, height);
+		if (cairo_surface_status(decoration->surface) !=
+		    CAIRO_STATUS_SUCCESS) {
+			weston_wm_decoration_fini(decoration);
+			return NULL;
+		}
+		decoration->width = width;
+		decoration->height = height;
+	}
+
+	free(decoration->title);
+	decoration->title = window->name ? strdup(window->name) : NULL;
+
+	cr = cairo_create(decoration->surface);
+	frame_repaint_background(window->frame, cr);
+	cairo_destroy(cr);
+	decoration->serial++;
+
+	return decoration;
+}
+
+static void
+weston_wm_window_paint_frame(struct weston_wm_window *window, cairo_t *cr,
+			     int width, int height)
+{
+	struct theme *t = window->wm->theme;
+	struct weston_wm_decoration *decoration;
+
+	decoration = weston_wm_window_get_decoration(window, width, height);
+	if (decoration == NULL) {
+		frame_repaint(window->frame, cr);
+		window->shown_decoration = NULL;
+		return;
+	}
+
+	/* If the window already shows this background, only the buttons
+	 * can have changed, and they all sit in the title bar. */
+	if (window->shown_decoration == decoration &&
+	    window->shown_serial == decoration->serial) {
+		cairo_rectangle(cr, t->margin, t->margin,
+				width - t->margin * 2, t->titlebar_height);
+		cairo_clip(cr);
+	}
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, decoration->surface, 0, 0);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	frame_repaint_buttons(window->frame, cr);
+
+	window->shown_decoration = decoration;
+	window->shown_serial = decoration->serial;
+}
+
 static void
 weston_wm_window_draw_decoration(void *data)
 {
@@ -949,7 +1143,6 @@ weston_wm_window_draw_decoration(void *data)
 	int32_t input_x, input_y, input_w, input_h;
 	struct weston_shell_interface *shell_interface =
 		&wm->server->compositor->shell_interface;
-	uint32_t flags = 0;
 
 	weston_wm_window_read_properties(window);
 
@@ -962,13 +1155,13 @@ weston_wm_window_draw_decoration(void *data)
 	cr = cairo_create(window->cairo_surface);
 
 	if (window->fullscreen) {
-		/* nothing */
+		/* nothing, and the client covers what was there */
+		window->shown_decoration = NULL;
 	} else if (window->decorate) {
-		if (wm->focus_window == window)
-			flags |= THEME_FRAME_ACTIVE;
-
-		frame_repaint(window->frame, cr);
+		weston_wm_window_paint_frame(window, cr, width, height);
 	} else {
+		window->shown_decoration = NULL;
+
 		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 		cairo_set_source_rgba(cr, 0, 0, 0, 0);
 		cairo_paint(cr);
@@ -1058,7 +1251,8 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	if (!window)
 		return;
 
-	window->properties_dirty = 1;
+	window->properties_dirty |=
+		weston_wm_property_mask(wm, property_notify->atom);
 
 	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", property_notify->window);
 	if (property_notify->state == XCB_PROPERTY_DELETE)
@@ -1094,7 +1288,7 @@ weston_wm_window_create(struct weston_wm *wm,
 
 	window->wm = wm;
 	window->id = id;
-	window->properties_dirty = 1;
+	window->properties_dirty = WM_PROPERTIES_ALL;
 	window->override_redirect = override;
 	window->width = width;
 	window->height = height;
@@ -1118,6 +1312,8 @@ weston_wm_window_destroy(struct weston_wm_window *window)
 
 	if (window->repaint_source)
 		wl_event_source_remove(window->repaint_source);
+	weston_wm_decoration_fini(&window->decoration[0]);
+	weston_wm_decoration_fini(&window->decoration[1]);
 	if (window->cairo_surface)
 		cairo_surface_destroy(window->cairo_surface);
 
@@ -1509,25 +1705,82 @@ static const struct cursor_alternatives cursors[] = {
 	{left_ptrs, ARRAY_LENGTH(left_ptrs)},
 };
 
-static void
+struct weston_wm_cursor_cache {
+	XcursorImages *images[ARRAY_LENGTH(cursors)];
+};
+
+/* Decoding the Xcursor theme means reading and parsing files from disk,
+ * so it is done once per compositor rather than once per X server. */
+static struct weston_wm_cursor_cache *
+weston_wm_cursor_cache_create(void)
+{
+	struct weston_wm_cursor_cache *cache;
+	XcursorImages *images;
+	size_t i, j;
+
+	cache = zalloc(sizeof *cache);
+	if (cache == NULL)
+		return NULL;
+
+	for (i = 0; i < ARRAY_LENGTH(cursors); i++) {
+		for (j = 0; j < cursors[i].count; j++) {
+			images =
+				xcursor_library_load_images(cursors[i].names[j]);
+			if (!images)
+				continue;
+			if (images->nimage == 1) {
+				cache->images[i] = images;
+				break;
+			}
+			XcursorImagesDestroy(images);
+		}
+	}
+
+	return cache;
+}
+
+void
+weston_wm_cursor_cache_destroy(struct weston_wm_cursor_cache *cache)
+{
+	size_t i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < ARRAY_LENGTH(cursors); i++)
+		if (cache->images[i])
+			XcursorImagesDestroy(cache->images[i]);
+
+	free(cache);
+}
+
+static int
 weston_wm_create_cursors(struct weston_wm *wm)
 {
-	const char *name;
+	struct weston_xserver *wxs = wm->server;
 	int i, count = ARRAY_LENGTH(cursors);
-	size_t j;
+	int cached = wxs->cursor_cache != NULL;
+	XcursorImages *images;
+
+	if (!cached)
+		wxs->cursor_cache = weston_wm_cursor_cache_create();
 
 	wm->cursors = malloc(count * sizeof(xcb_cursor_t));
 	for (i = 0; i < count; i++) {
-		for (j = 0; j < cursors[i].count; j++) {
-			name = cursors[i].names[j];
+		images = NULL;
+		if (wxs->cursor_cache)
+			images = wxs->cursor_cache->images[i];
+
+		if (images)
 			wm->cursors[i] =
-				xcb_cursor_library_load_cursor(wm, name);
-			if (wm->cursors[i] != (xcb_cursor_t)-1)
-				break;
-		}
+				xcb_cursor_images_load_cursor(wm, images);
+		else
+			wm->cursors[i] = -1;
 	}
 
 	wm->last_cursor = -1;
+
+	return cached;
 }
 
 static void
@@ -1915,6 +2168,7 @@ weston_wm_get_resources(struct weston_wm *wm)
 	xcb_render_pictforminfo_t *formats;
 	uint32_t i;
 
+	xcb_prefetch_extension_data (wm->conn, &xcb_big_requests_id);
 	xcb_prefetch_extension_data (wm->conn, &xcb_xfixes_id);
 	xcb_prefetch_extension_data (wm->conn, &xcb_composite_id);
 
@@ -1925,12 +2179,11 @@ weston_wm_get_resources(struct weston_wm *wm)
 					      strlen(atoms[i].name),
 					      atoms[i].name);
 
-	for (i = 0; i < ARRAY_LENGTH(atoms); i++) {
-		reply = xcb_intern_atom_reply (wm->conn, cookies[i], NULL);
-		*(xcb_atom_t *) ((char *) wm + atoms[i].offset) = reply->atom;
-		free(reply);
-	}
-
+	/* Nothing above waited for a reply.  The extension queries come
+	 * back in the first round trip, and the requests that need their
+	 * opcodes (the XFixes version and BIG-REQUESTS, which selection
+	 * setup needs) share a second one; the atom and format replies
+	 * arrive in the meantime. */
 	wm->xfixes = xcb_get_extension_data(wm->conn, &xcb_xfixes_id);
 	if (!wm->xfixes || !wm->xfixes->present)
 		weston_log("xfixes not available\n");
@@ -1938,6 +2191,14 @@ weston_wm_get_resources(struct weston_wm *wm)
 	xfixes_cookie = xcb_xfixes_query_version(wm->conn,
 						 XCB_XFIXES_MAJOR_VERSION,
 						 XCB_XFIXES_MINOR_VERSION);
+	xcb_prefetch_maximum_request_length(wm->conn);
+
+	for (i = 0; i < ARRAY_LENGTH(atoms); i++) {
+		reply = xcb_intern_atom_reply (wm->conn, cookies[i], NULL);
+		*(xcb_atom_t *) ((char *) wm + atoms[i].offset) = reply->atom;
+		free(reply);
+	}
+
 	xfixes_reply = xcb_xfixes_query_version_reply(wm->conn,
 						      xfixes_cookie, NULL);
 
@@ -2023,6 +2284,13 @@ weston_wm_create_wm_window(struct weston_wm *wm)
 				XCB_TIME_CURRENT_TIME);
 }
 
+static long
+elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000 +
+		(end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
 struct weston_wm *
 weston_wm_create(struct weston_xserver *wxs, int fd)
 {
@@ -2031,6 +2299,10 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 	xcb_screen_iterator_t s;
 	uint32_t values[1];
 	xcb_atom_t supported[3];
+	struct timespec start, end;
+	int cursors_cached;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	wm = zalloc(sizeof *wm);
 	if (wm == NULL)
@@ -2109,14 +2381,21 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 		      &wm->kill_listener);
 	wl_list_init(&wm->unpaired_window_list);
 
-	weston_wm_create_cursors(wm);
+	cursors_cached = weston_wm_create_cursors(wm);
 	weston_wm_window_set_cursor(wm, wm->screen->root, XWM_CURSOR_LEFT_PTR);
 
 	/* Create wm window and take WM_S0 selection last, which
 	 * signals to Xwayland that we're done with setup. */
 	weston_wm_create_wm_window(wm);
+	xcb_flush(wm->conn);
 
-	weston_log("created wm, root %d\n", wm->screen->root);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	weston_log("created wm, root %d: X server ready after %ld ms, "
+		   "wm setup took %ld ms (cursors %s)\n",
+		   wm->screen->root,
+		   elapsed_ms(&wxs->spawn_time, &start),
+		   elapsed_ms(&start, &end),
+		   cursors_cached ? "cached" : "loaded");
 
 	return wm;
 }
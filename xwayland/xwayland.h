@@ -20,6 +20,7 @@
  * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <time.h>
 #include <wayland-server.h>
 #include <xcb/xcb.h>
 #include <xcb/xfixes.h>
@@ -31,6 +32,8 @@
 #define SEND_EVENT_MASK (0x80)
 #define EVENT_TYPE(event) ((event)->response_type & ~SEND_EVENT_MASK)
 
+struct weston_wm_cursor_cache;
+
 struct weston_xserver {
 	struct wl_display *wl_display;
 	struct wl_event_loop *loop;
@@ -48,6 +51,9 @@ struct weston_xserver {
 	struct weston_compositor *compositor;
 	struct weston_wm *wm;
 	struct wl_listener destroy_listener;
+	struct timespec spawn_time;
+	/* Decoded cursor images, kept across X server restarts */
+	struct weston_wm_cursor_cache *cursor_cache;
 };
 
 struct weston_wm {
@@ -70,6 +76,8 @@ struct weston_wm {
 	struct wl_listener transform_listener;
 	struct wl_listener kill_listener;
 	struct wl_list unpaired_window_list;
+	uint32_t properties_read;
+	uint32_t properties_skipped;
 
 	xcb_window_t selection_window;
 	xcb_window_t selection_owner;
@@ -79,6 +87,8 @@ struct weston_wm {
 	xcb_get_property_reply_t *property_reply;
 	int property_start;
 	struct wl_array source_data;
+	uint32_t incr_chunk_size;
+	uint32_t incr_chunk_max;
 	xcb_selection_request_event_t selection_request;
 	xcb_atom_t selection_target;
 	xcb_timestamp_t selection_timestamp;
@@ -167,6 +177,8 @@ struct weston_wm *
 weston_wm_create(struct weston_xserver *wxs, int fd);
 void
 weston_wm_destroy(struct weston_wm *wm);
+void
+weston_wm_cursor_cache_destroy(struct weston_wm_cursor_cache *cache);
 
 struct weston_seat *
 weston_wm_pick_seat(struct weston_wm *wm);